@@ -31,6 +31,39 @@
 static serial_t bdm12pod_serial;
 static uint8_t bdm12pod_version;
 static uint8_t bdm12pod_reset_delay;
+static unsigned long bdm12pod_timeout;
+static int bdm12pod_probing;
+
+/* baud rates probed when none is given, default one first (POD answering
+   there needs no other probes), then faster ones, then slower ones */
+
+static const unsigned long bdm12pod_baud_table[] =
+{
+	BDM12POD_DEFAULT_BAUD_RATE,
+	1000000,
+	921600,
+	500000,
+	460800,
+	230400,
+	57600,
+	38400,
+	19200,
+	9600
+};
+
+#define BDM12POD_BAUD_TABLE_SIZE \
+	(sizeof(bdm12pod_baud_table) / sizeof(bdm12pod_baud_table[0]))
+
+/* commands in flight, waiting for answers */
+
+static struct
+{
+	uint8_t *drx;
+	size_t nrx;
+}
+bdm12pod_pipe[BDM12POD_PIPE_DEPTH];
+static int bdm12pod_pipe_count;
+static size_t bdm12pod_pipe_rx;
 
 
 /*
@@ -67,11 +100,12 @@ static int bdm12pod_tx(const uint8_t *data, size_t len)
 			if (ret != 0)
 				return ret;
 		}
-		while (!state && sys_get_ms() - start < BDM12POD_CTS_TIMEOUT);
+		while (!state && sys_get_ms() - start < bdm12pod_timeout);
 
 		if (!state)
 		{
-			error("BDM12POD not ready (CTS not asserted)\n");
+			if (!bdm12pod_probing)
+				error("BDM12POD not ready (CTS not asserted)\n");
 			return EIO;
 		}
 
@@ -88,11 +122,12 @@ static int bdm12pod_tx(const uint8_t *data, size_t len)
 			if (ret != 0)
 				return ret;
 		}
-		while (state && sys_get_ms() - start < BDM12POD_CTS_TIMEOUT);
+		while (state && sys_get_ms() - start < bdm12pod_timeout);
 
 		if (state)
 		{
-			error("BDM12POD not ready (CTS not lowered)\n");
+			if (!bdm12pod_probing)
+				error("BDM12POD not ready (CTS not lowered)\n");
 			return EIO;
 		}
 
@@ -108,33 +143,106 @@ static int bdm12pod_tx(const uint8_t *data, size_t len)
 
 
 /*
- *  send command to POD and get answer
+ *  collect answers for all commands in flight, in order of sending
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int bdm12pod_pipe_flush(void)
+{
+	int i;
+	size_t n;
+	int ret;
+
+	ret = 0;
+	for (i = 0; i < bdm12pod_pipe_count && ret == 0; ++ i)
+	{
+		n = bdm12pod_pipe[i].nrx;
+		ret = serial_read(&bdm12pod_serial, bdm12pod_pipe[i].drx, &n,
+			(bdm12pod_probing ? BDM12POD_PROBE_TIMEOUT : BDM12POD_RX_TIMEOUT));
+		if (ret == ETIMEDOUT && !bdm12pod_probing)
+			error("connection timed out\n");
+	}
+
+	bdm12pod_pipe_count = 0;
+	bdm12pod_pipe_rx = 0;
+
+	return ret;
+}
+
+
+/*
+ *  send command to POD, answer is collected later
+ *  (by bdm12pod_pipe_flush()), so next commands can be sent
+ *  without waiting for answer round trip
  *
  *  in:
  *    dtx - data buffer for send
  *    ntx - size of data to send
- *    drx - data buffer for read
+ *    drx - data buffer for read (must be valid until flush)
  *    nrx - size of data to read
  *  out:
  *    status code (errno-like)
  */
 
-static int bdm12pod_dialog(const uint8_t *dtx, size_t ntx,
+static int bdm12pod_pipe_submit(const uint8_t *dtx, size_t ntx,
 	uint8_t *drx, size_t nrx)
 {
 	int ret;
 
+	if (bdm12pod_pipe_count == BDM12POD_PIPE_DEPTH ||
+	    (bdm12pod_pipe_count != 0 && bdm12pod_pipe_rx + nrx > BDM12POD_PIPE_RX_MAX))
+	{
+		ret = bdm12pod_pipe_flush();
+		if (ret != 0)
+			return ret;
+	}
+
 	ret = bdm12pod_tx(dtx, ntx);
 	if (ret != 0)
+	{
+		bdm12pod_pipe_count = 0;
+		bdm12pod_pipe_rx = 0;
 		return ret;
+	}
 
-	ret = serial_read(&bdm12pod_serial, drx, &nrx, BDM12POD_RX_TIMEOUT);
-	if (ret == ETIMEDOUT)
+	if (nrx != 0)
 	{
-		error("connection timed out\n");
-		return ret;
+		bdm12pod_pipe[bdm12pod_pipe_count].drx = drx;
+		bdm12pod_pipe[bdm12pod_pipe_count].nrx = nrx;
+		++ bdm12pod_pipe_count;
+		bdm12pod_pipe_rx += nrx;
 	}
-	return ret;
+
+	return 0;
+}
+
+
+/*
+ *  send command to POD and get answer
+ *
+ *  in:
+ *    dtx - data buffer for send
+ *    ntx - size of data to send
+ *    drx - data buffer for read
+ *    nrx - size of data to read
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int bdm12pod_dialog(const uint8_t *dtx, size_t ntx,
+	uint8_t *drx, size_t nrx)
+{
+	int ret;
+
+	ret = bdm12pod_pipe_submit(dtx, ntx, drx, nrx);
+	if (ret != 0)
+		return ret;
+
+	return bdm12pod_pipe_flush();
 }
 
 
@@ -369,12 +477,13 @@ static int bdm12pod_reg_dump(void)
 
 
 /*
- *  target memory dump
+ *  target memory dump - command is only sent, data is in buffer
+ *  after bdm12pod_pipe_flush()
  *
  *  in:
  *    addr - target memory address
- *    buf - buffer for data to read
- *    len - size of data to read
+ *    buf - buffer for data to read (must be valid until flush)
+ *    len - size of data to read (in words)
  *  out:
  *    status code (errno-like)
  */
@@ -382,30 +491,20 @@ static int bdm12pod_reg_dump(void)
 static int bdm12pod_mem_dump(uint16_t addr, uint16_t *buf, uint16_t len)
 {
 	uint8_t q[6];
-	int ret;
 
 	q[0] = BDM12POD_CMD_EXT;
 	q[1] = BDM12POD_CMD_EXT_MEM_DUMP;
 	uint16_host2be_to_buf(q + 2, addr);
 	uint16_host2be_to_buf(q + 4, len);
 
-	ret = bdm12pod_dialog(q, sizeof(q), (uint8_t *)buf, len * 2);
-	if (ret != 0)
-		return ret;
-
 	if (options.debug)
 	{
-		int i;
-
 		printf("BDM12POD mem dump address <0x%04x> len <%u>\n",
 		       (unsigned int)addr,
 		       (unsigned int)(len * 2));
-		for (i = 0; i < len * 2; ++ i)
-			printf("%02x  ", (unsigned int)(((uint8_t *)buf)[i]));
-		printf("\n");
 	}
 
-	return 0;
+	return bdm12pod_pipe_submit(q, sizeof(q), (uint8_t *)buf, len * 2);
 }
 
 
@@ -534,6 +633,23 @@ static int bdm12pod_set_param(unsigned long osc,
 }
 
 
+/*
+ *  set new target BDM clock
+ *
+ *  in:
+ *    f - target frequency, same meaning as oscillator frequency at open
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int bdm12pod_set_clock(unsigned long f)
+{
+	return bdm12pod_set_param(f,
+		BDM12POD_DEFAULT_TRACE_DELAY,
+		bdm12pod_reset_delay);
+}
+
+
 /*
  *  execute BACKGROUND command
  *
@@ -1087,9 +1203,9 @@ static int bdm12pod_taggo(void)
 static int bdm12pod_read_mem(uint16_t addr, void *buf, size_t len)
 {
 	uint8_t *ptr;
+	uint8_t q[3];
 	size_t n;
 	size_t i;
-	uint16_t v;
 	int ret;
 
 	if (len == 0)
@@ -1113,19 +1229,53 @@ static int bdm12pod_read_mem(uint16_t addr, void *buf, size_t len)
 
 		if (options.podex_mem_bug)
 		{
+			/* READ_WORD answer is big-endian word, the same as
+			   memory image, so it goes directly into buffer */
+
 			for (i = 0; i < n; ++ i)
 			{
-				ret = bdm12pod_read_word((uint16_t)(addr + i * 2), &v);
+				q[0] = HCS12BDM_CMD_HW_READ_WORD;
+				uint16_host2be_to_buf(q + 1, (uint16_t)(addr + i * 2));
+				ret = bdm12pod_pipe_submit(q, sizeof(q), ptr + i * 2, 2);
 				if (ret != 0)
 					return ret;
-				uint16_host2be_to_buf(ptr + i * 2, v);
+			}
+
+			ret = bdm12pod_pipe_flush();
+			if (ret != 0)
+				return ret;
+
+			if (options.debug)
+			{
+				printf("BDM12POD cmd <READ_WORD> x <%u> addr <0x%04x> pipelined\n",
+				       (unsigned int)n,
+				       (unsigned int)addr);
 			}
 		}
 		else
 		{
-			ret = bdm12pod_mem_dump(addr, (uint16_t *)ptr, (uint16_t)n);
+			/* dump commands are sent ahead, next answer is already
+			   on the way while previous one is read */
+
+			for (i = 0; i < n; i += BDM12POD_MEM_DUMP_CHUNK)
+			{
+				ret = bdm12pod_mem_dump((uint16_t)(addr + i * 2),
+					(uint16_t *)(ptr + i * 2),
+					(uint16_t)(n - i < BDM12POD_MEM_DUMP_CHUNK ? n - i : BDM12POD_MEM_DUMP_CHUNK));
+				if (ret != 0)
+					return ret;
+			}
+
+			ret = bdm12pod_pipe_flush();
 			if (ret != 0)
 				return ret;
+
+			if (options.debug)
+			{
+				for (i = 0; i < n * 2; ++ i)
+					printf("%02x  ", (unsigned int)ptr[i]);
+				printf("\n");
+			}
 		}
 
 		n *= 2;
@@ -1217,6 +1367,78 @@ static int bdm12pod_write_mem(uint16_t addr, const void *buf, size_t len)
 }
 
 
+/*
+ *  check if POD answers at given baud rate
+ *
+ *  in:
+ *    baud - baud rate to check
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int bdm12pod_probe(unsigned long baud)
+{
+	serial_cfg_t cfg;
+	uint8_t q[BDM12POD_PROBE_SYNC_PAD + 2];
+	uint8_t a[2];
+	size_t n;
+	int ret;
+
+	cfg.baud_rate = baud;
+	cfg.char_size = SERIAL_CFG_CHAR_SIZE_8;
+	cfg.parity = SERIAL_CFG_PARITY_NONE;
+	cfg.stop_bits = SERIAL_CFG_STOP_BITS_1;
+	cfg.handshake = SERIAL_CFG_HANDSHAKE_NONE;
+
+	ret = serial_set_cfg(&bdm12pod_serial, &cfg);
+	if (ret != 0)
+		return ret;
+
+	serial_flush(&bdm12pod_serial);
+
+	/* SYNC bytes complete any command left unfinished by previous probes
+	   at wrong baud rate, then version query checks the link */
+
+	memset(q, BDM12POD_CMD_SYNC, BDM12POD_PROBE_SYNC_PAD);
+	q[BDM12POD_PROBE_SYNC_PAD + 0] = BDM12POD_CMD_EXT;
+	q[BDM12POD_PROBE_SYNC_PAD + 1] = BDM12POD_CMD_EXT_GET_VERSION;
+
+	bdm12pod_probing = TRUE;
+	bdm12pod_timeout = BDM12POD_PROBE_TIMEOUT;
+	ret = bdm12pod_dialog(q, sizeof(q), a + 0, 1);
+	if (ret == 0)
+	{
+		/* garbage answer at wrong baud rate may look like sane
+		   version too, so version is asked once more - the same
+		   answer must come, with nothing following it */
+
+		ret = bdm12pod_dialog(q + BDM12POD_PROBE_SYNC_PAD, 2, a + 1, 1);
+	}
+	bdm12pod_probing = FALSE;
+	bdm12pod_timeout = BDM12POD_CTS_TIMEOUT;
+	if (ret != 0)
+		return ret;
+
+	if ((a[0] & 0x7f) < 0x10 || (a[0] & 0x0f) > 9 || a[1] != a[0])
+		return EIO;
+
+	n = 1;
+	if (serial_read(&bdm12pod_serial, a, &n, BDM12POD_PROBE_QUIET) == 0)
+	{
+		serial_flush(&bdm12pod_serial);
+		return EIO;
+	}
+
+	if (options.debug)
+	{
+		printf("BDM12POD answers at <%lu bps>\n",
+		       (unsigned long)baud);
+	}
+
+	return 0;
+}
+
+
 /*
  *  open POD connection
  *
@@ -1229,6 +1451,7 @@ static int bdm12pod_write_mem(uint16_t addr, const void *buf, size_t len)
 static int bdm12pod_open(void)
 {
 	serial_cfg_t cfg;
+	unsigned int i;
 	int ret;
 
 	if (options.osc == 0)
@@ -1247,18 +1470,43 @@ static int bdm12pod_open(void)
 	if (ret != 0)
 		return ret;
 
+	bdm12pod_pipe_count = 0;
+	bdm12pod_pipe_rx = 0;
+	bdm12pod_probing = FALSE;
+	bdm12pod_timeout = BDM12POD_CTS_TIMEOUT;
+
+	/* without given baud rate, find the one POD answers at */
+
 	if (options.baud == 0)
-		options.baud = BDM12POD_DEFAULT_BAUD_RATE;
+	{
+		for (i = 0; i < BDM12POD_BAUD_TABLE_SIZE; ++ i)
+		{
+			if (bdm12pod_probe(bdm12pod_baud_table[i]) == 0)
+				break;
+		}
 
-	cfg.baud_rate = options.baud;
-	cfg.char_size = SERIAL_CFG_CHAR_SIZE_8;
-	cfg.parity = SERIAL_CFG_PARITY_NONE;
-	cfg.stop_bits = SERIAL_CFG_STOP_BITS_1;
-	cfg.handshake = SERIAL_CFG_HANDSHAKE_NONE;
+		if (i == BDM12POD_BAUD_TABLE_SIZE)
+		{
+			error("BDM12POD not responding at any baud rate\n"
+			      "Consider specifying one with -b option\n");
+			ret = ETIMEDOUT;
+			goto error;
+		}
 
-	ret = serial_set_cfg(&bdm12pod_serial, &cfg);
-	if (ret != 0)
-		goto error;
+		options.baud = bdm12pod_baud_table[i];
+	}
+	else
+	{
+		cfg.baud_rate = options.baud;
+		cfg.char_size = SERIAL_CFG_CHAR_SIZE_8;
+		cfg.parity = SERIAL_CFG_PARITY_NONE;
+		cfg.stop_bits = SERIAL_CFG_STOP_BITS_1;
+		cfg.handshake = SERIAL_CFG_HANDSHAKE_NONE;
+
+		ret = serial_set_cfg(&bdm12pod_serial, &cfg);
+		if (ret != 0)
+			goto error;
+	}
 
 	if (options.verbose)
 	{
@@ -1332,5 +1580,6 @@ hcs12bdm_handler_t bdm12pod_bdm_handler =
 	bdm12pod_go,
 	bdm12pod_go_until,
 	bdm12pod_trace1,
-	bdm12pod_taggo
+	bdm12pod_taggo,
+	bdm12pod_set_clock
 };
@@ -34,6 +34,16 @@
 #define BDM12POD_TX_TIMEOUT  2000 /* ms */
 #define BDM12POD_DEFAULT_TRACE_DELAY 0 /* ms */
 #define BDM12POD_DEFAULT_RESET_DELAY 1 /* ms */
+#define BDM12POD_PROBE_TIMEOUT 250 /* ms */
+#define BDM12POD_PROBE_SYNC_PAD 6 /* SYNC bytes completing partial command */
+#define BDM12POD_PROBE_QUIET 20 /* ms, no stray bytes after probe answers */
+
+/* pipelined commands - limits of commands sent before reading answers,
+   kept well below serial port input buffer size */
+
+#define BDM12POD_PIPE_DEPTH  32 /* commands */
+#define BDM12POD_PIPE_RX_MAX 512 /* answer bytes, two MEM_DUMP answers */
+#define BDM12POD_MEM_DUMP_CHUNK 128 /* words per MEM_DUMP command */
 
 /* BDM12POD commands */
 
@@ -26,6 +26,7 @@
 #include "bdm12pod.h"
 #include "tbdml.h"
 #include "srec.h"
+#include "image.h"
 #include "../target/agent.h"
 
 
@@ -34,10 +35,47 @@
 static hcs12bdm_handler_t *hcs12bdm_handler;
 static uint32_t hcs12bdm_ram_entry;
 static int hcs12bdm_agent_loaded;
+static int hcs12bdm_agent_current; /* agent carries current tag version */
 static uint16_t hcs12bdm_agent_param;
 static uint16_t hcs12bdm_agent_buf_addr;
 static uint16_t hcs12bdm_agent_buf_len;
-static uint8_t hcs12bdm_ppage;
+static unsigned long hcs12bdm_bus_clock;
+static int hcs12bdm_pll_active;
+static uint8_t *hcs12bdm_agent_multi_buf;
+
+/* command ring - FLASH write chunks batched in target RAM below agent,
+   descriptors from ring start, data from ring end */
+
+static uint16_t hcs12bdm_ring_addr;
+static uint16_t hcs12bdm_ring_size;
+static uint8_t *hcs12bdm_ring_buf;
+static int hcs12bdm_ring_n;
+static uint16_t hcs12bdm_ring_used;
+
+/* shadow copies of registers, changed only by hcs12mem while target
+   is halted - valid until reset or target code execution */
+
+static struct
+{
+	uint16_t addr;
+	int bd;
+	int valid;
+	uint8_t value;
+}
+hcs12bdm_shadow_table[] =
+{
+	{ HCS12_IO_PPAGE,      FALSE, FALSE, 0 },
+	{ HCS12_IO_SYNR,       FALSE, FALSE, 0 },
+	{ HCS12_IO_REFDV,      FALSE, FALSE, 0 },
+	{ HCS12_IO_CLKSEL,     FALSE, FALSE, 0 },
+	{ HCS12_IO_PLLCTL,     FALSE, FALSE, 0 },
+	{ HCS12_IO_FTSTMOD,    FALSE, FALSE, 0 },
+	{ HCS12_IO_FCNFG,      FALSE, FALSE, 0 },
+	{ HCS12_IO_FPROT,      FALSE, FALSE, 0 },
+	{ HCS12_IO_ECNFG,      FALSE, FALSE, 0 },
+	{ HCS12_IO_EPROT,      FALSE, FALSE, 0 },
+	{ HCS12BDM_REG_BDMGPR, TRUE,  FALSE, 0 }
+};
 
 static const struct
 {
@@ -90,7 +128,127 @@ static int hcs12bdm_wait_active(unsigned long timeout)
 
 
 /*
- *  initialize FLASH/EEPROM clock
+ *  find register shadow
+ *
+ *  in:
+ *    addr - register address
+ *  out:
+ *    shadow table index, -1 when register is not shadowed
+ */
+
+static int hcs12bdm_reg_shadow(uint16_t addr)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(hcs12bdm_shadow_table) / sizeof(hcs12bdm_shadow_table[0])); ++ i)
+	{
+		if (hcs12bdm_shadow_table[i].addr == addr)
+			return i;
+	}
+	return -1;
+}
+
+
+/*
+ *  forget all register shadows, target may change registers
+ *
+ *  in:
+ *    void
+ *  out:
+ *    void
+ */
+
+static void hcs12bdm_reg_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(hcs12bdm_shadow_table) / sizeof(hcs12bdm_shadow_table[0])); ++ i)
+		hcs12bdm_shadow_table[i].valid = FALSE;
+}
+
+
+/*
+ *  read register, from shadow when known
+ *
+ *  in:
+ *    addr - register address
+ *    v - on return, register value
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_reg_read(uint16_t addr, uint8_t *v)
+{
+	int i;
+	int ret;
+
+	i = hcs12bdm_reg_shadow(addr);
+	if (i >= 0 && hcs12bdm_shadow_table[i].valid)
+	{
+		*v = hcs12bdm_shadow_table[i].value;
+		return 0;
+	}
+
+	if (i >= 0 && hcs12bdm_shadow_table[i].bd)
+		ret = (*hcs12bdm_handler->read_bd_byte)(addr, v);
+	else
+		ret = (*hcs12bdm_handler->read_byte)(addr, v);
+	if (ret != 0)
+		return ret;
+
+	if (i >= 0)
+	{
+		hcs12bdm_shadow_table[i].value = *v;
+		hcs12bdm_shadow_table[i].valid = TRUE;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  write register, skipped when shadow holds the same value
+ *
+ *  in:
+ *    addr - register address
+ *    v - value to write
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_reg_write(uint16_t addr, uint8_t v)
+{
+	int i;
+	int ret;
+
+	i = hcs12bdm_reg_shadow(addr);
+	if (i >= 0 && hcs12bdm_shadow_table[i].valid &&
+	    hcs12bdm_shadow_table[i].value == v)
+		return 0;
+
+	if (i >= 0 && hcs12bdm_shadow_table[i].bd)
+		ret = (*hcs12bdm_handler->write_bd_byte)(addr, v);
+	else
+		ret = (*hcs12bdm_handler->write_byte)(addr, v);
+	if (ret != 0)
+	{
+		if (i >= 0)
+			hcs12bdm_shadow_table[i].valid = FALSE;
+		return ret;
+	}
+
+	if (i >= 0)
+	{
+		hcs12bdm_shadow_table[i].value = v;
+		hcs12bdm_shadow_table[i].valid = TRUE;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  initialize FLASH/EEPROM clock, for current bus clock
  *
  *  in:
  *    void
@@ -127,7 +285,7 @@ static int hcs12bdm_clkdiv_init(void)
 		-- div;
 	clk /= (1 + div);
 	if (clk < HCS12_FCLK_MIN ||
-	    ((options.osc + 2 * clk) / clk < options.osc / HCS12_FCLK_MAX))
+	    (1.0 / clk + 1.0 / hcs12bdm_bus_clock < 1.0 / HCS12_FCLK_MAX))
 	{
 		error("unable to determine proper clock divider for FLASH/EEPROM programming\n");
 		return EINVAL;
@@ -138,10 +296,10 @@ static int hcs12bdm_clkdiv_init(void)
 	if (options.debug)
 		printf("FCLK = %lu\n", (unsigned long)clk);
 
-	ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_FCLKDIV, b);
+	ret = hcs12bdm_reg_write(HCS12_IO_FCLKDIV, b);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_ECLKDIV, b);
+	ret = hcs12bdm_reg_write(HCS12_IO_ECLKDIV, b);
 	if (ret != 0)
 		return ret;
 
@@ -149,6 +307,159 @@ static int hcs12bdm_clkdiv_init(void)
 }
 
 
+/*
+ *  run target from PLL and switch BDM to bus clock
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_pll_init(void)
+{
+	uint32_t bus;
+	unsigned long f;
+	unsigned long best;
+	unsigned long start;
+	int syn;
+	int ref;
+	int best_syn;
+	int best_ref;
+	uint8_t b;
+	int ret;
+
+	if (hcs12bdm_handler->set_clock == NULL)
+	{
+		error("PLL boost mode not supported by this interface\n");
+		return ENOTSUP;
+	}
+
+	if (hcs12mem_target_param("pll_bus", &bus, 0) != 0)
+		return EINVAL;
+	if (bus == 0)
+	{
+		error("target description does not specify pll_bus parameter\n");
+		return EINVAL;
+	}
+
+	/* highest bus clock not above the limit,
+	   bus = osc * (SYNR + 1) / (REFDV + 1) */
+
+	best = 0;
+	best_syn = 0;
+	best_ref = 0;
+	for (ref = 0; ref <= HCS12_IO_REFDV_REFDV; ++ ref)
+	{
+		if (options.osc / (ref + 1) < HCS12_PLL_REF_MIN)
+			break;
+		for (syn = 0; syn <= HCS12_IO_SYNR_SYN; ++ syn)
+		{
+			f = options.osc / (ref + 1) * (syn + 1);
+			if (f > bus)
+				break;
+			if (f > best)
+			{
+				best = f;
+				best_syn = syn;
+				best_ref = ref;
+			}
+		}
+	}
+
+	if (best <= hcs12bdm_bus_clock)
+	{
+		if (options.verbose)
+			printf("PLL boost: bus clock cannot be raised\n");
+		return 0;
+	}
+
+	/* start PLL, with bus still running from oscillator */
+
+	ret = hcs12bdm_reg_write(HCS12_IO_CLKSEL, 0);
+	if (ret != 0)
+		return ret;
+	ret = hcs12bdm_reg_read(HCS12_IO_PLLCTL, &b);
+	if (ret != 0)
+		return ret;
+	ret = hcs12bdm_reg_write(HCS12_IO_PLLCTL,
+		(uint8_t)(b | HCS12_IO_PLLCTL_PLLON));
+	if (ret != 0)
+		return ret;
+	ret = hcs12bdm_reg_write(HCS12_IO_SYNR, (uint8_t)best_syn);
+	if (ret != 0)
+		return ret;
+	ret = hcs12bdm_reg_write(HCS12_IO_REFDV, (uint8_t)best_ref);
+	if (ret != 0)
+		return ret;
+
+	start = sys_get_ms();
+	for (;;)
+	{
+		ret = hcs12bdm_reg_read(HCS12_IO_CRGFLG, &b);
+		if (ret != 0)
+			return ret;
+		if (b & HCS12_IO_CRGFLG_LOCK)
+			break;
+		if (sys_get_ms() - start >= HCS12BDM_PLL_LOCK_TIMEOUT)
+		{
+			error("PLL lock wait timed out\n");
+			return ETIMEDOUT;
+		}
+	}
+
+	ret = hcs12bdm_reg_write(HCS12_IO_CLKSEL,
+		HCS12_IO_CLKSEL_PLLSEL);
+	if (ret != 0)
+		return ret;
+
+	/* BDM to bus clock, interface must follow */
+
+	ret = (*hcs12bdm_handler->read_bd_byte)(HCS12BDM_REG_STATUS, &b);
+	if (ret != 0)
+		return ret;
+	ret = (*hcs12bdm_handler->write_bd_byte)(HCS12BDM_REG_STATUS,
+		(uint8_t)(b | HCS12BDM_REG_STATUS_CLKSW));
+	if (ret != 0)
+		return ret;
+
+	hcs12bdm_pll_active = TRUE;
+	ret = (*hcs12bdm_handler->set_clock)(best);
+	if (ret != 0)
+		return ret;
+
+	hcs12bdm_bus_clock = best;
+
+	if (options.verbose)
+	{
+		printf("PLL boost: bus clock <%lu.%06lu MHz>\n",
+		       (unsigned long)(best / 1000000UL),
+		       (unsigned long)(best % 1000000UL));
+	}
+
+	return hcs12bdm_clkdiv_init();
+}
+
+
+/*
+ *  return interface to oscillator clock, after target reset
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_pll_reset(void)
+{
+	hcs12bdm_bus_clock = options.osc / 2;
+	if (!hcs12bdm_pll_active)
+		return 0;
+	hcs12bdm_pll_active = FALSE;
+	return (*hcs12bdm_handler->set_clock)(options.osc);
+}
+
+
 /*
  *  initialize target connection
  *
@@ -171,7 +482,11 @@ static int hcs12bdm_init(int verbose)
 
 	/* reset target into single chip special mode */
 
+	hcs12bdm_reg_invalidate();
 	ret = (*hcs12bdm_handler->reset_special)();
+	if (ret != 0)
+		return ret;
+	ret = hcs12bdm_pll_reset();
 	if (ret != 0)
 		return ret;
 
@@ -249,6 +564,13 @@ static int hcs12bdm_init(int verbose)
 		ret = hcs12bdm_clkdiv_init();
 		if (ret != 0)
 			return ret;
+
+		if (options.pll_boost)
+		{
+			ret = hcs12bdm_pll_init();
+			if (ret != 0)
+				return ret;
+		}
 	}
 
 	hcs12mcu_identify(verbose);
@@ -258,7 +580,8 @@ static int hcs12bdm_init(int verbose)
 	if (verbose)
 		printf("\n");
 
-	hcs12bdm_agent_loaded = FALSE;
+	if (!options.keep_agent)
+		hcs12bdm_agent_loaded = FALSE;
 
 	return 0;
 }
@@ -275,10 +598,17 @@ static int hcs12bdm_init(int verbose)
 
 static int hcs12bdm_reset(void)
 {
+	int ret;
+
 	if (options.verbose)
 		printf("reset: normal mode\n");
 
-	return (*hcs12bdm_handler->reset_normal)();
+	hcs12bdm_reg_invalidate();
+	ret = (*hcs12bdm_handler->reset_normal)();
+	if (ret != 0)
+		return ret;
+
+	return hcs12bdm_pll_reset();
 }
 
 
@@ -301,63 +631,272 @@ static uint32_t hcs12bdm_ram_address(uint32_t addr)
 
 
 /*
- *  load data into RAM target
+ *  execute command, using target RAM agent
  *
  *  in:
- *    file - data file name to read
- *    agent - flag when loading target RAM agent
+ *    cmd - command to execute
+ *    status - on return, operation status
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12bdm_ram_load(const char *file, int agent)
+static int hcs12bdm_agent_cmd(int cmd, int *status)
 {
 	int ret;
-	uint8_t *buf;
-	char info[256];
-	uint32_t entry;
-	uint32_t addr_min;
-	uint32_t addr_max;
-	uint32_t len;
-	uint32_t i;
-	uint32_t chunk;
-	unsigned long t;
-
-	if (!agent)
-		hcs12bdm_agent_loaded = FALSE;
+	uint8_t b;
 
-	buf = malloc(hcs12mcu_target.ram_size);
-	if (buf == NULL)
-	{
-		error("not enough memory\n");
-		return ENOMEM;
-	}
+	ret = (*hcs12bdm_handler->write_byte)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_CMD),
+		(uint8_t)cmd);
+	if (ret != 0)
+		return ret;
 
-	entry = 0xffffffff;
+	ret = (*hcs12bdm_handler->write_byte)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_STATUS),
+		HCS12_AGENT_ERROR_CMD);
+	if (ret != 0)
+		return ret;
 
-	if (options.verbose)
-	{
-		printf("RAM load: %s file <%s>\n",
-		       (const char *)(agent ? "agent" : "image"),
-		       (const char *)file);
-	}
+	ret = (*hcs12bdm_handler->write_reg)(
+		HCS12BDM_REG_PC, (uint16_t)hcs12bdm_ram_entry);
+	if (ret != 0)
+		return ret;
 
-	ret = srec_read(
-		file,
-		info,
-		sizeof(info),
-		buf,
-		hcs12mcu_target.ram_size,
-		NULL,
-		&entry,
-		&addr_min,
-		&addr_max,
-		hcs12bdm_ram_address);
+	hcs12bdm_reg_invalidate();
+	ret = (*hcs12bdm_handler->go)();
 	if (ret != 0)
-	{
-		free(buf);
 		return ret;
-	}
+
+	ret = hcs12bdm_wait_active(HCS12BDM_RUN_TIMEOUT);
+	if (ret != 0)
+		return ret;
+
+	ret = (*hcs12bdm_handler->read_byte)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_STATUS), &b);
+	if (ret != 0)
+		return ret;
+
+	if (b == HCS12_AGENT_ERROR_XTAL)
+	{
+		error("unable to proceed - oscillator frequency invalid\n");
+		return EINVAL;
+	}
+	if (b == HCS12_AGENT_ERROR_CMD)
+	{
+		/* older agent versions, caller may fall back when asked
+		   for status */
+		if (status != NULL)
+		{
+			*status = (int)b;
+			return 0;
+		}
+		error("unable to proceed - command not supported\n");
+		return ENOTSUP;
+	}
+	if (b == HCS12_AGENT_ERROR_PGM)
+	{
+		error("unable to proceed - programming failed\n");
+		return EIO;
+	}
+
+	if (status != NULL)
+		*status = (int)b;
+	else if (b != HCS12_AGENT_ERROR_NONE)
+	{
+		error("unable to proceed - unknown response\n");
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  compute CRC-16/CCITT of agent image part
+ *
+ *  in:
+ *    buf - agent image, indexed by RAM offset
+ *    start - start offset
+ *    end - end offset (exclusive)
+ *    crc - initial CRC value
+ *  out:
+ *    CRC value
+ */
+
+static uint16_t hcs12bdm_agent_crc(const uint8_t *buf, uint32_t start, uint32_t end, uint16_t crc)
+{
+	uint32_t i;
+	int j;
+
+	for (i = start; i < end; ++ i)
+	{
+		crc ^= (uint16_t)(buf[i] << 8);
+		for (j = 0; j < 8; ++ j)
+			crc = (uint16_t)((crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1));
+	}
+	return crc;
+}
+
+
+/*
+ *  compute resident agent hash, over tag and agent code
+ *
+ *  in:
+ *    buf - agent image, indexed by RAM offset
+ *    tag - tag offset within image
+ *    end - image end offset (exclusive)
+ *    hash - on return, image hash
+ *  out:
+ *    TRUE when image carries agent tag, FALSE otherwise
+ */
+
+static int hcs12bdm_agent_hash(const uint8_t *buf, uint32_t tag, uint32_t end, uint16_t *hash)
+{
+	if (tag + HCS12_AGENT_TAG_SIZE > end ||
+	    uint16_be2host_from_buf(buf + tag) != HCS12_AGENT_TAG_VERSION)
+		return FALSE;
+
+	/* skipping hash word itself */
+
+	*hash = hcs12bdm_agent_crc(buf, tag + HCS12_AGENT_TAG_SIZE, end,
+		hcs12bdm_agent_crc(buf, tag, tag + 2, 0xffff));
+	return TRUE;
+}
+
+
+/*
+ *  check for valid agent already present in target RAM - agent
+ *  computes CRC of its code, which must match image
+ *
+ *  in:
+ *    buf - agent image, indexed by RAM offset
+ *    tag - tag offset within image
+ *    end - image end offset (exclusive)
+ *    hash - image hash
+ *    resident - on return, TRUE when agent image need not be loaded
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_agent_resident(const uint8_t *buf, uint32_t tag, uint32_t end, uint16_t hash, int *resident)
+{
+	uint8_t q[HCS12_AGENT_TAG_SIZE];
+	uint16_t crc;
+	int status;
+	int ret;
+
+	*resident = FALSE;
+
+	ret = (*hcs12bdm_handler->read_mem)(
+		(uint16_t)(hcs12mcu_target.ram_base + tag), q, sizeof(q));
+	if (ret != 0)
+		return ret;
+
+	if (uint16_be2host_from_buf(q) != HCS12_AGENT_TAG_VERSION ||
+	    uint16_be2host_from_buf(q + 2) != hash)
+		return 0;
+
+	/* tag could survive partially overwritten agent, so agent code
+	   is checked as a whole - by agent itself */
+
+	ret = (*hcs12bdm_handler->write_word)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 0),
+		(uint16_t)(hcs12mcu_target.ram_base + tag + HCS12_AGENT_TAG_SIZE));
+	if (ret != 0)
+		return ret;
+
+	ret = (*hcs12bdm_handler->write_word)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 2),
+		(uint16_t)(hcs12mcu_target.ram_base + end));
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12bdm_agent_cmd(HCS12_AGENT_CMD_IMAGE_CRC, &status);
+	if (ret != 0)
+	{
+		/* damaged agent may run away, target is stopped before
+		   agent is loaded again */
+
+		if (options.verbose)
+			printf("RAM load: resident agent not responding\n");
+		return (*hcs12bdm_handler->background)();
+	}
+	if (status != HCS12_AGENT_ERROR_NONE)
+		return 0;
+
+	ret = (*hcs12bdm_handler->read_word)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 4), &crc);
+	if (ret != 0)
+		return ret;
+
+	if (crc == hcs12bdm_agent_crc(buf, tag + HCS12_AGENT_TAG_SIZE, end, 0xffff))
+		*resident = TRUE;
+	return 0;
+}
+
+
+/*
+ *  load data into RAM target
+ *
+ *  in:
+ *    file - data file name to read
+ *    agent - flag when loading target RAM agent
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_ram_load(const char *file, int agent)
+{
+	int ret;
+	uint8_t *buf;
+	char info[256];
+	uint32_t entry;
+	uint32_t addr_min;
+	uint32_t addr_max;
+	uint32_t len;
+	uint32_t i;
+	uint32_t chunk;
+	unsigned long t;
+	uint32_t tag;
+	uint16_t hash;
+	int tagged;
+	int resident;
+
+	if (!agent)
+		hcs12bdm_agent_loaded = FALSE;
+
+	buf = malloc(hcs12mcu_target.ram_size);
+	if (buf == NULL)
+	{
+		error("not enough memory\n");
+		return ENOMEM;
+	}
+
+	entry = 0xffffffff;
+
+	if (options.verbose)
+	{
+		printf("RAM load: %s file <%s>\n",
+		       (const char *)(agent ? "agent" : "image"),
+		       (const char *)file);
+	}
+
+	ret = image_read(
+		file,
+		info,
+		sizeof(info),
+		buf,
+		hcs12mcu_target.ram_size,
+		NULL,
+		&entry,
+		&addr_min,
+		&addr_max,
+		hcs12bdm_ram_address);
+	if (ret != 0)
+	{
+		free(buf);
+		return ret;
+	}
 
 	if (entry == 0xffffffff && !options.start_valid)
 	{
@@ -393,6 +932,37 @@ static int hcs12bdm_ram_load(const char *file, int agent)
 		}
 	}
 
+	/* agent left in RAM by previous session need not be loaded again */
+
+	tagged = FALSE;
+	if (agent && hcs12bdm_ram_entry >= addr_min + HCS12_AGENT_TAG_SIZE)
+	{
+		tag = hcs12bdm_ram_entry - HCS12_AGENT_TAG_SIZE - hcs12mcu_target.ram_base;
+		tagged = hcs12bdm_agent_hash(buf, tag,
+			addr_max - hcs12mcu_target.ram_base + 1, &hash);
+		if (tagged)
+		{
+			hcs12bdm_agent_param = (uint16_t)addr_min;
+			ret = hcs12bdm_agent_resident(buf, tag,
+				addr_max - hcs12mcu_target.ram_base + 1, hash, &resident);
+			if (ret != 0)
+			{
+				free(buf);
+				return ret;
+			}
+			if (resident)
+			{
+				if (options.verbose)
+					printf("RAM load: agent already resident\n");
+				hcs12bdm_agent_current = TRUE;
+				free(buf);
+				return 0;
+			}
+		}
+	}
+	if (agent)
+		hcs12bdm_agent_current = tagged;
+
 	chunk = HCS12BDM_RAM_LOAD_CHUNK;
 	t = progress_start("RAM load: data");
 	for (i = 0; i < len; i += chunk)
@@ -414,6 +984,17 @@ static int hcs12bdm_ram_load(const char *file, int agent)
 	}
 	progress_stop(t, NULL, 0);
 
+	if (tagged)
+	{
+		ret = (*hcs12bdm_handler->write_word)(
+			(uint16_t)(hcs12mcu_target.ram_base + tag + 2), hash);
+		if (ret != 0)
+		{
+			free(buf);
+			return ret;
+		}
+	}
+
 	if (agent)
 		hcs12bdm_agent_param = (uint16_t)addr_min;
 
@@ -453,6 +1034,7 @@ static int hcs12bdm_ram_run(const char *file)
 	if (ret != 0)
 		return ret;
 
+	hcs12bdm_reg_invalidate();
 	ret = (*hcs12bdm_handler->go)();
 	if (ret != 0)
 		return ret;
@@ -482,10 +1064,10 @@ static int hcs12bdm_hcs12_eeprom_command(uint8_t command)
 	uint8_t b;
 	unsigned long ms;
 
-	ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_ECMD, command);
+	ret = hcs12bdm_reg_write(HCS12_IO_ECMD, command);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_ESTAT, HCS12_IO_ESTAT_CBEIF);
 	if (ret != 0)
 		return ret;
@@ -493,7 +1075,7 @@ static int hcs12bdm_hcs12_eeprom_command(uint8_t command)
 	ms = sys_get_ms();
 	do
 	{
-		ret = (*hcs12bdm_handler->read_byte)(HCS12_IO_ESTAT, &b);
+		ret = hcs12bdm_reg_read(HCS12_IO_ESTAT, &b);
 		if (ret != 0)
 			return ret;
 	}
@@ -533,10 +1115,10 @@ static int hcs12bdm_hcs12_eeprom_mass_erase(void)
 {
 	int ret;
 
-	ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_EPROT, 0xff);
+	ret = hcs12bdm_reg_write(HCS12_IO_EPROT, 0xff);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_ESTAT, HCS12_IO_ESTAT_PVIOL | HCS12_IO_ESTAT_ACCERR);
 	if (ret != 0)
 		return ret;
@@ -568,7 +1150,7 @@ static int hcs12bdm_hcs12_eeprom_erase_verify(int *state)
 	int ret;
 	uint8_t b;
 
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_ESTAT, HCS12_IO_ESTAT_PVIOL | HCS12_IO_ESTAT_ACCERR);
 	if (ret != 0)
 		return ret;
@@ -581,7 +1163,7 @@ static int hcs12bdm_hcs12_eeprom_erase_verify(int *state)
 	ret = hcs12bdm_hcs12_eeprom_command(HCS12_IO_ECMD_ERASE_VERIFY);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->read_byte)(HCS12_IO_ESTAT, &b);
+	ret = hcs12bdm_reg_read(HCS12_IO_ESTAT, &b);
 	if (ret != 0)
 		return ret;
 
@@ -617,15 +1199,75 @@ static int hcs12bdm_hcs12_eeprom_program(uint16_t addr, uint16_t value)
 
 
 /*
- *  wait for FLASH operation completion
+ *  update target EEPROM sector - only words that differ are programmed,
+ *  sector is erased (sector modify) only when a word cannot be
+ *  programmed over its current value
  *
  *  in:
- *    void
+ *    addr - sector address
+ *    data - new sector content
+ *    cur - current sector content
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12bdm_hcs12_flash_ccif_wait(void)
+static int hcs12bdm_hcs12_eeprom_sector(uint16_t addr, const uint8_t *data, const uint8_t *cur)
+{
+	uint16_t w;
+	uint16_t c;
+	int modify;
+	int ret;
+	int i;
+
+	modify = FALSE;
+	for (i = 0; i < HCS12_EEPROM_SECTOR_SIZE; i += 2)
+	{
+		w = uint16_be2host_from_buf(data + i);
+		c = uint16_be2host_from_buf(cur + i);
+		if (w != c && c != 0xffff)
+			modify = TRUE;
+	}
+
+	i = 0;
+	if (modify)
+	{
+		/* sector modify erases sector and programs first word */
+
+		ret = (*hcs12bdm_handler->write_word)(addr, uint16_be2host_from_buf(data));
+		if (ret != 0)
+			return ret;
+		ret = hcs12bdm_hcs12_eeprom_command(HCS12_IO_ECMD_SECTOR_MODIFY);
+		if (ret != 0)
+			return ret;
+		i = 2;
+	}
+
+	for (; i < HCS12_EEPROM_SECTOR_SIZE; i += 2)
+	{
+		w = uint16_be2host_from_buf(data + i);
+		c = (modify ? 0xffff : uint16_be2host_from_buf(cur + i));
+		if (w == c)
+			continue;
+		ret = hcs12bdm_hcs12_eeprom_program((uint16_t)(addr + i), w);
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  wait for FLASH status flag
+ *
+ *  in:
+ *    flag - FSTAT flag to wait for (CCIF - command completion,
+ *           CBEIF - command buffer empty, next command can be launched)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_hcs12_flash_wait(uint8_t flag)
 {
 	int ret;
 	uint8_t b;
@@ -634,11 +1276,11 @@ static int hcs12bdm_hcs12_flash_ccif_wait(void)
 	ms = sys_get_ms();
 	do
 	{
-		ret = (*hcs12bdm_handler->read_byte)(HCS12_IO_FSTAT, &b);
+		ret = hcs12bdm_reg_read(HCS12_IO_FSTAT, &b);
 		if (ret != 0)
 			return ret;
 	}
-	while (!(b & (HCS12_IO_FSTAT_CCIF | HCS12_IO_FSTAT_PVIOL | HCS12_IO_FSTAT_ACCERR)) &&
+	while (!(b & (flag | HCS12_IO_FSTAT_PVIOL | HCS12_IO_FSTAT_ACCERR)) &&
 	       (sys_get_ms() - ms < HCS12_FLASH_CMD_TIMEOUT));
 
 	if (b & HCS12_IO_FSTAT_PVIOL)
@@ -651,7 +1293,7 @@ static int hcs12bdm_hcs12_flash_ccif_wait(void)
 		error("FLASH access error (ACCERR bit set)\n");
 		return EIO;
 	}
-	if (!(b & HCS12_IO_FSTAT_CCIF))
+	if (!(b & flag))
 	{
 		error("FLASH operation timed out\n");
 		return ETIMEDOUT;
@@ -661,6 +1303,21 @@ static int hcs12bdm_hcs12_flash_ccif_wait(void)
 }
 
 
+/*
+ *  wait for FLASH operation completion
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_hcs12_flash_ccif_wait(void)
+{
+	return hcs12bdm_hcs12_flash_wait(HCS12_IO_FSTAT_CCIF);
+}
+
+
 /*
  *  mass erase target FLASH
  *
@@ -678,19 +1335,19 @@ static int hcs12bdm_hcs12_flash_mass_erase(unsigned int *t)
 
 	if (hcs12mcu_target.flash_blocks > 1)
 	{
-		ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_FCNFG, 0x00);
+		ret = hcs12bdm_reg_write(HCS12_IO_FCNFG, 0x00);
 		if (ret != 0)
 			return ret;
-		ret = (*hcs12bdm_handler->write_byte)(
+		ret = hcs12bdm_reg_write(
 			HCS12_IO_FTSTMOD, HCS12_IO_FTSTMOD_WRALL);
 		if (ret != 0)
 			return ret;
 	}
 
-	ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_FPROT, 0xff);
+	ret = hcs12bdm_reg_write(HCS12_IO_FPROT, 0xff);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_FSTAT, HCS12_IO_FSTAT_PVIOL | HCS12_IO_FSTAT_ACCERR);
 	if (ret != 0)
 		return ret;
@@ -700,18 +1357,18 @@ static int hcs12bdm_hcs12_flash_mass_erase(unsigned int *t)
 	ret = (*hcs12bdm_handler->write_word)(HCS12_IO_FADDR, 0);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_FCMD, HCS12_IO_FCMD_MASS_ERASE);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_FSTAT, HCS12_IO_FSTAT_CBEIF);
 	if (ret != 0)
 		return ret;
 
 	if (hcs12mcu_target.flash_blocks > 1)
 	{
-		ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_FTSTMOD, 0);
+		ret = hcs12bdm_reg_write(HCS12_IO_FTSTMOD, 0);
 		if (ret != 0)
 			return ret;
 	}
@@ -722,7 +1379,7 @@ static int hcs12bdm_hcs12_flash_mass_erase(unsigned int *t)
 	{
 		if (hcs12mcu_target.flash_blocks > 1)
 		{
-			ret = (*hcs12bdm_handler->write_byte)(
+			ret = hcs12bdm_reg_write(
 				HCS12_IO_FCNFG, (uint8_t)i);
 			if (ret != 0)
 				return ret;
@@ -757,16 +1414,16 @@ static int hcs12bdm_hcs12_flash_erase_verify(int *state)
 
 	if (hcs12mcu_target.flash_blocks > 1)
 	{
-		ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_FCNFG, 0x00);
+		ret = hcs12bdm_reg_write(HCS12_IO_FCNFG, 0x00);
 		if (ret != 0)
 			return ret;
-		ret = (*hcs12bdm_handler->write_byte)(
+		ret = hcs12bdm_reg_write(
 			HCS12_IO_FTSTMOD, HCS12_IO_FTSTMOD_WRALL);
 		if (ret != 0)
 			return ret;
 	}
 
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_FSTAT, HCS12_IO_FSTAT_PVIOL | HCS12_IO_FSTAT_ACCERR);
 	if (ret != 0)
 		return ret;
@@ -776,18 +1433,18 @@ static int hcs12bdm_hcs12_flash_erase_verify(int *state)
 	ret = (*hcs12bdm_handler->write_word)(HCS12_IO_FADDR, 0);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_FCMD, HCS12_IO_FCMD_ERASE_VERIFY);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_FSTAT, HCS12_IO_FSTAT_CBEIF);
 	if (ret != 0)
 		return ret;
 
 	if (hcs12mcu_target.flash_blocks > 1)
 	{
-		ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_FTSTMOD, 0);
+		ret = hcs12bdm_reg_write(HCS12_IO_FTSTMOD, 0);
 		if (ret != 0)
 			return ret;
 	}
@@ -798,7 +1455,7 @@ static int hcs12bdm_hcs12_flash_erase_verify(int *state)
 	{
 		if (hcs12mcu_target.flash_blocks > 1)
 		{
-			ret = (*hcs12bdm_handler->write_byte)(
+			ret = hcs12bdm_reg_write(
 				HCS12_IO_FCNFG, (uint8_t)i);
 			if (ret != 0)
 				return ret;
@@ -808,7 +1465,7 @@ static int hcs12bdm_hcs12_flash_erase_verify(int *state)
 		if (ret != 0)
 			return ret;
 
-		ret = (*hcs12bdm_handler->read_byte)(HCS12_IO_FSTAT, &b);
+		ret = hcs12bdm_reg_read(HCS12_IO_FSTAT, &b);
 		if (ret != 0)
 			return ret;
 
@@ -840,11 +1497,11 @@ static int hcs12bdm_hcs12_flash_program(uint16_t addr, uint16_t value)
 	ret = (*hcs12bdm_handler->write_word)(addr, value);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_FCMD, HCS12_IO_FCMD_PROGRAM);
 	if (ret != 0)
 		return ret;
-	ret = (*hcs12bdm_handler->write_byte)(
+	ret = hcs12bdm_reg_write(
 		HCS12_IO_FSTAT, HCS12_IO_FSTAT_CBEIF);
 	if (ret != 0)
 		return ret;
@@ -857,18 +1514,62 @@ static int hcs12bdm_hcs12_flash_program(uint16_t addr, uint16_t value)
 
 
 /*
- *  unsecure target
+ *  program phrase into target FLASH - words of a phrase are launched
+ *  as soon as command buffer is empty (burst), completion is awaited
+ *  once per phrase
  *
  *  in:
- *    void
+ *    addr - phrase address
+ *    buf - phrase data (big endian words)
+ *    size - phrase size, in bytes
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12bdm_unsecure(void)
+static int hcs12bdm_hcs12_flash_program_phrase(uint16_t addr, const uint8_t *buf, size_t size)
 {
 	int ret;
-	unsigned int t;
+	size_t i;
+
+	for (i = 0; i < size; i += 2)
+	{
+		if (i != 0)
+		{
+			ret = hcs12bdm_hcs12_flash_wait(HCS12_IO_FSTAT_CBEIF);
+			if (ret != 0)
+				return ret;
+		}
+		ret = (*hcs12bdm_handler->write_word)((uint16_t)(addr + i),
+			uint16_be2host_from_buf(buf + i));
+		if (ret != 0)
+			return ret;
+		ret = hcs12bdm_reg_write(
+			HCS12_IO_FCMD, HCS12_IO_FCMD_PROGRAM);
+		if (ret != 0)
+			return ret;
+		ret = hcs12bdm_reg_write(
+			HCS12_IO_FSTAT, HCS12_IO_FSTAT_CBEIF);
+		if (ret != 0)
+			return ret;
+	}
+
+	return hcs12bdm_hcs12_flash_ccif_wait();
+}
+
+
+/*
+ *  unsecure target
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_unsecure(void)
+{
+	int ret;
+	unsigned int t;
 
 	if (hcs12mcu_target.family < HCS12_FAMILY_S12)
 	{
@@ -958,74 +1659,6 @@ static int hcs12bdm_secure(void)
 }
 
 
-/*
- *  execute command, using target RAM agent
- *
- *  in:
- *    cmd - command to execute
- *    status - on return, operation status
- *  out:
- *    status code (errno-like)
- */
-
-static int hcs12bdm_agent_cmd(int cmd, int *status)
-{
-	int ret;
-	uint8_t b;
-
-	ret = (*hcs12bdm_handler->write_byte)(
-		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_CMD),
-		(uint8_t)cmd);
-	if (ret != 0)
-		return ret;
-
-	ret = (*hcs12bdm_handler->write_byte)(
-		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_STATUS),
-		HCS12_AGENT_ERROR_CMD);
-	if (ret != 0)
-		return ret;
-
-	ret = (*hcs12bdm_handler->write_reg)(
-		HCS12BDM_REG_PC, (uint16_t)hcs12bdm_ram_entry);
-	if (ret != 0)
-		return ret;
-
-	ret = (*hcs12bdm_handler->go)();
-	if (ret != 0)
-		return ret;
-
-	ret = hcs12bdm_wait_active(HCS12BDM_RUN_TIMEOUT);
-	if (ret != 0)
-		return ret;
-
-	ret = (*hcs12bdm_handler->read_byte)(
-		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_STATUS), &b);
-	if (ret != 0)
-		return ret;
-
-	if (b == HCS12_AGENT_ERROR_XTAL)
-	{
-		error("unable to proceed - oscillator frequency invalid\n");
-		return EINVAL;
-	}
-	if (b == HCS12_AGENT_ERROR_CMD)
-	{
-		error("unable to proceed - command not supported\n");
-		return ENOTSUP;
-	}
-
-	if (status != NULL)
-		*status = (int)b;
-	else if (b != HCS12_AGENT_ERROR_NONE)
-	{
-		error("unable to proceed - unknown response\n");
-		return EINVAL;
-	}
-
-	return 0;
-}
-
-
 /*
  *  load agent into target RAM
  *
@@ -1039,6 +1672,8 @@ static int hcs12bdm_agent_load(void)
 {
 	const char *ptr;
 	char file[SYS_MAX_PATH + 1];
+	uint32_t size;
+	uint32_t len;
 	int ret;
 
 	if (hcs12bdm_agent_loaded)
@@ -1066,9 +1701,30 @@ static int hcs12bdm_agent_load(void)
 	if (ret != 0)
 		return ret;
 
+	/* data buffer is offered in RAM below agent, quarter of RAM
+	   there (rest is left for command ring); agent reports buffer
+	   it uses, its own one when RAM is too small or it does not
+	   take buffer given */
+
+	len = 0;
+	if ((uint32_t)hcs12bdm_agent_param > hcs12mcu_target.ram_base)
+	{
+		size = ((uint32_t)hcs12bdm_agent_param - hcs12mcu_target.ram_base) / 4;
+		for (len = HCS12BDM_AGENT_BUF_SIZE_MAX; len > size; len /= 2)
+			;
+		if (len < HCS12BDM_AGENT_BUF_SIZE_MIN)
+			len = 0;
+	}
+
+	ret = (*hcs12bdm_handler->write_word)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 0),
+		(uint16_t)(hcs12bdm_agent_param - len));
+	if (ret != 0)
+		return ret;
+
 	ret = (*hcs12bdm_handler->write_word)(
-		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM),
-		(uint16_t)(options.osc / 1000));
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 2),
+		(uint16_t)len);
 	if (ret != 0)
 		return ret;
 
@@ -1286,6 +1942,37 @@ static uint32_t hcs12bdm_eeprom_address(uint32_t addr)
 }
 
 
+/*
+ *  read target EEPROM area in chunks
+ *
+ *  in:
+ *    addr - start address
+ *    buf - buffer for data
+ *    len - data length
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_eeprom_read_mem(uint32_t addr, uint8_t *buf, uint32_t len)
+{
+	uint32_t i;
+	uint32_t chunk;
+	int ret;
+
+	chunk = HCS12BDM_EEPROM_READ_CHUNK;
+	for (i = 0; i < len; i += chunk)
+	{
+		if (i + chunk > len)
+			chunk = len - i;
+		ret = (*hcs12bdm_handler->read_mem)(
+			(uint16_t)(addr + i), buf + i, chunk);
+		if (ret != 0)
+			return ret;
+	}
+	return 0;
+}
+
+
 /*
  *  write target EEPROM
  *
@@ -1299,15 +1986,18 @@ static int hcs12bdm_eeprom_write(const char *file)
 {
 	int ret;
 	uint8_t *buf;
+	uint8_t *cur;
 	char info[256];
 	uint32_t addr_min;
 	uint32_t addr_max;
 	uint32_t len;
 	uint32_t i;
-	int cnt;
+	uint32_t j;
+	uint32_t k;
+	uint32_t off;
+	uint32_t changed;
 	unsigned long t;
 	int agent;
-	uint16_t w;
 
 	ret = hcs12bdm_get_mode("bdm_eeprom_write", &agent);
 	if (ret != 0)
@@ -1330,15 +2020,36 @@ static int hcs12bdm_eeprom_write(const char *file)
 		ret = hcs12bdm_agent_load();
 		if (ret != 0)
 			return ret;
+
+		/* agents older than current tag version program whole sectors
+		   without comparing words, so they are not used - direct
+		   writing does the compare and sector modify itself */
+
+		if (!hcs12bdm_agent_current)
+		{
+			if (options.verbose)
+				printf("EEPROM write: agent too old, writing directly\n");
+			agent = FALSE;
+		}
 	}
 
-	buf = malloc(hcs12mcu_target.eeprom_size);
+	buf = malloc(2 * hcs12mcu_target.eeprom_size);
 	if (buf == NULL)
 	{
 		error("not enough memory\n");
 		return ENOMEM;
 	}
-	memset(buf, 0xff, (size_t)hcs12mcu_target.eeprom_size);
+	cur = buf + hcs12mcu_target.eeprom_size;
+
+	/* current EEPROM content - data file is laid over it, so areas
+	   not covered by file keep their content and only differing
+	   sectors are written */
+
+	ret = hcs12bdm_eeprom_read_mem(hcs12mcu_target.eeprom_base,
+		cur, hcs12mcu_target.eeprom_size);
+	if (ret != 0)
+		goto error;
+	memcpy(buf, cur, (size_t)hcs12mcu_target.eeprom_size);
 
 	if (options.verbose)
 	{
@@ -1348,7 +2059,7 @@ static int hcs12bdm_eeprom_write(const char *file)
 
 	/* read EEPROM data from S-record file */
 
-	ret = srec_read(
+	ret = image_read(
 		file,
 		info,
 		sizeof(info),
@@ -1381,104 +2092,123 @@ static int hcs12bdm_eeprom_write(const char *file)
 		if (!options.force)
 		{
 			error("EEPROM data covers protected area. If this is intended, consider -f option.\n");
-			return EINVAL;
+			ret = EINVAL;
+			goto error;
 		}
 	}
 
-	/* align to word boundaries */
+	/* align to sector boundaries */
 
-	if ((addr_min & 1) != 0)
-	{
-		-- addr_min;
-		++ len;
-	}
-	if ((addr_max & 1) == 0)
-	{
-		++ addr_max;
-		++ len;
-	}
+	addr_min &= ~(uint32_t)(HCS12_EEPROM_SECTOR_SIZE - 1);
+	addr_max |= HCS12_EEPROM_SECTOR_SIZE - 1;
+	len = addr_max - addr_min + 1;
+	off = addr_min - hcs12mcu_target.eeprom_base;
 
-	/* write loop */
+	/* write loop, agent gets agent buffer sized chunks trimmed to
+	   differing sectors, and compares words on its own */
 
-	cnt = 0;
+	changed = 0;
 	t = progress_start("EEPROM write: data");
-	for (i = 0; i < len; i += 2)
+	for (i = 0; i < len; i = j)
 	{
-		w = uint16_be2host_from_buf(&buf[addr_min - hcs12mcu_target.eeprom_base + i]);
-
 		if (agent)
 		{
-			/* write word for programming */
+			j = i + hcs12bdm_agent_buf_len;
+			if (j > len)
+				j = len;
 
-			ret = (*hcs12bdm_handler->write_word)(
-				(uint16_t)(hcs12bdm_agent_buf_addr + cnt), w);
-			if (ret != 0)
-				goto error_nl;
+			for (; i < j; i += HCS12_EEPROM_SECTOR_SIZE)
+			{
+				if (memcmp(buf + off + i, cur + off + i, HCS12_EEPROM_SECTOR_SIZE) != 0)
+					break;
+			}
+			for (k = j; k > i; k -= HCS12_EEPROM_SECTOR_SIZE)
+			{
+				if (memcmp(buf + off + k - HCS12_EEPROM_SECTOR_SIZE,
+					cur + off + k - HCS12_EEPROM_SECTOR_SIZE, HCS12_EEPROM_SECTOR_SIZE) != 0)
+					break;
+			}
 
-			cnt += 2;
-			if (cnt == hcs12bdm_agent_buf_len || i + 2 == len)
+			if (k > i)
 			{
+				ret = (*hcs12bdm_handler->write_mem)(
+					hcs12bdm_agent_buf_addr, buf + off + i, (uint16_t)(k - i));
+				if (ret != 0)
+					goto error;
+
 				/* param + 0: EEPROM address (word) */
 
 				ret = (*hcs12bdm_handler->write_word)(
 					(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 0),
-					(uint16_t)(addr_min + i + 2 - cnt));
+					(uint16_t)(addr_min + i));
 				if (ret != 0)
-					goto error_nl;
+					goto error;
 
 				/* param + 2: data length (word) */
 
 				ret = (*hcs12bdm_handler->write_word)(
 					(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 2),
-					(uint16_t)cnt);
+					(uint16_t)(k - i));
 				if (ret != 0)
-					goto error_nl;
+					goto error;
 
 				/* execute command via agent */
 
 				ret = hcs12bdm_agent_cmd(HCS12_AGENT_CMD_EEPROM_WRITE, NULL);
 				if (ret != 0)
-					goto error_nl;
+					goto error;
 
-				cnt = 0;
+				for (; i < k; i += HCS12_EEPROM_SECTOR_SIZE)
+				{
+					if (memcmp(buf + off + i, cur + off + i, HCS12_EEPROM_SECTOR_SIZE) != 0)
+						++ changed;
+				}
 			}
 		}
 		else
 		{
-			ret = hcs12bdm_hcs12_eeprom_program((uint16_t)(addr_min + i), w);
-			if (ret != 0)
+			j = i + HCS12_EEPROM_SECTOR_SIZE;
+
+			if (memcmp(buf + off + i, cur + off + i, HCS12_EEPROM_SECTOR_SIZE) != 0)
 			{
-			  error_nl:
-				/*progress_stop(t, NULL, 0);*/
-				goto error;
+				ret = hcs12bdm_hcs12_eeprom_sector(
+					(uint16_t)(addr_min + i), buf + off + i, cur + off + i);
+				if (ret != 0)
+					goto error;
+				++ changed;
 			}
 		}
 
-		progress_report(i + 2, len);
+		progress_report(j, len);
 	}
 	progress_stop(t, "EEPROM write: data", hcs12mcu_target.eeprom_size);
 
+	if (options.verbose)
+	{
+		printf("EEPROM write: sectors written <%u> of <%u>\n",
+		       (unsigned int)changed,
+		       (unsigned int)(len / HCS12_EEPROM_SECTOR_SIZE));
+	}
+
 	if (options.verify)
 	{
 		t = progress_start("EEPROM write: verify");
+		ret = hcs12bdm_eeprom_read_mem(addr_min, cur + off, len);
+		if (ret != 0)
+			goto error;
 		for (i = 0; i < len; i += 2)
 		{
-			ret = (*hcs12bdm_handler->read_word)(
-				(uint16_t)(addr_min + i), &w);
-			if (ret != 0)
-				goto error;
-
-			if (w != uint16_be2host_from_buf(&buf[addr_min - hcs12mcu_target.eeprom_base + i]))
+			if (memcmp(buf + off + i, cur + off + i, 2) != 0)
 			{
 				error("EEPROM data verify error at address <0x%04X> value <0x%04X> expected <0x%04X>\n",
 				      (unsigned int)(addr_min + i),
-				      (unsigned int)w,
-				      (unsigned int)uint16_be2host_from_buf(&buf[addr_min - hcs12mcu_target.eeprom_base + i]));
+				      (unsigned int)uint16_be2host_from_buf(cur + off + i),
+				      (unsigned int)uint16_be2host_from_buf(buf + off + i));
+				ret = EIO;
 				goto error;
 			}
-
-			progress_report(i + 2, len);
 		}
+		progress_report(len, len);
 		progress_stop(t, "EEPROM write: verify", hcs12mcu_target.eeprom_size);
 		if (options.verbose)
 			printf("EEPROM write: verify ok\n");
@@ -1556,7 +2286,7 @@ static int hcs12bdm_eeprom_protect(const char *opt)
 		prot = hcs12_eeprom_prot_area_table[i].size;
 	}
 
-	ret = (*hcs12bdm_handler->read_byte)(HCS12_IO_EPROT, &eprot);
+	ret = hcs12bdm_reg_read(HCS12_IO_EPROT, &eprot);
 	if (ret != 0)
 		return ret;
 
@@ -1648,6 +2378,54 @@ static int hcs12bdm_eeprom_protect(const char *opt)
 }
 
 
+/*
+ *  mass erase all FLASH blocks concurrently, using target RAM agent
+ *
+ *  in:
+ *    t - erase time (on return)
+ *  out:
+ *    status code (errno-like), ENOTSUP when agent lacks the command
+ */
+
+static int hcs12bdm_agent_flash_mass_erase_all(unsigned int *t)
+{
+	unsigned long start;
+	int status;
+	int ret;
+
+	/* param + 0: number of FLASH blocks (byte)
+	   param + 1: PPAGE (byte) */
+
+	ret = (*hcs12bdm_handler->write_byte)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 0),
+		(uint8_t)hcs12mcu_target.flash_blocks);
+	if (ret != 0)
+		return ret;
+
+	ret = (*hcs12bdm_handler->write_byte)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 1),
+		hcs12mcu_block_to_ppage_base(0));
+	if (ret != 0)
+		return ret;
+
+	start = sys_get_ms();
+	ret = hcs12bdm_agent_cmd(HCS12_AGENT_CMD_FLASH_MASS_ERASE_ALL, &status);
+	if (ret != 0)
+		return ret;
+	*t = (unsigned int)(sys_get_ms() - start);
+
+	if (status == HCS12_AGENT_ERROR_CMD)
+		return ENOTSUP;
+	if (status != HCS12_AGENT_ERROR_NONE)
+	{
+		error("FLASH erase failed - unknown response\n");
+		return EIO;
+	}
+
+	return 0;
+}
+
+
 /*
  *  erase target FLASH
  *
@@ -1689,7 +2467,27 @@ static int hcs12bdm_flash_erase(int unsecure)
 		if (ret != 0)
 			return ret;
 
-		for (i = 0; i < hcs12mcu_target.flash_blocks; ++ i)
+		/* multiple blocks are erased concurrently, when agent
+		   supports it */
+
+		i = 0;
+		if (hcs12mcu_target.flash_blocks > 1)
+		{
+			ret = hcs12bdm_agent_flash_mass_erase_all(&t);
+			if (ret == 0)
+			{
+				i = hcs12mcu_target.flash_blocks;
+				if (options.verbose)
+				{
+					printf("FLASH erase: blocks #0-#%u bulk erased concurrently, time <%u ms>\n",
+					       (unsigned int)(i - 1), t);
+				}
+			}
+			else if (ret != ENOTSUP)
+				return ret;
+		}
+
+		for (; i < hcs12mcu_target.flash_blocks; ++ i)
 		{
 			/* param + 0: FLASH block number (byte)
 			   param + 1: PPAGE (byte) */
@@ -1832,11 +2630,11 @@ static int hcs12bdm_flash_erase(int unsecure)
 		}
 		else
 		{
-			ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_FCNFG, 0);
+			ret = hcs12bdm_reg_write(HCS12_IO_FCNFG, 0);
 			if (ret != 0)
 				return ret;
 
-			ret = (*hcs12bdm_handler->write_byte)(HCS12_IO_PPAGE,
+			ret = hcs12bdm_reg_write(HCS12_IO_PPAGE,
 				(uint8_t)(hcs12mcu_target.ppage_base + hcs12mcu_target.ppage_count - 1));
 			if (ret != 0)
 				return ret;
@@ -1872,7 +2670,8 @@ static int hcs12bdm_agent_cmd_flash(uint8_t cmd, uint32_t addr, uint16_t size)
 	/* param + 0: FLASH block number (byte)
 	   param + 1: PPAGE (byte)
 	   param + 2: address (word)
-	   param + 4: data length (word) */
+	   param + 4: data length (word)
+	   param + 6: phrase length, in words (word) */
 
 	ret = (*hcs12bdm_handler->write_byte)(
 		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 0),
@@ -1899,6 +2698,12 @@ static int hcs12bdm_agent_cmd_flash(uint8_t cmd, uint32_t addr, uint16_t size)
 	if (ret != 0)
 		return ret;
 
+	ret = (*hcs12bdm_handler->write_word)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 6),
+		(uint16_t)(hcs12mcu_target.flash_phrase / 2));
+	if (ret != 0)
+		return ret;
+
 	ret = hcs12bdm_agent_cmd(cmd, NULL);
 	if (ret != 0)
 		return ret;
@@ -1918,35 +2723,17 @@ static int hcs12bdm_agent_cmd_flash(uint8_t cmd, uint32_t addr, uint16_t size)
 
 static int hcs12bdm_flash_set_bank_ppage(uint32_t addr)
 {
-	uint8_t p;
 	int ret;
 
-	if (hcs12bdm_ppage == 0xff)
-	{
-		ret = (*hcs12bdm_handler->read_byte)(
-			HCS12_IO_PPAGE, &hcs12bdm_ppage);
-		if (ret != 0)
-			return ret;
-	}
-
-	p = hcs12mcu_linear_to_ppage(addr);
-	if (p != hcs12bdm_ppage)
-	{
-		ret = (*hcs12bdm_handler->write_byte)(
-			HCS12_IO_FCNFG,
-			hcs12mcu_linear_to_block(addr));
-		if (ret != 0)
-			return ret;
-
-		ret = (*hcs12bdm_handler->write_byte)(
-			HCS12_IO_PPAGE, p);
-		if (ret != 0)
-			return ret;
-
-		hcs12bdm_ppage = p;
-	}
+	ret = hcs12bdm_reg_write(
+		HCS12_IO_FCNFG,
+		hcs12mcu_linear_to_block(addr));
+	if (ret != 0)
+		return ret;
 
-	return 0;
+	return hcs12bdm_reg_write(
+		HCS12_IO_PPAGE,
+		hcs12mcu_linear_to_ppage(addr));
 }
 
 
@@ -1999,26 +2786,98 @@ static int hcs12bdm_flash_read_cb_agent(uint32_t addr, void *buf, size_t size)
 
 
 /*
- *  read target FLASH
+ *  FLASH read callback for S12X, using BDM global addressing - whole
+ *  global memory map is accessible via BDMGPR page, so no FCNFG/PPAGE
+ *  switching is needed
  *
  *  in:
- *    file - file name to write
+ *    addr - FLASH linear address
+ *    size - block size
+ *    buf - data buffer
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12bdm_flash_read(const char *file)
+static int hcs12bdm_flash_read_cb_global(uint32_t addr, void *buf, size_t size)
 {
+	uint32_t global;
+	uint8_t gpage;
 	int ret;
-	int agent;
 
-	ret = hcs12bdm_get_mode("bdm_flash_read", &agent);
+	global = HCS12X_FLASH_GLOBAL_BASE +
+		(uint32_t)hcs12mcu_linear_to_ppage(addr) * HCS12_FLASH_PAGE_SIZE +
+		addr % HCS12_FLASH_PAGE_SIZE;
+
+	gpage = (uint8_t)(global >> 16);
+	ret = hcs12bdm_reg_write(HCS12BDM_REG_BDMGPR,
+		(uint8_t)(HCS12BDM_REG_BDMGPR_BGAE |
+		(gpage & HCS12BDM_REG_BDMGPR_BGP)));
 	if (ret != 0)
 		return ret;
 
-	if (hcs12mcu_target.flash_size == 0)
-	{
-		error("FLASH read not possible - no FLASH memory\n");
+	ret = (*hcs12bdm_handler->read_mem)((uint16_t)global, buf, size);
+	if (ret != 0)
+		return ret;
+
+	return 0;
+}
+
+
+/*
+ *  get chunk size for reading FLASH directly via BDM
+ *
+ *  in:
+ *    chunk - chunk size (on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_flash_read_chunk(uint32_t *chunk)
+{
+	int ret;
+
+	ret = hcs12mem_target_param("bdm_flash_read_chunk",
+		chunk, HCS12BDM_FLASH_READ_CHUNK);
+	if (ret != 0)
+		return ret;
+
+	/* chunks must not cross FLASH page boundary */
+
+	if (*chunk < 2 || *chunk > HCS12_FLASH_PAGE_SIZE ||
+	    (*chunk & (*chunk - 1)) != 0)
+	{
+		error("invalid FLASH read chunk size: %lu\n",
+		      (unsigned long)*chunk);
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  read target FLASH
+ *
+ *  in:
+ *    file - file name to write
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_flash_read(const char *file)
+{
+	int ret;
+	int ret2;
+	int agent;
+	uint32_t chunk;
+
+	ret = hcs12bdm_get_mode("bdm_flash_read", &agent);
+	if (ret != 0)
+		return ret;
+
+	if (hcs12mcu_target.flash_size == 0)
+	{
+		error("FLASH read not possible - no FLASH memory\n");
 		return EINVAL;
 	}
 
@@ -2037,8 +2896,22 @@ static int hcs12bdm_flash_read(const char *file)
 		return hcs12mcu_flash_read(file, hcs12bdm_agent_buf_len, hcs12bdm_flash_read_cb_agent);
 	}
 
-	hcs12bdm_ppage = 0xff; /* invalid ppage to start with, and force proper init */
-	return hcs12mcu_flash_read(file, HCS12BDM_FLASH_READ_CHUNK, hcs12bdm_flash_read_cb_direct);
+	if (hcs12mcu_target.family == HCS12_FAMILY_S12X)
+	{
+		/* global addressing is switched off afterwards, so that
+		   other operations use local memory map again */
+
+		ret = hcs12mcu_flash_read(file, HCS12BDM_FLASH_READ_GLOBAL_CHUNK,
+			hcs12bdm_flash_read_cb_global);
+		ret2 = hcs12bdm_reg_write(HCS12BDM_REG_BDMGPR, 0);
+		return (ret != 0 ? ret : ret2);
+	}
+
+	ret = hcs12bdm_flash_read_chunk(&chunk);
+	if (ret != 0)
+		return ret;
+
+	return hcs12mcu_flash_read(file, (size_t)chunk, hcs12bdm_flash_read_cb_direct);
 }
 
 
@@ -2062,12 +2935,15 @@ static int hcs12bdm_flash_write_cb_direct(uint32_t addr, const void *buf, size_t
 	if (ret != 0)
 		return ret;
 
-	for (i = 0; i < size; i += 2)
+	/* chunks are aligned to phrases by hcs12mcu_flash_write() */
+
+	for (i = 0; i < size; i += hcs12mcu_target.flash_phrase)
 	{
-		ret = hcs12bdm_hcs12_flash_program(
+		ret = hcs12bdm_hcs12_flash_program_phrase(
 			(uint16_t)(HCS12_FLASH_PAGE_BANKED_ADDR +
 			((addr + i) % HCS12_FLASH_PAGE_SIZE)),
-			uint16_be2host_from_buf((const uint8_t *)buf + i));
+			(const uint8_t *)buf + i,
+			(size_t)hcs12mcu_target.flash_phrase);
 		if (ret != 0)
 			return ret;
 	}
@@ -2094,6 +2970,285 @@ static int hcs12bdm_flash_write_cb_agent(uint32_t addr, const void *buf, size_t
 }
 
 
+/*
+ *  set up command ring in target RAM below agent and its data buffer,
+ *  when agent supports it and there is enough RAM
+ *
+ *  in:
+ *    void
+ *  out:
+ *    TRUE when ring is set up
+ */
+
+static int hcs12bdm_ring_open(void)
+{
+	uint32_t base;
+	uint32_t top;
+	uint32_t size;
+	int status;
+
+	base = hcs12mcu_target.ram_base;
+	top = (uint32_t)hcs12bdm_agent_param;
+	if ((uint32_t)hcs12bdm_agent_buf_addr < top)
+		top = (uint32_t)hcs12bdm_agent_buf_addr;
+	if (top <= base)
+		return FALSE;
+	size = top - base;
+	if (size > HCS12BDM_RING_SIZE_MAX)
+	{
+		base = top - HCS12BDM_RING_SIZE_MAX;
+		size = HCS12BDM_RING_SIZE_MAX;
+	}
+	if (size < 2 * (HCS12_AGENT_RING_DESC + (uint32_t)hcs12bdm_agent_buf_len))
+		return FALSE;
+
+	/* empty ring tells whether agent knows the command */
+
+	if ((*hcs12bdm_handler->write_word)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 0), 0) != 0)
+		return FALSE;
+	if (hcs12bdm_agent_cmd(HCS12_AGENT_CMD_RING, &status) != 0 ||
+	    status != HCS12_AGENT_ERROR_NONE)
+		return FALSE;
+
+	hcs12bdm_ring_buf = malloc(size);
+	if (hcs12bdm_ring_buf == NULL)
+		return FALSE;
+
+	hcs12bdm_ring_addr = (uint16_t)base;
+	hcs12bdm_ring_size = (uint16_t)size;
+	hcs12bdm_ring_n = 0;
+	hcs12bdm_ring_used = 0;
+
+	if (options.verbose)
+	{
+		printf("FLASH write: command ring <0x%04X-0x%04X>\n",
+		       (unsigned int)base,
+		       (unsigned int)(base + size - 1));
+	}
+	return TRUE;
+}
+
+
+/*
+ *  execute commands collected in ring, with single agent run
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_ring_flush(void)
+{
+	const uint8_t *d;
+	int status;
+	int ret;
+	int i;
+
+	if (hcs12bdm_ring_n == 0)
+		return 0;
+
+	ret = (*hcs12bdm_handler->write_mem)(hcs12bdm_ring_addr,
+		hcs12bdm_ring_buf, (size_t)hcs12bdm_ring_n * HCS12_AGENT_RING_DESC);
+	if (ret != 0)
+		return ret;
+
+	ret = (*hcs12bdm_handler->write_mem)(
+		(uint16_t)(hcs12bdm_ring_addr + hcs12bdm_ring_size - hcs12bdm_ring_used),
+		hcs12bdm_ring_buf + hcs12bdm_ring_size - hcs12bdm_ring_used,
+		(size_t)hcs12bdm_ring_used);
+	if (ret != 0)
+		return ret;
+
+	ret = (*hcs12bdm_handler->write_word)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 0),
+		(uint16_t)hcs12bdm_ring_n);
+	if (ret != 0)
+		return ret;
+
+	ret = (*hcs12bdm_handler->write_word)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 2),
+		hcs12bdm_ring_addr);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12bdm_agent_cmd(HCS12_AGENT_CMD_RING, &status);
+	if (ret == 0 && status != HCS12_AGENT_ERROR_NONE)
+	{
+		error("FLASH write failed - unknown response\n");
+		ret = EIO;
+	}
+	if (ret == 0)
+	{
+		/* queued chunks are programmed only now, so they count as
+		   written (journal, progress) from here */
+
+		hcs12bdm_ring_n = 0;
+		hcs12bdm_ring_used = 0;
+		hcs12mcu_flash_confirm();
+		return 0;
+	}
+
+	/* per descriptor status tells which write failed */
+
+	if ((*hcs12bdm_handler->read_mem)(hcs12bdm_ring_addr,
+		hcs12bdm_ring_buf, (size_t)hcs12bdm_ring_n * HCS12_AGENT_RING_DESC) == 0)
+	{
+		for (i = 0; i < hcs12bdm_ring_n; ++ i)
+		{
+			d = hcs12bdm_ring_buf + i * HCS12_AGENT_RING_DESC;
+			if (d[HCS12_AGENT_RING_DESC_STATUS] != HCS12_AGENT_ERROR_NONE)
+			{
+				error("FLASH write failed at page <0x%02X> address <0x%04X>\n",
+				      (unsigned int)d[HCS12_AGENT_RING_DESC_PARAM + 1],
+				      (unsigned int)uint16_be2host_from_buf(d + HCS12_AGENT_RING_DESC_PARAM + 2));
+				break;
+			}
+		}
+	}
+	return ret;
+}
+
+
+/*
+ *  FLASH write callback for command ring - chunk is queued, ring is
+ *  executed when full
+ *
+ *  in:
+ *    addr - FLASH linear address
+ *    size - block size
+ *    buf - data buffer
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_flash_write_cb_ring(uint32_t addr, const void *buf, size_t size)
+{
+	uint8_t *d;
+	int ret;
+
+	if ((size_t)(hcs12bdm_ring_n + 1) * HCS12_AGENT_RING_DESC +
+	    hcs12bdm_ring_used + size > hcs12bdm_ring_size)
+	{
+		ret = hcs12bdm_ring_flush();
+		if (ret != 0)
+			return ret;
+	}
+
+	hcs12bdm_ring_used += (uint16_t)size;
+	memcpy(hcs12bdm_ring_buf + hcs12bdm_ring_size - hcs12bdm_ring_used, buf, size);
+
+	/* parameters as for FLASH_WRITE command */
+
+	d = hcs12bdm_ring_buf + hcs12bdm_ring_n * HCS12_AGENT_RING_DESC;
+	memset(d, 0, HCS12_AGENT_RING_DESC);
+	d[HCS12_AGENT_RING_DESC_CMD] = HCS12_AGENT_CMD_FLASH_WRITE;
+	d[HCS12_AGENT_RING_DESC_STATUS] = HCS12_AGENT_RING_PENDING;
+	d[HCS12_AGENT_RING_DESC_PARAM + 0] = hcs12mcu_linear_to_block(addr);
+	d[HCS12_AGENT_RING_DESC_PARAM + 1] = hcs12mcu_linear_to_ppage(addr);
+	uint16_host2be_to_buf(d + HCS12_AGENT_RING_DESC_PARAM + 2,
+		(uint16_t)hcs12mcu_flash_addr_window(addr));
+	uint16_host2be_to_buf(d + HCS12_AGENT_RING_DESC_PARAM + 4, (uint16_t)size);
+	uint16_host2be_to_buf(d + HCS12_AGENT_RING_DESC_PARAM + 6,
+		(uint16_t)(hcs12mcu_target.flash_phrase / 2));
+	uint16_host2be_to_buf(d + HCS12_AGENT_RING_DESC_DATA,
+		(uint16_t)(hcs12bdm_ring_addr + hcs12bdm_ring_size - hcs12bdm_ring_used));
+	++ hcs12bdm_ring_n;
+
+	return 0;
+}
+
+
+/*
+ *  check whether agent supports interleaved multi-block writing
+ *
+ *  in:
+ *    void
+ *  out:
+ *    TRUE when agent knows the command
+ */
+
+static int hcs12bdm_agent_multi_probe(void)
+{
+	int status;
+
+	/* empty segment list tells whether agent knows the command */
+
+	if ((*hcs12bdm_handler->write_byte)(
+		(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 0), 0) != 0)
+		return FALSE;
+	if (hcs12bdm_agent_cmd(HCS12_AGENT_CMD_FLASH_WRITE_MULTI, &status) != 0 ||
+	    status != HCS12_AGENT_ERROR_NONE)
+		return FALSE;
+
+	return TRUE;
+}
+
+
+/*
+ *  FLASH write callback for interleaved multi-block writing
+ *
+ *  in:
+ *    e - extents to write, at most one per FLASH block
+ *    n - number of extents
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_flash_write_cb_agent_multi(const hcs12mcu_extent_t *e, int n)
+{
+	uint8_t *q;
+	size_t off;
+	int ret;
+	int i;
+
+	if (n > 1)
+	{
+		/* segment descriptors first, then data */
+
+		q = hcs12bdm_agent_multi_buf;
+		off = (size_t)n * HCS12BDM_AGENT_MULTI_DESC;
+		for (i = 0; i < n; ++ i)
+		{
+			q[i * HCS12BDM_AGENT_MULTI_DESC + 0] = hcs12mcu_linear_to_block(e[i].addr);
+			q[i * HCS12BDM_AGENT_MULTI_DESC + 1] = hcs12mcu_linear_to_ppage(e[i].addr);
+			uint16_host2be_to_buf(q + i * HCS12BDM_AGENT_MULTI_DESC + 2,
+				(uint16_t)(HCS12_FLASH_PAGE_BANKED_ADDR +
+				(e[i].addr % HCS12_FLASH_PAGE_SIZE)));
+			uint16_host2be_to_buf(q + i * HCS12BDM_AGENT_MULTI_DESC + 4,
+				(uint16_t)(hcs12bdm_agent_buf_addr + off));
+			uint16_host2be_to_buf(q + i * HCS12BDM_AGENT_MULTI_DESC + 6,
+				(uint16_t)(e[i].size / 2));
+			memcpy(q + off, e[i].buf, e[i].size);
+			off += e[i].size;
+		}
+
+		ret = (*hcs12bdm_handler->write_mem)(
+			hcs12bdm_agent_buf_addr, q, off);
+		if (ret != 0)
+			return ret;
+
+		ret = (*hcs12bdm_handler->write_byte)(
+			(uint16_t)(hcs12bdm_agent_param + HCS12_AGENT_PARAM + 0),
+			(uint8_t)n);
+		if (ret != 0)
+			return ret;
+
+		return hcs12bdm_agent_cmd(HCS12_AGENT_CMD_FLASH_WRITE_MULTI, NULL);
+	}
+
+	for (i = 0; i < n; ++ i)
+	{
+		ret = hcs12bdm_flash_write_cb_agent(e[i].addr, e[i].buf, e[i].size);
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+
 /*
  *  write target FLASH
  *
@@ -2107,6 +3262,8 @@ static int hcs12bdm_flash_write(const char *file)
 {
 	int ret;
 	int agent;
+	uint32_t chunk;
+	uint32_t n;
 
 	ret = hcs12bdm_get_mode("bdm_flash_write", &agent);
 	if (ret != 0)
@@ -2130,14 +3287,179 @@ static int hcs12bdm_flash_write(const char *file)
 		if (ret != 0)
 			return ret;
 
+		ret = hcs12mcu_flash_cost(HCS12BDM_COST_AGENT_OVERHEAD,
+			HCS12BDM_COST_RATE, HCS12_FLASH_WORD_TIME);
+		if (ret != 0)
+			return ret;
+		hcs12mcu_flash_readback(hcs12bdm_flash_read_cb_agent);
+
+		/* agent buffer is shared by all blocks, so older agents
+		   without multi-block writing get full buffer chunks instead */
+
+		if (hcs12mcu_target.flash_blocks > 1 &&
+		    options.flash_addr != HCS12MEM_FLASH_ADDR_NON_BANKED &&
+		    hcs12bdm_agent_multi_probe())
+		{
+			/* chunk size must be a power of 2 */
+
+			chunk = (hcs12bdm_agent_buf_len / hcs12mcu_target.flash_blocks) -
+				HCS12BDM_AGENT_MULTI_DESC;
+			for (n = hcs12mcu_target.flash_phrase; n * 2 <= chunk; n *= 2)
+				;
+			chunk = n;
+
+			hcs12bdm_agent_multi_buf = malloc(hcs12bdm_agent_buf_len);
+			if (hcs12bdm_agent_multi_buf == NULL)
+			{
+				error("not enough memory\n");
+				return ENOMEM;
+			}
+
+			ret = hcs12mcu_flash_write_blocks(file, (size_t)chunk,
+				hcs12bdm_flash_write_cb_agent_multi);
+			free(hcs12bdm_agent_multi_buf);
+			hcs12bdm_agent_multi_buf = NULL;
+			return ret;
+		}
+
+		/* chunks are collected in command ring and written by one
+		   agent run each time ring fills up, chunks count as written
+		   (journal, progress) only when their ring has been run */
+
+		if (hcs12bdm_ring_open())
+		{
+			ret = hcs12mcu_flash_cost(HCS12BDM_COST_RING_OVERHEAD,
+				HCS12BDM_COST_RATE, HCS12_FLASH_WORD_TIME);
+			if (ret == 0)
+			{
+				hcs12mcu_flash_defer(hcs12bdm_ring_flush);
+				ret = hcs12mcu_flash_write(file, hcs12bdm_agent_buf_len, hcs12bdm_flash_write_cb_ring);
+			}
+			free(hcs12bdm_ring_buf);
+			hcs12bdm_ring_buf = NULL;
+			return ret;
+		}
+
 		return hcs12mcu_flash_write(file, hcs12bdm_agent_buf_len, hcs12bdm_flash_write_cb_agent);
 	}
 
-	hcs12bdm_ppage = 0xff; /* invalid ppage to start with, and force proper init */
+	ret = hcs12mcu_flash_cost(HCS12BDM_COST_DIRECT_OVERHEAD,
+		HCS12BDM_COST_RATE, HCS12BDM_COST_DIRECT_WORD);
+	if (ret != 0)
+		return ret;
+	hcs12mcu_flash_readback(hcs12bdm_flash_read_cb_direct);
+
 	return hcs12mcu_flash_write(file, HCS12BDM_FLASH_WRITE_CHUNK, hcs12bdm_flash_write_cb_direct);
 }
 
 
+/*
+ *  FLASH sector erase callback for FLASH update
+ *
+ *  in:
+ *    addr - FLASH linear address of sector
+ *    wait - flag set when erase completion must be awaited
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_flash_update_erase(uint32_t addr, int wait)
+{
+	int ret;
+
+	ret = hcs12bdm_flash_set_bank_ppage(addr);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12bdm_reg_write(HCS12_IO_FPROT, 0xff);
+	if (ret != 0)
+		return ret;
+	ret = hcs12bdm_reg_write(
+		HCS12_IO_FSTAT, HCS12_IO_FSTAT_PVIOL | HCS12_IO_FSTAT_ACCERR);
+	if (ret != 0)
+		return ret;
+	ret = (*hcs12bdm_handler->write_word)((uint16_t)(HCS12_FLASH_PAGE_BANKED_ADDR +
+		(addr % HCS12_FLASH_PAGE_SIZE)), 0xffff);
+	if (ret != 0)
+		return ret;
+	ret = hcs12bdm_reg_write(
+		HCS12_IO_FCMD, HCS12_IO_FCMD_SECTOR_ERASE);
+	if (ret != 0)
+		return ret;
+	ret = hcs12bdm_reg_write(
+		HCS12_IO_FSTAT, HCS12_IO_FSTAT_CBEIF);
+	if (ret != 0)
+		return ret;
+
+	/* started erase keeps running on chip, while halted target is
+	   accessed via BDM and agent is fed with data */
+
+	return hcs12bdm_hcs12_flash_wait(wait ?
+		HCS12_IO_FSTAT_CCIF : HCS12_IO_FSTAT_CBEIF);
+}
+
+
+/*
+ *  update target FLASH - erase sectors covered by image and write them
+ *
+ *  in:
+ *    file - file name with data for programming
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_flash_update(const char *file)
+{
+	int ret;
+	int agent;
+
+	if (hcs12mcu_target.family < HCS12_FAMILY_S12)
+	{
+		error("FLASH update not available for this MCU family\n");
+		return EINVAL;
+	}
+
+	ret = hcs12bdm_get_mode("bdm_flash_write", &agent);
+	if (ret != 0)
+		return ret;
+
+	if (hcs12mcu_target.flash_size == 0)
+	{
+		error("FLASH update not possible - no FLASH memory\n");
+		return EINVAL;
+	}
+
+	if (hcs12mcu_target.secured && !options.force)
+	{
+		error("FLASH update not possible - MCU secured (-f option forces the operation)\n");
+		return EIO;
+	}
+
+	if (agent)
+	{
+		ret = hcs12bdm_agent_load();
+		if (ret != 0)
+			return ret;
+
+		ret = hcs12mcu_flash_cost(HCS12BDM_COST_AGENT_OVERHEAD,
+			HCS12BDM_COST_RATE, HCS12_FLASH_WORD_TIME);
+		if (ret != 0)
+			return ret;
+
+		return hcs12mcu_flash_update(file, hcs12bdm_agent_buf_len,
+			hcs12bdm_flash_update_erase, hcs12bdm_flash_write_cb_agent);
+	}
+
+	ret = hcs12mcu_flash_cost(HCS12BDM_COST_DIRECT_OVERHEAD,
+		HCS12BDM_COST_RATE, HCS12BDM_COST_DIRECT_WORD);
+	if (ret != 0)
+		return ret;
+
+	return hcs12mcu_flash_update(file, HCS12BDM_FLASH_WRITE_CHUNK,
+		hcs12bdm_flash_update_erase, hcs12bdm_flash_write_cb_direct);
+}
+
+
 /*
  *  protect target FLASH
  *
@@ -2153,6 +3475,290 @@ static int hcs12bdm_flash_protect(const char *opt)
 }
 
 
+/*
+ *  calibration helper - time target RAM write and read back with
+ *  current transfer mode
+ *
+ *  in:
+ *    pattern - test data
+ *    buf - buffer for read back data
+ *    size - test block size
+ *    ms - elapsed time (on return)
+ *  out:
+ *    status code (errno-like), EIO when data read back differs
+ */
+
+static int hcs12bdm_calibrate_ram(const uint8_t *pattern, uint8_t *buf,
+	size_t size, unsigned long *ms)
+{
+	unsigned long t;
+	int ret;
+
+	t = sys_get_ms();
+
+	ret = (*hcs12bdm_handler->write_mem)(
+		(uint16_t)hcs12mcu_target.ram_base, pattern, size);
+	if (ret != 0)
+		return ret;
+
+	ret = (*hcs12bdm_handler->read_mem)(
+		(uint16_t)hcs12mcu_target.ram_base, buf, size);
+	if (ret != 0)
+		return ret;
+
+	*ms = sys_get_ms() - t;
+
+	if (memcmp(pattern, buf, size) != 0)
+		return EIO;
+
+	return 0;
+}
+
+
+/*
+ *  calibration helper - time FLASH sample read with given method
+ *
+ *  in:
+ *    f - FLASH read callback
+ *    chunk - read chunk size
+ *    buf - buffer for data
+ *    size - sample size
+ *    ms - elapsed time (on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_calibrate_flash(
+	int (*f)(uint32_t addr, void *buf, size_t size),
+	size_t chunk, uint8_t *buf, size_t size, unsigned long *ms)
+{
+	unsigned long t;
+	size_t i;
+	int ret;
+
+	t = sys_get_ms();
+
+	for (i = 0; i < size; i += chunk)
+	{
+		ret = (*f)((uint32_t)i, buf + i, chunk);
+		if (ret != 0)
+			return ret;
+	}
+
+	*ms = sys_get_ms() - t;
+	return 0;
+}
+
+
+/*
+ *  calibration helper - report measured transfer rate
+ *
+ *  in:
+ *    what - measured method description
+ *    size - transferred data size
+ *    ms - elapsed time, in ms
+ *    ok - measurement status
+ *  out:
+ *    void
+ */
+
+static void hcs12bdm_calibrate_report(const char *what, size_t size,
+	unsigned long ms, int ok)
+{
+	if (!options.verbose)
+		return;
+
+	if (!ok)
+		printf("calibration: %s <failed>\n", (const char *)what);
+	else
+	{
+		printf("calibration: %s <%lu B/s>\n",
+		       (const char *)what,
+		       (unsigned long)(size * 1000UL / (ms == 0 ? 1 : ms)));
+	}
+}
+
+
+/*
+ *  benchmark available transfer modes and FLASH read methods, store
+ *  the fastest working ones in tuning profile
+ *  (FLASH/EEPROM write methods are not measured, as this would require
+ *  erasing target memory)
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12bdm_calibrate(void)
+{
+	static const size_t chunks[] = { 256, 512, 1024, 2048, 4096 };
+	uint8_t *save;
+	uint8_t *pattern;
+	uint8_t *buf;
+	uint8_t *ref;
+	size_t ram_size;
+	size_t flash_size;
+	const char *key;
+	int *mode;
+	int best_mode;
+	unsigned long best_ms;
+	unsigned long ms;
+	size_t best_chunk;
+	int best_agent;
+	char str[32];
+	size_t i;
+	int ret;
+
+	if (hcs12mcu_target.secured && !options.force)
+	{
+		error("calibration not possible - MCU secured (-f option forces the operation)\n");
+		return EIO;
+	}
+
+	ram_size = HCS12BDM_CALIBRATE_RAM_SIZE;
+	if (ram_size > hcs12mcu_target.ram_size)
+		ram_size = hcs12mcu_target.ram_size;
+	flash_size = HCS12BDM_CALIBRATE_FLASH_SIZE;
+	if (flash_size > hcs12mcu_target.flash_size)
+		flash_size = hcs12mcu_target.flash_size;
+
+	save = malloc(2 * ram_size + 2 * flash_size);
+	if (save == NULL)
+	{
+		error("not enough memory\n");
+		return ENOMEM;
+	}
+	pattern = save + ram_size;
+	buf = pattern + ram_size;
+	ref = buf + flash_size;
+
+	/* POD transfer mode, measured on RAM (contents restored afterwards) */
+
+	if (hcs12bdm_handler == &tbdml_bdm_handler)
+	{
+		key = "tbdml_bulk";
+		mode = &options.tbdml_bulk;
+	}
+	else if (hcs12bdm_handler == &bdm12pod_bdm_handler)
+	{
+		key = "podex_mem_bug";
+		mode = &options.podex_mem_bug;
+	}
+	else
+	{
+		key = NULL;
+		mode = NULL;
+	}
+
+	ret = (*hcs12bdm_handler->read_mem)(
+		(uint16_t)hcs12mcu_target.ram_base, save, ram_size);
+	if (ret != 0)
+		goto done;
+
+	for (i = 0; i < ram_size; ++ i)
+		pattern[i] = (uint8_t)(i * 7 + (i >> 8) + 0x5a);
+
+	ms = 0;
+	best_mode = (mode == NULL ? FALSE : *mode);
+	best_ms = HCS12BDM_CALIBRATE_NONE;
+	for (i = 0; i < (mode == NULL ? 1 : 2); ++ i)
+	{
+		if (mode != NULL)
+			*mode = (int)i;
+		ret = hcs12bdm_calibrate_ram(pattern, buf, ram_size, &ms);
+		snprintf(str, sizeof(str), "RAM access %s <%s>",
+			 (const char *)(key == NULL ? "" : key),
+			 (const char *)(i ? "on" : "off"));
+		hcs12bdm_calibrate_report(str, 2 * ram_size, ms, ret == 0);
+		if (ret == 0 && ms < best_ms)
+		{
+			best_mode = (int)i;
+			best_ms = ms;
+		}
+	}
+	if (mode != NULL)
+		*mode = best_mode;
+
+	ret = (*hcs12bdm_handler->write_mem)(
+		(uint16_t)hcs12mcu_target.ram_base, save, ram_size);
+	if (ret != 0)
+		goto done;
+	hcs12bdm_agent_loaded = FALSE;
+
+	if (best_ms == HCS12BDM_CALIBRATE_NONE)
+	{
+		error("calibration failed - no working transfer mode\n");
+		ret = EIO;
+		goto done;
+	}
+
+	if (mode != NULL)
+	{
+		ret = hcs12mem_profile_set(key, best_mode ? "1" : "0");
+		if (ret != 0)
+			goto done;
+	}
+
+	/* FLASH read method and chunk size, first direct read is reference */
+
+	if (flash_size != 0)
+	{
+		best_ms = HCS12BDM_CALIBRATE_NONE;
+		best_chunk = HCS12BDM_FLASH_READ_CHUNK;
+		best_agent = FALSE;
+
+		for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++ i)
+		{
+			if (chunks[i] > flash_size)
+				break;
+			ret = hcs12bdm_calibrate_flash(hcs12bdm_flash_read_cb_direct,
+				chunks[i], (i == 0 ? ref : buf), flash_size, &ms);
+			if (ret == 0 && i != 0 && memcmp(ref, buf, flash_size) != 0)
+				ret = EIO;
+			snprintf(str, sizeof(str), "FLASH read bdm <%u B>",
+				 (unsigned int)chunks[i]);
+			hcs12bdm_calibrate_report(str, flash_size, ms, ret == 0);
+			if (ret != 0 && i == 0)
+				goto done;
+			if (ret == 0 && ms < best_ms)
+			{
+				best_chunk = chunks[i];
+				best_ms = ms;
+			}
+		}
+
+		if (hcs12mem_target_info("bdm_agent", TRUE) != NULL &&
+		    hcs12bdm_agent_load() == 0 &&
+		    hcs12bdm_agent_buf_len != 0 &&
+		    flash_size % hcs12bdm_agent_buf_len == 0)
+		{
+			ret = hcs12bdm_calibrate_flash(hcs12bdm_flash_read_cb_agent,
+				hcs12bdm_agent_buf_len, buf, flash_size, &ms);
+			if (ret == 0 && memcmp(ref, buf, flash_size) != 0)
+				ret = EIO;
+			hcs12bdm_calibrate_report("FLASH read agent", flash_size, ms, ret == 0);
+			if (ret == 0 && ms < best_ms)
+				best_agent = TRUE;
+		}
+
+		ret = hcs12mem_profile_set("bdm_flash_read", best_agent ? "agent" : "bdm");
+		if (ret != 0)
+			goto done;
+		snprintf(str, sizeof(str), "%u", (unsigned int)best_chunk);
+		ret = hcs12mem_profile_set("bdm_flash_read_chunk", str);
+		if (ret != 0)
+			goto done;
+	}
+
+	ret = 0;
+done:
+	free(save);
+	return ret;
+}
+
+
 /*
  *  open BDM target connection
  *
@@ -2235,7 +3841,9 @@ hcs12mem_target_handler_t hcs12mem_target_handler_bdm12pod =
 	hcs12bdm_flash_erase,
 	hcs12bdm_flash_write,
 	hcs12bdm_flash_protect,
-	hcs12bdm_reset
+	hcs12bdm_reset,
+	hcs12bdm_calibrate,
+	hcs12bdm_flash_update
 };
 
 
@@ -2273,5 +3881,7 @@ hcs12mem_target_handler_t hcs12mem_target_handler_tbdml =
 	hcs12bdm_flash_erase,
 	hcs12bdm_flash_write,
 	hcs12bdm_flash_protect,
-	hcs12bdm_reset
+	hcs12bdm_reset,
+	hcs12bdm_calibrate,
+	hcs12bdm_flash_update
 };
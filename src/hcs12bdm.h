@@ -29,6 +29,25 @@
 #define HCS12BDM_EEPROM_READ_CHUNK 256
 #define HCS12BDM_FLASH_READ_CHUNK  512
 #define HCS12BDM_FLASH_WRITE_CHUNK  16 /* for direct writing ! */
+#define HCS12BDM_FLASH_READ_GLOBAL_CHUNK 0x4000 /* S12X global reads, whole page */
+#define HCS12BDM_AGENT_MULTI_DESC    8 /* multi-block write segment descriptor size */
+#define HCS12BDM_RING_SIZE_MAX  0x2000 /* command ring area, below agent */
+#define HCS12BDM_AGENT_BUF_SIZE_MIN 0x100 /* smallest agent data buffer below agent */
+#define HCS12BDM_AGENT_BUF_SIZE_MAX 0x400 /* largest one, quarter of RAM there */
+
+/* FLASH write cost model defaults */
+
+#define HCS12BDM_COST_AGENT_OVERHEAD  8000 /* us, agent command round trips */
+#define HCS12BDM_COST_RING_OVERHEAD    500 /* us, ring descriptor transfer */
+#define HCS12BDM_COST_DIRECT_OVERHEAD 2000 /* us, bank selection and setup */
+#define HCS12BDM_COST_DIRECT_WORD     3000 /* us, BDM round trips per word */
+#define HCS12BDM_COST_RATE           20000 /* bytes per second */
+
+/* calibration run */
+
+#define HCS12BDM_CALIBRATE_RAM_SIZE   1024 /* RAM test block */
+#define HCS12BDM_CALIBRATE_FLASH_SIZE 8192 /* FLASH read sample */
+#define HCS12BDM_CALIBRATE_NONE       ((unsigned long)-1) /* no result yet */
 
 /* HCS12 CPU registers */
 
@@ -46,6 +65,12 @@
 #define HCS12BDM_REG_SHIFTER     0xff02 /* 2 bytes */
 #define HCS12BDM_REG_ADDRESS     0xff04 /* 2 bytes */
 #define HCS12BDM_REG_CCRSAV      0xff06 /* 1 byte */
+#define HCS12BDM_REG_BDMGPR      0xff08 /* 1 byte, S12X only */
+
+/* S12X BDMGPR register bits */
+
+#define HCS12BDM_REG_BDMGPR_BGAE   0x80 /* BDM global address enable */
+#define HCS12BDM_REG_BDMGPR_BGP    0x7f /* BDM global page */
 
 /* BDM12 STATUS register bits */
 
@@ -95,6 +120,7 @@
 #define HCS12_EEPROM_CMD_TIMEOUT   1000
 #define HCS12_FLASH_CMD_TIMEOUT    1000
 #define HCS12BDM_RUN_TIMEOUT        5000
+#define HCS12BDM_PLL_LOCK_TIMEOUT   100
 
 /* BDM handler */
 
@@ -133,6 +159,10 @@ typedef struct
 	int (*go_until)(void);
 	int (*go_trace1)(void);
 	int (*go_taggo)(void);
+
+	/* interface speed */
+
+	int (*set_clock)(unsigned long f);
 }
 hcs12bdm_handler_t;
 
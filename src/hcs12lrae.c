@@ -26,6 +26,8 @@
 #include "hcs12bdm.h"
 #include "serial.h"
 #include "srec.h"
+#include "image.h"
+#include "pack.h"
 #include "../target/agent.h"
 
 
@@ -35,6 +37,7 @@ static serial_t hcs12lrae_serial;
 static uint32_t hcs12lrae_flash_size;
 static uint32_t hcs12lrae_ram_base;
 static int hcs12lrae_agent_loaded;
+static int hcs12lrae_pack;
 
 static const unsigned long hcs12lrae_baud_table[] =
 {
@@ -357,7 +360,7 @@ static int hcs12lrae_ram_load(const char *file, int agent)
 	}
 
 	entry = 0xffffffff;
-	ret = srec_read(
+	ret = image_read(
 		file,
 		info,
 		sizeof(info),
@@ -709,6 +712,10 @@ static int hcs12lrae_load_agent(void)
 		return EINVAL;
 	}
 
+	/* FLASH data is transferred packed, until agent turns out
+	   not to support it */
+
+	hcs12lrae_pack = TRUE;
 	hcs12lrae_agent_loaded = TRUE;
 
 	return 0;
@@ -1111,6 +1118,177 @@ static int hcs12lrae_flash_read_cb(uint32_t addr, void *buf, size_t size)
 }
 
 
+/*
+ *  FLASH read callback for arbitrary block, used for reading address
+ *  ranges and to check FLASH contents when resuming interrupted write
+ *
+ *  in:
+ *    addr - FLASH linear address
+ *    size - block size
+ *    buf - data buffer
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12lrae_flash_readback_cb(uint32_t addr, void *buf, size_t size)
+{
+	int ret;
+	uint8_t cmd[6];
+	uint8_t b;
+
+	cmd[0] = hcs12mcu_linear_to_block(addr);
+	cmd[1] = hcs12mcu_linear_to_ppage(addr);
+	uint16_host2be_to_buf(cmd + 2, (uint16_t)hcs12mcu_flash_addr_window(addr));
+	uint16_host2be_to_buf(cmd + 4, (uint16_t)size);
+
+	ret = hcs12lrae_cmd(HCS12_AGENT_CMD_FLASH_READ, cmd, sizeof(cmd));
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12lrae_rx(buf, size);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12lrae_rx(&b, 1);
+	if (ret != 0)
+		return ret;
+
+	if (hcs12lrae_sum(buf, size) != b)
+	{
+		error("invalid checksum received\n");
+		return EIO;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  get answer to packed transfer command - agent acknowledges command
+ *  it knows, before any data is transferred
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like), ENOTSUP when agent lacks the command
+ */
+
+static int hcs12lrae_pack_ack(void)
+{
+	uint8_t b;
+	int ret;
+
+	ret = hcs12lrae_rx(&b, 1);
+	if (ret != 0)
+		return ret;
+
+	if (b == HCS12_AGENT_ERROR_CMD)
+	{
+		/* older agent, data is transferred as is */
+		hcs12lrae_pack = FALSE;
+		return ENOTSUP;
+	}
+	if (b != HCS12_AGENT_ERROR_NONE)
+	{
+		error("communication failed, invalid response received\n");
+		return EIO;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  FLASH read callback for arbitrary block, transferred packed
+ *
+ *  in:
+ *    addr - FLASH linear address
+ *    size - block size
+ *    buf - data buffer
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12lrae_flash_read_cb_packed(uint32_t addr, void *buf, size_t size)
+{
+	int ret;
+	uint8_t cmd[6];
+	uint8_t b;
+	uint8_t sum;
+	uint8_t *ptr;
+	size_t n, k;
+
+	if (!hcs12lrae_pack)
+		return hcs12lrae_flash_readback_cb(addr, buf, size);
+
+	cmd[0] = hcs12mcu_linear_to_block(addr);
+	cmd[1] = hcs12mcu_linear_to_ppage(addr);
+	uint16_host2be_to_buf(cmd + 2, (uint16_t)hcs12mcu_flash_addr_window(addr));
+	uint16_host2be_to_buf(cmd + 4, (uint16_t)size);
+
+	ret = hcs12lrae_cmd(HCS12_AGENT_CMD_FLASH_READ_PACKED, cmd, sizeof(cmd));
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12lrae_pack_ack();
+	if (ret == ENOTSUP)
+		return hcs12lrae_flash_readback_cb(addr, buf, size);
+	if (ret != 0)
+		return ret;
+
+	/* packed data is unpacked as it is received */
+
+	ptr = buf;
+	sum = 0;
+	for (n = 0; n < size; n += k)
+	{
+		ret = hcs12lrae_rx(&b, 1);
+		if (ret != 0)
+			return ret;
+		sum += b;
+
+		if (b < HCS12_AGENT_PACK_RUN)
+		{
+			k = (size_t)b + 1;
+			if (k > size - n)
+				break;
+			ret = hcs12lrae_rx(ptr + n, k);
+			if (ret != 0)
+				return ret;
+			sum += hcs12lrae_sum(ptr + n, (int)k);
+		}
+		else
+		{
+			k = (size_t)(b - HCS12_AGENT_PACK_RUN) + HCS12_AGENT_PACK_RUN_MIN;
+			if (k > size - n)
+				break;
+			ret = hcs12lrae_rx(ptr + n, 1);
+			if (ret != 0)
+				return ret;
+			sum += ptr[n];
+			memset(ptr + n + 1, ptr[n], k - 1);
+		}
+	}
+	if (n < size)
+	{
+		error("invalid packed data received\n");
+		return EIO;
+	}
+
+	ret = hcs12lrae_rx(&b, 1);
+	if (ret != 0)
+		return ret;
+
+	if (sum != b)
+	{
+		error("invalid checksum received\n");
+		return EIO;
+	}
+
+	return 0;
+}
+
+
 /*
  *  read target FLASH
  *
@@ -1128,7 +1306,16 @@ static int hcs12lrae_flash_read(const char *file)
 	if (ret != 0)
 		return ret;
 
-	ret = hcs12mcu_flash_read(file, 1, hcs12lrae_flash_read_cb);
+	/* packed read callback takes whole page, falls back to read
+	   as is with older agent; streaming read callback handles whole
+	   pages only */
+
+	if (hcs12lrae_pack)
+		ret = hcs12mcu_flash_read(file, HCS12_FLASH_PAGE_SIZE, hcs12lrae_flash_read_cb_packed);
+	else if (strchr(file, HCS12MEM_RANGE_SEPARATOR) != NULL)
+		ret = hcs12mcu_flash_read(file, HCS12LRAE_BUFFER_SIZE, hcs12lrae_flash_readback_cb);
+	else
+		ret = hcs12mcu_flash_read(file, 1, hcs12lrae_flash_read_cb);
 	if (ret != 0)
 		return ret;
 
@@ -1150,17 +1337,42 @@ static int hcs12lrae_flash_read(const char *file)
 static int hcs12lrae_flash_write_cb(uint32_t addr, const void *buf, size_t size)
 {
 	int ret;
-	uint8_t cmd[6];
+	uint8_t cmd[8];
+	uint8_t q[HCS12LRAE_BUFFER_SIZE];
 	uint8_t b;
+	size_t n;
 
 	cmd[0] = hcs12mcu_linear_to_block(addr);
 	cmd[1] = hcs12mcu_linear_to_ppage(addr);
 	uint16_host2be_to_buf(cmd + 2, (uint16_t)hcs12mcu_flash_addr_window(addr));
 	uint16_host2be_to_buf(cmd + 4, (uint16_t)size);
 
-	ret = hcs12lrae_cmd(HCS12_AGENT_CMD_FLASH_WRITE, cmd, sizeof(cmd));
-	if (ret != 0)
-		return ret;
+	/* packed data is sent when it pays off */
+
+	ret = ENOTSUP;
+	if (hcs12lrae_pack && pack_encode(buf, size, q, sizeof(q), &n) == 0)
+	{
+		uint16_host2be_to_buf(cmd + 6, (uint16_t)n);
+		ret = hcs12lrae_cmd(HCS12_AGENT_CMD_FLASH_WRITE_PACKED, cmd, sizeof(cmd));
+		if (ret != 0)
+			return ret;
+
+		ret = hcs12lrae_pack_ack();
+		if (ret != 0 && ret != ENOTSUP)
+			return ret;
+	}
+
+	if (ret == 0)
+	{
+		buf = q;
+		size = n;
+	}
+	else
+	{
+		ret = hcs12lrae_cmd(HCS12_AGENT_CMD_FLASH_WRITE, cmd, sizeof(cmd) - 2);
+		if (ret != 0)
+			return ret;
+	}
 
 	ret = hcs12lrae_tx(buf, size);
 	if (ret != 0)
@@ -1205,6 +1417,12 @@ static int hcs12lrae_flash_write(const char *file)
 	if (ret != 0)
 		return ret;
 
+	ret = hcs12mcu_flash_cost(HCS12LRAE_COST_OVERHEAD,
+		(uint32_t)(options.baud / 10), HCS12_FLASH_WORD_TIME);
+	if (ret != 0)
+		return ret;
+
+	hcs12mcu_flash_readback(hcs12lrae_flash_readback_cb);
 	ret = hcs12mcu_flash_write(file, HCS12LRAE_BUFFER_SIZE, hcs12lrae_flash_write_cb);
 	if (ret != 0)
 		return ret;
@@ -1256,5 +1474,7 @@ hcs12mem_target_handler_t hcs12mem_target_handler_lrae =
 	hcs12lrae_flash_erase,
 	hcs12lrae_flash_write,
 	NULL,
-	hcs12lrae_reset
+	hcs12lrae_reset,
+	NULL,
+	NULL
 };
@@ -30,6 +30,7 @@
 #define HCS12LRAE_BAUD_ERROR_LIMIT 390 /* 3.9% */
 
 #define HCS12LRAE_BUFFER_SIZE 256
+#define HCS12LRAE_COST_OVERHEAD 3000 /* us, command and answer latency */
 
 #define HCS12LRAE_SYNC_MSG     0x55
 #define HCS12LRAE_SYNC_ACK     0xaa
@@ -23,6 +23,8 @@
 #include "hcs12mem.h"
 #include "hcs12mcu.h"
 #include "srec.h"
+#include "image.h"
+#include "patch.h"
 
 static const char *hcs12_family_table[] =
 {
@@ -190,28 +192,62 @@ static const struct
 	uint8_t ppage_count;
 	uint8_t ppage_base_2;
 	uint8_t ppage_count_2;
+	uint32_t phrase;
 }
 hcs12_flash_module_table[] =
 {
-	/* name        type           fsec_keyen_bits, blocks   size sector  lsize   lbase ppbase1 ppcnt1 ppbase2 ppcnt2 */
-	{ "NONE",      HCS12_FLASH_MODULE_NONE,     0, 0,          0,    0,      0,      0,    0,  0,    0, 0 },
-	{ "OTHER",     HCS12_FLASH_MODULE_OTHER,    0, 0,          0,    0,      0,      0,    0,  0,    0, 0 },
-	{ "FTS16K",    HCS12_FLASH_MODULE_FTS16K,   2, 1,  16 * 1024,  512, 0x4000, 0xc000, 0x3f,  1,    0, 0 },
-	{ "FTS32K",    HCS12_FLASH_MODULE_FTS32K,   2, 1,  32 * 1024,  512, 0x8000, 0x8000, 0x3e,  2,    0, 0 },
-	{ "FTS64K",    HCS12_FLASH_MODULE_FTS64K,   1, 1,  64 * 1024,  512, 0xc000, 0x4000, 0x3c,  4,    0, 0 },
-	{ "FTS64KV4",  HCS12_FLASH_MODULE_FTS64K,   2, 1,  64 * 1024,  512, 0xc000, 0x4000, 0x3c,  4,    0, 0 },
-	{ "FTS128K",   HCS12_FLASH_MODULE_FTS128K,  2, 2, 128 * 1024,  512, 0xc000, 0x4000, 0x38,  8,    0, 0 },
-	{ "FTS128K1",  HCS12_FLASH_MODULE_FTS128K1, 2, 1, 128 * 1024, 1024, 0xc000, 0x4000, 0x38,  8,    0, 0 },
-	{ "FTS256K",   HCS12_FLASH_MODULE_FTS256K,  1, 4, 256 * 1024,  512, 0xc000, 0x4000, 0x30, 16,    0, 0 },
-	{ "FTS512K4",  HCS12_FLASH_MODULE_FTS512K4, 2, 4, 512 * 1024, 1024, 0xc000, 0x4000, 0x20, 32,    0, 0 },
-	{ "FTX128K1",  HCS12_FLASH_MODULE_FTX128K1, 2, 1, 128 * 1024, 1024, 0xc000, 0x4000, 0xf8,  8,    0, 0 },
-	{ "FTX256K2",  HCS12_FLASH_MODULE_FTX256K2, 2, 2, 256 * 1024, 1024, 0xc000, 0x4000, 0xe0,  8, 0xf0, 8 },
-	{ "FTX512K4",  HCS12_FLASH_MODULE_FTX512K4, 2, 4, 512 * 1024, 1024, 0xc000, 0x4000, 0xe0, 32,    0, 0 },
-	{ NULL,        HCS12_FLASH_MODULE_UNKNOWN,  0, 0,          0,    0,      0,      0,    0,  0,    0, 0 }
+	/* name        type           fsec_keyen_bits, blocks   size sector  lsize   lbase ppbase1 ppcnt1 ppbase2 ppcnt2 phrase */
+	{ "NONE",      HCS12_FLASH_MODULE_NONE,     0, 0,          0,    0,      0,      0,    0,  0,    0, 0,  0 },
+	{ "OTHER",     HCS12_FLASH_MODULE_OTHER,    0, 0,          0,    0,      0,      0,    0,  0,    0, 0,  0 },
+	{ "FTS16K",    HCS12_FLASH_MODULE_FTS16K,   2, 1,  16 * 1024,  512, 0x4000, 0xc000, 0x3f,  1,    0, 0,  2 },
+	{ "FTS32K",    HCS12_FLASH_MODULE_FTS32K,   2, 1,  32 * 1024,  512, 0x8000, 0x8000, 0x3e,  2,    0, 0,  2 },
+	{ "FTS64K",    HCS12_FLASH_MODULE_FTS64K,   1, 1,  64 * 1024,  512, 0xc000, 0x4000, 0x3c,  4,    0, 0,  2 },
+	{ "FTS64KV4",  HCS12_FLASH_MODULE_FTS64K,   2, 1,  64 * 1024,  512, 0xc000, 0x4000, 0x3c,  4,    0, 0,  2 },
+	{ "FTS128K",   HCS12_FLASH_MODULE_FTS128K,  2, 2, 128 * 1024,  512, 0xc000, 0x4000, 0x38,  8,    0, 0,  2 },
+	{ "FTS128K1",  HCS12_FLASH_MODULE_FTS128K1, 2, 1, 128 * 1024, 1024, 0xc000, 0x4000, 0x38,  8,    0, 0,  2 },
+	{ "FTS256K",   HCS12_FLASH_MODULE_FTS256K,  1, 4, 256 * 1024,  512, 0xc000, 0x4000, 0x30, 16,    0, 0,  2 },
+	{ "FTS512K4",  HCS12_FLASH_MODULE_FTS512K4, 2, 4, 512 * 1024, 1024, 0xc000, 0x4000, 0x20, 32,    0, 0,  2 },
+	{ "FTX128K1",  HCS12_FLASH_MODULE_FTX128K1, 2, 1, 128 * 1024, 1024, 0xc000, 0x4000, 0xf8,  8,    0, 0,  8 },
+	{ "FTX256K2",  HCS12_FLASH_MODULE_FTX256K2, 2, 2, 256 * 1024, 1024, 0xc000, 0x4000, 0xe0,  8, 0xf0, 8,  8 },
+	{ "FTX512K4",  HCS12_FLASH_MODULE_FTX512K4, 2, 4, 512 * 1024, 1024, 0xc000, 0x4000, 0xe0, 32,    0, 0,  8 },
+	{ NULL,        HCS12_FLASH_MODULE_UNKNOWN,  0, 0,          0,    0,      0,      0,    0,  0,    0, 0,  0 }
 };
 
 hcs12mcu_target_t hcs12mcu_target;
 
+static hcs12mcu_cost_t hcs12mcu_cost;
+
+/* FLASH write journal - for each write stream, image offset up to
+   which all extents were confirmed written */
+
+static struct
+{
+	FILE *f;
+	char file[SYS_MAX_PATH + 1];
+	uint32_t mark[HCS12_FLASH_BLOCKS_MAX];
+}
+hcs12mcu_journal;
+
+static int (*hcs12mcu_readback)(uint32_t addr, void *buf, size_t size);
+
+/* FLASH write with deferred programming - extents passed to write
+   callback are recorded in journal and progress only when confirmed */
+
+static struct
+{
+	int (*flush)(void);
+	uint32_t end;
+	uint32_t pending;
+	uint32_t cnt;
+	uint32_t len;
+}
+hcs12mcu_defer;
+
+/* FLASH sectors touched by image patch (flag per sector), NULL when
+   image was not patched */
+
+static uint8_t *hcs12mcu_patch_sectors;
+
 
 int hcs12mcu_target_parse(void)
 {
@@ -351,6 +387,7 @@ int hcs12mcu_target_parse(void)
 			hcs12mcu_target.flash_nb_base = hcs12_flash_module_table[i].nb_base;
 			hcs12mcu_target.ppage_base = hcs12_flash_module_table[i].ppage_base;
 			hcs12mcu_target.ppage_count = hcs12_flash_module_table[i].ppage_count;
+			hcs12mcu_target.flash_phrase = hcs12_flash_module_table[i].phrase;
 			break;
 		}
 	}
@@ -374,6 +411,19 @@ int hcs12mcu_target_parse(void)
 	if (hcs12mem_target_param("flash_nb_base", &hcs12mcu_target.flash_nb_base, hcs12mcu_target.flash_nb_base) != 0)
 		return EINVAL;
 
+	/* FLASH programming unit, a word for FTS modules, a phrase for FTX */
+
+	if (hcs12mem_target_param("flash_phrase", &hcs12mcu_target.flash_phrase,
+		(hcs12mcu_target.flash_phrase == 0 ? 2 : hcs12mcu_target.flash_phrase)) != 0)
+		return EINVAL;
+	if (hcs12mcu_target.flash_phrase < 2 ||
+	    hcs12mcu_target.flash_phrase > HCS12_FLASH_PHRASE_MAX ||
+	    (hcs12mcu_target.flash_phrase & (hcs12mcu_target.flash_phrase - 1)) != 0)
+	{
+		error("invalid FLASH phrase size\n");
+		return EINVAL;
+	}
+
 	/* get PPAGE base and pages count */
 
 	if (hcs12mem_target_param("ppage_base", &hcs12mcu_target.ppage_base, hcs12mcu_target.ppage_base) != 0)
@@ -388,6 +438,7 @@ int hcs12mcu_target_parse(void)
 	hcs12mcu_target.flash_block_size =
 		hcs12mcu_target.flash_size / hcs12mcu_target.flash_blocks;
 
+	hcs12mcu_target.partid = 0;
 	hcs12mcu_target.read_byte = NULL;
 	hcs12mcu_target.read_word = NULL;
 	hcs12mcu_target.write_byte = NULL;
@@ -444,6 +495,7 @@ int hcs12mcu_partid(uint16_t id, int verbose)
 			);
 	}
 
+	hcs12mcu_target.partid = id;
 	return TRUE;
 }
 
@@ -929,127 +981,213 @@ uint8_t hcs12mcu_block_to_ppage_base(uint32_t block)
 
 
 /*
- *  read FLASH memory
+ *  EEPROM address -> buffer address
+ */
+
+static uint32_t hcs12mcu_eeprom_read_address(uint32_t addr)
+{
+	return addr - hcs12mcu_target.eeprom_base;
+}
+
+
+/*
+ *  parse address ranges appended to file name of read operation
+ *  (<file>@<range>[,<range>...], range is <start>-<end> or
+ *  <start>+<size>), ranges are marked in byte map, rounded to words
  *
  *  in:
- *    file - file name to write
+ *    file - file name with optional ranges
+ *    name - buffer for file name (on return)
+ *    name_len - buffer size
+ *    atc - address translation callback
+ *    size - memory size
+ *    map - byte map (on return), NULL when whole memory is read
+ *    len - size of data to read (on return)
  *  out:
  *    status code (errno-like)
  */
 
-int hcs12mcu_flash_read(const char *file, size_t chunk,
-	int (*f)(uint32_t addr, void *buf, size_t size))
+static int hcs12mcu_read_ranges(const char *file, char *name, size_t name_len,
+	uint32_t (*atc)(uint32_t addr), uint32_t size, uint8_t **map, uint32_t *len)
 {
-	int ret;
-	uint32_t size;
-	uint8_t *buf;
-	unsigned long t;
+	const char *ranges;
+	const char *ptr;
+	char *end;
+	unsigned long start;
+	unsigned long last;
+	uint32_t lo, hi;
 	uint32_t i;
-	uint32_t (*adc)(uint32_t addr);
-	uint32_t entry;
 
-	if (hcs12mcu_target.flash_size == 0)
+	*map = NULL;
+	*len = size;
+
+	ranges = strrchr(file, HCS12MEM_RANGE_SEPARATOR);
+	if (ranges == NULL)
 	{
-		error("FLASH read not possible - no FLASH memory\n");
-		return EINVAL;
+		strlcpy(name, file, name_len);
+		return 0;
 	}
 
-	if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
-		size = hcs12mcu_target.flash_nb_size;
-	else
-		size = hcs12mcu_target.flash_size;
+	i = (uint32_t)(ranges - file);
+	if (i >= (uint32_t)name_len)
+		i = (uint32_t)name_len - 1;
+	memcpy(name, file, (size_t)i);
+	name[i] = '\0';
 
-	buf = malloc(size);
-	if (buf == NULL)
+	*map = calloc(1, size);
+	if (*map == NULL)
 	{
 		error("not enough memory\n");
 		return ENOMEM;
 	}
 
-	t = progress_start("FLASH read: data");
-	for (i = 0; i < size; i += (uint32_t)chunk)
+	for (ptr = ranges + 1;; ptr = end + 1)
 	{
-		ret = (*f)(i, buf + i, chunk);
-		if (ret != 0)
+		start = strtoul(ptr, &end, 0);
+		if (end == ptr || (*end != '-' && *end != '+'))
+			break;
+		ptr = end + 1;
+		last = strtoul(ptr, &end, 0);
+		if (end == ptr || (*end != ',' && *end != '\0'))
+			break;
+		if (ptr[-1] == '+')
 		{
-			free(buf);
-			return ret;
+			if (last == 0)
+				break;
+			last = start + last - 1;
 		}
 
-		progress_report(i + (uint32_t)chunk, size);
+		lo = (*atc)((uint32_t)start);
+		hi = (*atc)((uint32_t)last);
+		if (lo >= size || hi >= size || lo > hi)
+			break;
+
+		lo &= ~(uint32_t)1;
+		hi |= 1;
+		if (hi >= size)
+			hi = size - 1;
+		memset(*map + lo, 1, (size_t)(hi - lo + 1));
+
+		if (*end == '\0')
+		{
+			*len = 0;
+			for (i = 0; i < size; ++ i)
+				*len += (*map)[i];
+			return 0;
+		}
 	}
-	progress_stop(t, "FLASH read: data", size);
 
-	if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
-		adc = hcs12mcu_flash_write_address_nb;
-	else if (options.flash_addr == HCS12MEM_FLASH_ADDR_BANKED_LINEAR)
-		adc = hcs12mcu_flash_write_address_bl;
-	else if (options.flash_addr == HCS12MEM_FLASH_ADDR_BANKED_PPAGE)
-		adc = hcs12mcu_flash_write_address_bp;
-	else
-		adc = NULL;
+	error("invalid address range: %s\n",
+	      (const char *)(ranges + 1));
+	free(*map);
+	*map = NULL;
+	return EINVAL;
+}
 
-	entry = ((uint32_t)buf[size - 2] << 8) + (uint32_t)buf[size - 1];
 
-	ret = srec_write(
-		file,
-		"FLASH image",
-		0,
-		size,
-		buf,
-		entry,
-		adc,
-		!options.include_erased,
-		options.srec_size,
-		SREC_ENTRY_MODE_RAW
-		);
-	if (ret != 0)
+/*
+ *  find next block to read - within chunk, covered by byte map
+ *
+ *  in:
+ *    map - byte map, NULL when whole memory is read
+ *    size - memory size
+ *    chunk - read chunk size
+ *    addr - search start address (on entry), block start (on return)
+ *    next - block end (on return)
+ *  out:
+ *    FALSE when there is no more data to read
+ */
+
+static int hcs12mcu_read_next(const uint8_t *map, uint32_t size,
+	size_t chunk, uint32_t *addr, uint32_t *next)
+{
+	uint32_t i, j;
+
+	i = *addr;
+	if (map != NULL)
 	{
-		free(buf);
-		return ret;
+		while (i < size && map[i] == 0)
+			++ i;
 	}
+	if (i >= size)
+		return FALSE;
 
-	if (options.verbose)
+	j = i - (i % (uint32_t)chunk) + (uint32_t)chunk;
+	if (j > size)
+		j = size;
+	if (map != NULL)
 	{
-		printf("FLASH read: data file <%s> written\n",
-		       (const char *)file);
+		for (*next = i; *next < j && map[*next] != 0; ++ *next)
+			;
+		j = *next;
 	}
 
-	free(buf);
+	*addr = i;
+	*next = j;
+	return TRUE;
+}
+
+
+/*
+ *  write data read so far to output file
+ *
+ *  in:
+ *    out - S-record output file
+ *    buf - data buffer
+ *    pos - start of data not written yet (on entry), next data
+ *          start (on return)
+ *    end - end of data read
+ *    next - next data start
+ *  out:
+ *    status code (errno-like), file is closed on error
+ */
+
+static int hcs12mcu_read_put(srec_file_t *out, const uint8_t *buf,
+	uint32_t *pos, uint32_t end, uint32_t next)
+{
+	int ret;
+
+	if (end > *pos)
+	{
+		ret = srec_put(out, *pos, end - *pos, buf + *pos);
+		if (ret != 0)
+			return ret;
+	}
+
+	*pos = next;
 	return 0;
 }
 
 
 /*
- *  write target FLASH
+ *  read FLASH memory
  *
  *  in:
- *    file - file name with data for programming
+ *    file - file name to write, optionally with address ranges
  *  out:
  *    status code (errno-like)
  */
 
-int hcs12mcu_flash_write(const char *file, size_t chunk,
-	int (*f)(uint32_t addr, const void *buf, size_t size))
+int hcs12mcu_flash_read(const char *file, size_t chunk,
+	int (*f)(uint32_t addr, void *buf, size_t size))
 {
-	uint32_t (*adc)(uint32_t addr);
+	int ret;
 	uint32_t size;
-	uint8_t *buf;
-	char info[256];
-	uint32_t entry;
-	uint32_t addr_min;
-	uint32_t addr_max;
 	uint32_t len;
-	uint32_t i, j;
-	uint32_t end;
-	uint32_t pend;
 	uint32_t cnt;
+	uint8_t *buf;
+	uint8_t *map;
+	char name[SYS_MAX_PATH + 1];
+	srec_file_t out;
 	unsigned long t;
-	int ret;
+	uint32_t i, j;
+	uint32_t p, q;
+	uint32_t (*adc)(uint32_t addr);
+	uint32_t entry;
 
 	if (hcs12mcu_target.flash_size == 0)
 	{
-		error("FLASH write not possible - no FLASH memory\n");
+		error("FLASH read not possible - no FLASH memory\n");
 		return EINVAL;
 	}
 
@@ -1058,172 +1196,1711 @@ int hcs12mcu_flash_write(const char *file, size_t chunk,
 	else
 		size = hcs12mcu_target.flash_size;
 
-	if (chunk < 2 || (chunk & 1) != 0 || (size % chunk) != 0 ||
-	    chunk > hcs12mcu_target.flash_sector)
-	{
-		error("invalid chunk size for FLASH write: %u\n",
-		      (unsigned int)chunk);
-		return EINVAL;
-	}
+	if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
+		adc = hcs12mcu_flash_read_address_nb;
+	else if (options.flash_addr == HCS12MEM_FLASH_ADDR_BANKED_LINEAR)
+		adc = hcs12mcu_flash_read_address_bl;
+	else
+		adc = hcs12mcu_flash_read_address_bp;
+
+	ret = hcs12mcu_read_ranges(file, name, sizeof(name), adc, size, &map, &len);
+	if (ret != 0)
+		return ret;
 
 	buf = malloc(size);
 	if (buf == NULL)
 	{
+		free(map);
 		error("not enough memory\n");
 		return ENOMEM;
 	}
 	memset(buf, 0xff, (size_t)size);
 
-	if (options.verbose)
-	{
-		printf("FLASH write: image file <%s>\n",
-		       (const char *)file);
-	}
-
 	if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
-		adc = hcs12mcu_flash_read_address_nb;
+		adc = hcs12mcu_flash_write_address_nb;
 	else if (options.flash_addr == HCS12MEM_FLASH_ADDR_BANKED_LINEAR)
-		adc = hcs12mcu_flash_read_address_bl;
+		adc = hcs12mcu_flash_write_address_bl;
 	else if (options.flash_addr == HCS12MEM_FLASH_ADDR_BANKED_PPAGE)
-		adc = hcs12mcu_flash_read_address_bp;
+		adc = hcs12mcu_flash_write_address_bp;
 	else
 		adc = NULL;
 
-	entry = HCS12_FLASH_INVALID_ADDRESS;
-	ret = srec_read(
-		file,
-		info,
-		sizeof(info),
-		buf,
-		size,
-		&entry,
-		NULL,
-		&addr_min,
-		&addr_max,
-		adc
-		);
+	ret = srec_open(&out, name, "FLASH image", 0, size, adc,
+		!options.include_erased, options.srec_size);
 	if (ret != 0)
 	{
+		free(map);
 		free(buf);
 		return ret;
 	}
 
-	if (options.verbose)
+	/* blocks are read in address order, so each FLASH page is
+	   selected once; data is written to file as soon as page
+	   (or range) is complete */
+
+	cnt = 0;
+	p = 0;
+	q = 0;
+	t = progress_start("FLASH read: data");
+	for (i = 0; hcs12mcu_read_next(map, size, chunk, &i, &j); i = j)
 	{
-		char entry_address_str[10];
+		if (i != q)
+		{
+			ret = hcs12mcu_read_put(&out, buf, &p, q, i);
+			if (ret != 0)
+				goto fail;
+		}
 
-		if (entry != HCS12_FLASH_INVALID_ADDRESS)
+		ret = (*f)(i, buf + i, j - i);
+		if (ret != 0)
 		{
-			snprintf(entry_address_str, sizeof(entry_address_str), "0x%04X",
-				(unsigned int)entry);
+			srec_abort(&out);
+			goto fail;
 		}
-		else
+		q = j;
+
+		if ((q % HCS12_FLASH_PAGE_SIZE) == 0)
 		{
-			snprintf(entry_address_str, sizeof(entry_address_str), "unknown");
+			ret = hcs12mcu_read_put(&out, buf, &p, q, q);
+			if (ret != 0)
+				goto fail;
 		}
 
-		printf("FLASH write: image info <%s> entry <%s>\n",
-			(const char *)(info[0] != '\0' ? info : "unknown"),
-			(const char *)entry_address_str
-			);
+		cnt += j - i;
+		progress_report(cnt, len);
 	}
+	progress_stop(t, "FLASH read: data", len);
 
-	len = 0;
-	for (i = 0; i < size;)
-	{
-		pend = i - (i % HCS12_FLASH_PAGE_SIZE) +
-			HCS12_FLASH_PAGE_SIZE;
+	entry = ((uint32_t)buf[size - 2] << 8) + (uint32_t)buf[size - 1];
 
-		end = i + HCS12_FLASH_PAGE_SIZE;
-		if (end > pend)
-			end = pend;
+	ret = hcs12mcu_read_put(&out, buf, &p, q, q);
+	if (ret != 0)
+		goto fail;
+	ret = srec_close(&out, entry, SREC_ENTRY_MODE_RAW);
+	if (ret != 0)
+		goto fail;
 
-		for (; i < end; i += sizeof(uint32_t))
-		{
-			/* no endianness conversion required for 0xffffffff */
-			if (*((uint32_t *)(buf + i)) != 0xffffffff)
-				break;
-		}
-		if (i == end)
-			continue;
+	if (options.verbose)
+	{
+		printf("FLASH read: data file <%s> written\n",
+		       (const char *)name);
+	}
 
-		end = i + HCS12_FLASH_PAGE_SIZE;
-		if (end > pend)
-			end = pend;
+fail:
+	free(map);
+	free(buf);
+	return ret;
+}
 
-		for (j = i + sizeof(uint32_t); j < end; j += sizeof(uint32_t))
-		{
-			/* no endianness conversion required for 0xffffffff */
-			if (*((uint32_t *)(buf + j)) == 0xffffffff)
-				break;
-		}
 
-		if (options.verbose)
-		{
-			if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
-			{
-				printf("FLASH write: address range <0x%04X-0x%04X> size <0x%04X>\n",
-				       (unsigned int)(i + hcs12mcu_target.flash_nb_base),
-				       (unsigned int)(j - 1 + hcs12mcu_target.flash_nb_base),
-				       (unsigned int)(j - i));
-			}
-			else
-			{
-				printf("FLASH write: linear address range <0x%05X-0x%05X> size <0x%04X>\n",
-				       (unsigned int)(i + hcs12mcu_target.flash_linear_base),
-				       (unsigned int)(j - 1 + hcs12mcu_target.flash_linear_base),
-				       (unsigned int)(j - i));
-			}
-		}
+/*
+ *  check if FLASH image block is erased
+ *
+ *  in:
+ *    buf - image data, aligned to 4 bytes
+ *    size - block size, multiple of 4 bytes
+ *  out:
+ *    TRUE when all bytes are 0xff
+ */
 
-		len += j - i;
-		i = j;
-	}
+static int hcs12mcu_flash_blank(const uint8_t *buf, uint32_t size)
+{
+	uint32_t i;
 
-	cnt = 0;
-	t = progress_start("FLASH write: image");
-	for (i = 0; i < size;)
+	for (i = 0; i < size; i += sizeof(uint32_t))
 	{
-		pend = i - (i % hcs12mcu_target.flash_sector) +
-			hcs12mcu_target.flash_sector;
+		/* no endianness conversion required for 0xffffffff */
+		if (*((const uint32_t *)(buf + i)) != 0xffffffff)
+			return FALSE;
+	}
 
-		end = i + (uint32_t)chunk;
-		if (end > pend)
-			end = pend;
+	return TRUE;
+}
 
-		for (; i < end; i += sizeof(uint32_t))
-		{
-			/* no endianness conversion required for 0xffffffff */
-			if (*((uint32_t *)(buf + i)) != 0xffffffff)
-				break;
-		}
-		if (i == end)
-			continue;
 
-		end = i + (uint32_t)chunk;
-		if (end > pend)
+/*
+ *  merge image file data into FLASH image, data defined by several
+ *  files must be the same, unless conflict policy says which one wins
+ *
+ *  in:
+ *    file - image file name
+ *    buf - FLASH image
+ *    map - FLASH image byte map, set for data from previous files
+ *    data - image file data
+ *    fmap - image file byte map
+ *    size - image size
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12mcu_flash_image_merge(const char *file, uint8_t *buf,
+	uint8_t *map, const uint8_t *data, const uint8_t *fmap, uint32_t size)
+{
+	uint32_t base;
+	uint32_t first;
+	uint32_t cnt;
+	uint32_t i;
+
+	cnt = 0;
+	first = 0;
+	for (i = 0; i < size; ++ i)
+	{
+		if (!fmap[i])
+			continue;
+		if (map[i] && buf[i] != data[i])
+		{
+			if (cnt ++ == 0)
+				first = i;
+			if (options.merge == HCS12MEM_MERGE_FIRST)
+				continue;
+		}
+		buf[i] = data[i];
+		map[i] = 1;
+	}
+	if (cnt == 0)
+		return 0;
+
+	if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
+		base = hcs12mcu_target.flash_nb_base;
+	else
+		base = hcs12mcu_target.flash_linear_base;
+
+	if (options.merge == HCS12MEM_MERGE_ERROR)
+	{
+		error("image file %s conflicts with previous ones at <0x%05X> (%lu bytes)\n",
+			(const char *)file,
+			(unsigned int)(first + base),
+			(unsigned long)cnt);
+		return EINVAL;
+	}
+
+	printf("FLASH write: image file <%s> conflicts with previous ones at <0x%05X> (%lu bytes), %s data kept\n",
+	       (const char *)file,
+	       (unsigned int)(first + base),
+	       (unsigned long)cnt,
+	       (const char *)(options.merge == HCS12MEM_MERGE_FIRST ? "previous" : "its"));
+	return 0;
+}
+
+
+/*
+ *  update CRC-32 (IEEE 802.3) with data, table driven
+ *
+ *  in:
+ *    crc - CRC value so far (0 for start)
+ *    buf - data
+ *    size - data size
+ *  out:
+ *    CRC value
+ */
+
+static uint32_t hcs12mcu_crc32_update(uint32_t crc, const uint8_t *buf, uint32_t size)
+{
+	static uint32_t table[256];
+	static int table_init = FALSE;
+	uint32_t c;
+	uint32_t i;
+	int b;
+
+	if (!table_init)
+	{
+		for (i = 0; i < 256; ++ i)
+		{
+			c = i;
+			for (b = 0; b < 8; ++ b)
+				c = (c >> 1) ^ ((c & 1) ? 0xedb88320 : 0);
+			table[i] = c;
+		}
+		table_init = TRUE;
+	}
+
+	crc = ~crc;
+	for (i = 0; i < size; ++ i)
+		crc = (crc >> 8) ^ table[(crc ^ buf[i]) & 0xff];
+	return ~crc;
+}
+
+
+/*
+ *  compute CRC-32 (IEEE 802.3) of image data
+ *
+ *  in:
+ *    buf - data
+ *    size - data size
+ *  out:
+ *    CRC value
+ */
+
+static uint32_t hcs12mcu_crc32(const uint8_t *buf, uint32_t size)
+{
+	return hcs12mcu_crc32_update(0, buf, size);
+}
+
+
+/*
+ *  compute parsed image cache key - it covers contents of all image
+ *  files, target memory layout and options used for image translation;
+ *  names and sizes of image files are listed too, so that cache is
+ *  not taken on CRC match alone
+ *
+ *  in:
+ *    file - file name(s) with data for programming
+ *    key - cache key (on return)
+ *    files - image file list, one "file <size> <name>" line per file
+ *            (on return)
+ *    files_size - file list buffer size
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12mcu_cache_key(const char *file, uint32_t *key,
+	char *files, size_t files_size)
+{
+	sys_map_t m;
+	const char *name;
+	const char *next;
+	char fname[SYS_MAX_PATH + 1];
+	size_t n;
+	size_t k;
+	uint32_t layout[15];
+	uint8_t b[sizeof(layout)];
+	int i;
+	int ret;
+
+	*key = 0;
+	k = 0;
+	for (name = file;; name = next + 1)
+	{
+		next = strchr(name, HCS12MEM_IMAGE_SEPARATOR);
+		n = (next == NULL ? strlen(name) : (size_t)(next - name));
+		if (n > SYS_MAX_PATH)
+			n = SYS_MAX_PATH;
+		memcpy(fname, name, n);
+		fname[n] = '\0';
+
+		ret = sys_map_open(&m, fname);
+		if (ret != 0)
+			return ret;
+		*key = hcs12mcu_crc32_update(*key, m.data, (uint32_t)m.size);
+
+		/* file boundaries are part of the key */
+
+		for (i = 0; i < 4; ++ i)
+			b[i] = (uint8_t)((uint32_t)m.size >> (24 - i * 8));
+		*key = hcs12mcu_crc32_update(*key, b, 4);
+		n = (size_t)snprintf(files + k, files_size - k, "file %lX %s\n",
+			(unsigned long)m.size, (const char *)fname);
+		sys_map_close(&m);
+		if (n >= files_size - k)
+			return ENAMETOOLONG;
+		k += n;
+
+		if (next == NULL)
+			break;
+	}
+
+	layout[0] = hcs12mcu_target.flash_size;
+	layout[1] = hcs12mcu_target.flash_sector;
+	layout[2] = hcs12mcu_target.flash_phrase;
+	layout[3] = hcs12mcu_target.flash_nb_base;
+	layout[4] = hcs12mcu_target.flash_nb_size;
+	layout[5] = hcs12mcu_target.flash_linear_base;
+	layout[6] = hcs12mcu_target.flash_block_size;
+	layout[7] = (uint32_t)hcs12mcu_target.flash_blocks;
+	layout[8] = hcs12mcu_target.ppage_base;
+	layout[9] = hcs12mcu_target.ppage_count;
+	layout[10] = hcs12mcu_target.ppage_default;
+	layout[11] = (uint32_t)options.flash_addr;
+	layout[12] = (uint32_t)options.merge;
+	layout[13] = (uint32_t)options.binary_base;
+	layout[14] = (uint32_t)options.binary_base_valid;
+
+	/* stored MSB first, so that key does not depend on host */
+
+	for (n = 0; n < sizeof(layout) / sizeof(layout[0]); ++ n)
+	{
+		for (i = 0; i < 4; ++ i)
+			b[n * 4 + i] = (uint8_t)(layout[n] >> (24 - i * 8));
+	}
+	*key = hcs12mcu_crc32_update(*key, b, sizeof(b));
+	return 0;
+}
+
+
+/*
+ *  read parsed image from cache, if it was made for the same key and
+ *  image files - image buffer is left erased (0xff) when cache is not
+ *  used
+ *
+ *  in:
+ *    key - cache key
+ *    files - image file list
+ *    buf - image buffer
+ *    size - image size
+ *    len - size of data to program (on return)
+ *  out:
+ *    TRUE - image read from cache, FALSE - no usable cache
+ */
+
+static int hcs12mcu_cache_read(uint32_t key, const char *files,
+	uint8_t *buf, uint32_t size, uint32_t *len)
+{
+	FILE *f;
+	char file[SYS_MAX_PATH + 1];
+	char line[SYS_MAX_PATH + 32];
+	const char *p;
+	unsigned long v;
+	size_t n;
+	int match;
+
+	hcs12mem_state_file(file, sizeof(file), "img");
+	f = fopen(file, "rb");
+	if (f == NULL)
+		return FALSE;
+
+	/* file lines must repeat image file list exactly, in order */
+
+	match = 0;
+	p = files;
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		if (strncmp(line, "file ", 5) == 0)
+		{
+			n = strlen(line);
+			if (p == NULL || strncmp(p, line, n) != 0)
+				p = NULL;
+			else
+				p += n;
+		}
+		else if (sscanf(line, "key %lx", &v) == 1)
+		{
+			if (v == (unsigned long)key)
+				++ match;
+		}
+		else if (sscanf(line, "size %lx", &v) == 1)
+		{
+			if (v == (unsigned long)size)
+				++ match;
+		}
+		else if (sscanf(line, "len %lx", &v) == 1)
+		{
+			*len = (uint32_t)v;
+		}
+		else if (strcmp(line, "image\n") == 0)
+			break;
+	}
+
+	/* image data follows header, short file is not used */
+
+	if (match != 2 || p == NULL || *p != '\0' ||
+	    fread(buf, 1, size, f) != size)
+	{
+		fclose(f);
+		memset(buf, 0xff, (size_t)size);
+		if (options.verbose)
+		{
+			printf("FLASH write: image cache <%s> does not match image or target\n",
+			       (const char *)file);
+		}
+		return FALSE;
+	}
+	fclose(f);
+
+	if (options.verbose)
+	{
+		printf("FLASH write: image read from cache <%s>\n",
+		       (const char *)file);
+	}
+	return TRUE;
+}
+
+
+/*
+ *  store parsed image in cache, failure is reported but does not
+ *  stop FLASH write
+ *
+ *  in:
+ *    key - cache key
+ *    files - image file list
+ *    buf - image data
+ *    size - image size
+ *    len - size of data to program
+ *  out:
+ *    void
+ */
+
+static void hcs12mcu_cache_write(uint32_t key, const char *files,
+	const uint8_t *buf, uint32_t size, uint32_t len)
+{
+	FILE *f;
+	char file[SYS_MAX_PATH + 1];
+	int ok;
+
+	hcs12mem_state_file(file, sizeof(file), "img");
+	f = fopen(file, "wb");
+	if (f == NULL)
+	{
+		printf("FLASH write: unable to create image cache <%s>: %s\n",
+		       (const char *)file, (const char *)strerror(errno));
+		return;
+	}
+
+	fprintf(f, "key %08lX\n", (unsigned long)key);
+	fputs(files, f);
+	fprintf(f, "size %lX\n", (unsigned long)size);
+	fprintf(f, "len %lX\n", (unsigned long)len);
+	fprintf(f, "image\n");
+	ok = (fwrite(buf, 1, size, f) == size);
+	if (fclose(f) != 0 || !ok)
+	{
+		printf("FLASH write: unable to write image cache <%s>\n",
+		       (const char *)file);
+		remove(file);
+		return;
+	}
+
+	if (options.verbose)
+	{
+		printf("FLASH write: image stored in cache <%s>\n",
+		       (const char *)file);
+	}
+}
+
+
+/*
+ *  apply per-device patch to FLASH image and note touched sectors
+ *
+ *  in:
+ *    buf - image data
+ *    size - image size
+ *    unit - planning unit
+ *    adc - address translation callback
+ *    len - size of data to program (updated on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12mcu_flash_image_patch(uint8_t *buf, uint32_t size, uint32_t unit,
+	uint32_t (*adc)(uint32_t addr), uint32_t *len)
+{
+	uint8_t *map;
+	uint32_t i;
+	uint32_t n;
+	int ret;
+
+	free(hcs12mcu_patch_sectors);
+	hcs12mcu_patch_sectors = NULL;
+
+	if (options.patch == NULL)
+		return 0;
+
+	map = calloc(1, size);
+	hcs12mcu_patch_sectors = calloc(1, size / hcs12mcu_target.flash_sector);
+	if (map == NULL || hcs12mcu_patch_sectors == NULL)
+	{
+		error("not enough memory\n");
+		free(map);
+		return ENOMEM;
+	}
+
+	ret = patch_apply(options.patch, buf, size, adc, map);
+	if (ret != 0)
+	{
+		free(map);
+		return ret;
+	}
+
+	n = 0;
+	for (i = 0; i < size; ++ i)
+	{
+		if (map[i] && !hcs12mcu_patch_sectors[i / hcs12mcu_target.flash_sector])
+		{
+			hcs12mcu_patch_sectors[i / hcs12mcu_target.flash_sector] = 1;
+			++ n;
+		}
+	}
+	free(map);
+
+	if (options.verbose)
+	{
+		printf("FLASH write: patch touches <%lu> sectors\n",
+		       (unsigned long)n);
+	}
+
+	/* patch may have filled blank units */
+
+	*len = 0;
+	for (i = 0; i < size; i += unit)
+	{
+		if (!hcs12mcu_flash_blank(buf + i, unit))
+			*len += unit;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  load FLASH image for writing
+ *
+ *  in:
+ *    file - file name with data for programming, several comma
+ *           separated file names are merged into one image
+ *    chunk - write chunk size
+ *    image - image buffer (on return), to be freed by caller
+ *    size - image buffer size (on return)
+ *    unit - planning unit (on return)
+ *    len - size of data to program (on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12mcu_flash_image_load(const char *file, size_t chunk,
+	uint8_t **image, uint32_t *size, uint32_t *unit, uint32_t *len)
+{
+	uint32_t (*adc)(uint32_t addr);
+	uint8_t *buf;
+	uint8_t *map;
+	uint8_t *data;
+	uint8_t *fmap;
+	const char *name;
+	const char *next;
+	char fname[SYS_MAX_PATH + 1];
+	size_t n;
+	char info[256];
+	uint32_t entry;
+	uint32_t addr_min;
+	uint32_t addr_max;
+	uint32_t i, j;
+	uint32_t end;
+	uint32_t pend;
+	uint32_t key;
+	char files[4 * SYS_MAX_PATH];
+	int key_valid;
+	int ret;
+
+	if (hcs12mcu_target.flash_size == 0)
+	{
+		error("FLASH write not possible - no FLASH memory\n");
+		return EINVAL;
+	}
+
+	if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
+		*size = hcs12mcu_target.flash_nb_size;
+	else
+		*size = hcs12mcu_target.flash_size;
+
+	/* image is planned in programming units (phrases for FTX modules),
+	   so that no written block starts or ends within a phrase */
+
+	*unit = hcs12mcu_target.flash_phrase;
+	if (*unit < sizeof(uint32_t))
+		*unit = sizeof(uint32_t);
+
+	if (chunk < 2 || (chunk % *unit) != 0 || (*size % chunk) != 0 ||
+	    chunk > hcs12mcu_target.flash_sector)
+	{
+		error("invalid chunk size for FLASH write: %u\n",
+		      (unsigned int)chunk);
+		return EINVAL;
+	}
+
+	buf = malloc(*size);
+	if (buf == NULL)
+	{
+		error("not enough memory\n");
+		return ENOMEM;
+	}
+	memset(buf, 0xff, (size_t)*size);
+
+	if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
+		adc = hcs12mcu_flash_read_address_nb;
+	else if (options.flash_addr == HCS12MEM_FLASH_ADDR_BANKED_LINEAR)
+		adc = hcs12mcu_flash_read_address_bl;
+	else if (options.flash_addr == HCS12MEM_FLASH_ADDR_BANKED_PPAGE)
+		adc = hcs12mcu_flash_read_address_bp;
+	else
+		adc = NULL;
+
+	/* parsed image is reused when input files, target and options
+	   are the same as in earlier run */
+
+	key_valid = FALSE;
+	if (options.image_cache)
+	{
+		key_valid = (hcs12mcu_cache_key(file, &key, files, sizeof(files)) == 0);
+		if (key_valid && hcs12mcu_cache_read(key, files, buf, *size, len))
+			goto patch;
+	}
+
+	/* several image files are merged into one image */
+
+	map = NULL;
+	data = NULL;
+	fmap = NULL;
+	if (strchr(file, HCS12MEM_IMAGE_SEPARATOR) != NULL)
+	{
+		map = calloc(1, *size);
+		data = malloc(*size);
+		fmap = malloc(*size);
+		if (map == NULL || data == NULL || fmap == NULL)
+		{
+			error("not enough memory\n");
+			ret = ENOMEM;
+			goto fail;
+		}
+	}
+
+	for (name = file;; name = next + 1)
+	{
+		next = strchr(name, HCS12MEM_IMAGE_SEPARATOR);
+		n = (next == NULL ? strlen(name) : (size_t)(next - name));
+		if (n > SYS_MAX_PATH)
+			n = SYS_MAX_PATH;
+		memcpy(fname, name, n);
+		fname[n] = '\0';
+
+		if (options.verbose)
+		{
+			printf("FLASH write: image file <%s>\n",
+			       (const char *)fname);
+		}
+
+		entry = HCS12_FLASH_INVALID_ADDRESS;
+		if (map == NULL)
+		{
+			ret = image_read(
+				fname,
+				info,
+				sizeof(info),
+				buf,
+				*size,
+				&entry,
+				NULL,
+				&addr_min,
+				&addr_max,
+				adc
+				);
+		}
+		else
+		{
+			memset(data, 0xff, (size_t)*size);
+			memset(fmap, 0, (size_t)*size);
+			ret = image_read_map(
+				fname,
+				info,
+				sizeof(info),
+				data,
+				*size,
+				&entry,
+				NULL,
+				&addr_min,
+				&addr_max,
+				adc,
+				fmap
+				);
+			if (ret == 0)
+				ret = hcs12mcu_flash_image_merge(fname, buf, map, data, fmap, *size);
+		}
+		if (ret != 0)
+			goto fail;
+
+		if (options.verbose)
+		{
+			char entry_address_str[10];
+
+			if (entry != HCS12_FLASH_INVALID_ADDRESS)
+			{
+				snprintf(entry_address_str, sizeof(entry_address_str), "0x%04X",
+					(unsigned int)entry);
+			}
+			else
+			{
+				snprintf(entry_address_str, sizeof(entry_address_str), "unknown");
+			}
+
+			printf("FLASH write: image info <%s> entry <%s>\n",
+				(const char *)(info[0] != '\0' ? info : "unknown"),
+				(const char *)entry_address_str
+				);
+		}
+
+		if (next == NULL)
+			break;
+	}
+
+	free(map);
+	free(data);
+	free(fmap);
+
+	*len = 0;
+	for (i = 0; i < *size;)
+	{
+		pend = i - (i % HCS12_FLASH_PAGE_SIZE) +
+			HCS12_FLASH_PAGE_SIZE;
+
+		end = i + HCS12_FLASH_PAGE_SIZE;
+		if (end > pend)
+			end = pend;
+
+		for (; i < end; i += *unit)
+		{
+			if (!hcs12mcu_flash_blank(buf + i, *unit))
+				break;
+		}
+		if (i == end)
+			continue;
+
+		end = i + HCS12_FLASH_PAGE_SIZE;
+		if (end > pend)
+			end = pend;
+
+		for (j = i + *unit; j < end; j += *unit)
+		{
+			if (hcs12mcu_flash_blank(buf + j, *unit))
+				break;
+		}
+
+		if (options.verbose)
+		{
+			if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
+			{
+				printf("FLASH write: address range <0x%04X-0x%04X> size <0x%04X>\n",
+				       (unsigned int)(i + hcs12mcu_target.flash_nb_base),
+				       (unsigned int)(j - 1 + hcs12mcu_target.flash_nb_base),
+				       (unsigned int)(j - i));
+			}
+			else
+			{
+				printf("FLASH write: linear address range <0x%05X-0x%05X> size <0x%04X>\n",
+				       (unsigned int)(i + hcs12mcu_target.flash_linear_base),
+				       (unsigned int)(j - 1 + hcs12mcu_target.flash_linear_base),
+				       (unsigned int)(j - i));
+			}
+		}
+
+		*len += j - i;
+		i = j;
+	}
+
+	if (key_valid)
+		hcs12mcu_cache_write(key, files, buf, *size, *len);
+
+	/* patch is applied to base image, cached image stays the same
+	   for all devices */
+
+patch:
+	ret = hcs12mcu_flash_image_patch(buf, *size, *unit, adc, len);
+	if (ret != 0)
+	{
+		free(buf);
+		return ret;
+	}
+
+	*image = buf;
+	return 0;
+
+fail:
+	free(map);
+	free(data);
+	free(fmap);
+	free(buf);
+	return ret;
+}
+
+
+/*
+ *  set FLASH write cost model for following writes, target description
+ *  may override interface defaults
+ *
+ *  in:
+ *    overhead - cost of single write callback, microseconds
+ *    rate - data transfer rate, bytes per second
+ *    word - program time per word, microseconds
+ *  out:
+ *    status code (errno-like)
+ */
+
+int hcs12mcu_flash_cost(uint32_t overhead, uint32_t rate, uint32_t word)
+{
+	int ret;
+
+	ret = hcs12mem_target_param("flash_cost_overhead", &hcs12mcu_cost.overhead, overhead);
+	if (ret != 0)
+		return ret;
+	ret = hcs12mem_target_param("flash_cost_rate", &hcs12mcu_cost.rate, rate);
+	if (ret != 0)
+		return ret;
+	return hcs12mem_target_param("flash_cost_word", &hcs12mcu_cost.word, word);
+}
+
+
+/*
+ *  check if programming blank gap is cheaper than starting new extent
+ *
+ *  in:
+ *    gap - gap size
+ *  out:
+ *    TRUE when gap should be programmed
+ */
+
+static int hcs12mcu_flash_gap_cheap(uint32_t gap)
+{
+	double us;
+
+	if (hcs12mcu_cost.overhead == 0 || hcs12mcu_cost.rate == 0)
+		return FALSE;
+
+	us = (double)gap * 1000000.0 / (double)hcs12mcu_cost.rate +
+		(double)(gap / 2) * (double)hcs12mcu_cost.word;
+	return us < (double)hcs12mcu_cost.overhead;
+}
+
+
+/*
+ *  find next FLASH image extent to write - non-blank data, not longer
+ *  than chunk size and not crossing sector boundary, short blank gaps
+ *  are merged according to cost model
+ *
+ *  in:
+ *    buf - image data
+ *    size - image size
+ *    chunk - write chunk size
+ *    unit - planning unit
+ *    addr - search start address (on entry), extent start (on return)
+ *    next - extent end (on return)
+ *  out:
+ *    FALSE when there is no more data to write
+ */
+
+static int hcs12mcu_flash_next_extent(const uint8_t *buf, uint32_t size,
+	size_t chunk, uint32_t unit, uint32_t *addr, uint32_t *next)
+{
+	uint32_t i, j, k;
+	uint32_t end;
+	uint32_t pend;
+
+	for (i = *addr; i < size;)
+	{
+		pend = i - (i % hcs12mcu_target.flash_sector) +
+			hcs12mcu_target.flash_sector;
+
+		end = i + (uint32_t)chunk;
+		if (end > pend)
 			end = pend;
 
-		for (j = i + sizeof(uint32_t); j < end; j += sizeof(uint32_t))
+		for (; i < end; i += unit)
+		{
+			if (!hcs12mcu_flash_blank(buf + i, unit))
+				break;
+		}
+		if (i == end)
+			continue;
+
+		end = i + (uint32_t)chunk;
+		if (end > pend)
+			end = pend;
+
+		for (j = i + unit; j < end; j += unit)
+		{
+			if (!hcs12mcu_flash_blank(buf + j, unit))
+				continue;
+
+			/* blank gap is programmed too, when data follows within
+			   the chunk and it costs less than another callback */
+
+			for (k = j + unit; k < end; k += unit)
+			{
+				if (!hcs12mcu_flash_blank(buf + k, unit))
+					break;
+			}
+			if (k == end || !hcs12mcu_flash_gap_cheap(k - j))
+				break;
+			j = k;
+		}
+
+		*addr = i;
+		*next = j;
+		return TRUE;
+	}
+
+	*addr = size;
+	return FALSE;
+}
+
+
+/*
+ *  show FLASH write plan - extents as they will be passed to callback
+ *
+ *  in:
+ *    buf - image data
+ *    size - image size
+ *    chunk - write chunk size
+ *    unit - planning unit
+ *    len - size of non-blank data to program
+ *    total - size of data to program, with merged gaps (on return)
+ *  out:
+ *    void
+ */
+
+static void hcs12mcu_flash_plan(const uint8_t *buf, uint32_t size,
+	size_t chunk, uint32_t unit, uint32_t len, uint32_t *total)
+{
+	uint32_t i, j;
+	uint32_t base;
+	uint32_t cnt;
+	double us;
+
+	if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
+		base = hcs12mcu_target.flash_nb_base;
+	else
+		base = hcs12mcu_target.flash_linear_base;
+
+	cnt = 0;
+	*total = 0;
+	for (i = 0; hcs12mcu_flash_next_extent(buf, size, chunk, unit, &i, &j); i = j)
+	{
+		if (options.debug)
+		{
+			printf("FLASH write: plan <0x%05X-0x%05X> size <0x%04X>\n",
+			       (unsigned int)(i + base),
+			       (unsigned int)(j - 1 + base),
+			       (unsigned int)(j - i));
+		}
+		++ cnt;
+		*total += j - i;
+	}
+
+	if (options.verbose)
+	{
+		printf("FLASH write: plan <%lu> commands, <%lu> gap bytes merged",
+		       (unsigned long)cnt,
+		       (unsigned long)(*total - len));
+		if (hcs12mcu_cost.rate != 0)
+		{
+			us = (double)cnt * (double)hcs12mcu_cost.overhead +
+				(double)*total * 1000000.0 / (double)hcs12mcu_cost.rate +
+				(double)(*total / 2) * (double)hcs12mcu_cost.word;
+			printf(", estimated time <%lu ms>", (unsigned long)(us / 1000.0));
+		}
+		printf("\n");
+	}
+}
+
+
+/*
+ *  set FLASH read callback used to check FLASH contents when
+ *  interrupted write is resumed
+ *
+ *  in:
+ *    f - FLASH read callback, NULL when FLASH can't be read back
+ *  out:
+ *    void
+ */
+
+void hcs12mcu_flash_readback(int (*f)(uint32_t addr, void *buf, size_t size))
+{
+	hcs12mcu_readback = f;
+}
+
+
+/*
+ *  read FLASH write journal left by interrupted write, when resume
+ *  was requested - journal is used only if it was made for the same
+ *  image and target
+ *
+ *  in:
+ *    buf - image data
+ *    size - image size
+ *    streams - number of write streams
+ *  out:
+ *    void
+ */
+
+static void hcs12mcu_journal_read(const uint8_t *buf, uint32_t size, int streams)
+{
+	FILE *f;
+	char line[128];
+	unsigned long v;
+	int n;
+	int match;
+
+	memset(hcs12mcu_journal.mark, 0, sizeof(hcs12mcu_journal.mark));
+	hcs12mem_state_file(hcs12mcu_journal.file,
+		sizeof(hcs12mcu_journal.file), "jnl");
+	if (!options.resume)
+		return;
+
+	f = fopen(hcs12mcu_journal.file, "rt");
+	if (f == NULL)
+	{
+		printf("FLASH write: no journal <%s>, writing whole image\n",
+		       (const char *)hcs12mcu_journal.file);
+		return;
+	}
+
+	match = 0;
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		if (sscanf(line, "image %lx", &v) == 1)
+		{
+			if (v == (unsigned long)hcs12mcu_crc32(buf, size))
+				++ match;
+		}
+		else if (sscanf(line, "size %lx", &v) == 1)
+		{
+			if (v == (unsigned long)size)
+				++ match;
+		}
+		else if (sscanf(line, "partid %lx", &v) == 1)
+		{
+			if (v == (unsigned long)hcs12mcu_target.partid)
+				++ match;
+		}
+		else if (sscanf(line, "streams %d", &n) == 1)
+		{
+			if (n == streams)
+				++ match;
+		}
+		else if (sscanf(line, "done %d %lx", &n, &v) == 2)
+		{
+			if (n >= 0 && n < streams && v <= (unsigned long)size)
+				hcs12mcu_journal.mark[n] = (uint32_t)v;
+		}
+	}
+	fclose(f);
+
+	if (match != 4)
+	{
+		printf("FLASH write: journal does not match image or target, writing whole image\n");
+		memset(hcs12mcu_journal.mark, 0, sizeof(hcs12mcu_journal.mark));
+	}
+}
+
+
+/*
+ *  check FLASH contents at the point where interrupted write stopped -
+ *  extents recorded as written but found blank (e.g. FLASH was erased
+ *  in the meantime) are written again, extents programmed but not yet
+ *  recorded are skipped, extent which was being written is continued
+ *  after its already programmed part
+ *
+ *  in:
+ *    buf - image data
+ *    chunk - write chunk size
+ *    unit - planning unit
+ *    stream - write stream
+ *    lo - stream start
+ *    hi - stream end
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12mcu_journal_resume(const uint8_t *buf, size_t chunk,
+	uint32_t unit, int stream, uint32_t lo, uint32_t hi)
+{
+	uint32_t *ext;
+	uint8_t *tmp;
+	uint32_t mark;
+	uint32_t base;
+	uint32_t i, j, e;
+	uint32_t n, k;
+	int ret;
+
+	mark = hcs12mcu_journal.mark[stream];
+	if (mark <= lo || hcs12mcu_readback == NULL)
+		return 0;
+
+	if (options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
+		base = hcs12mcu_target.flash_nb_base;
+	else
+		base = hcs12mcu_target.flash_linear_base;
+
+	n = 0;
+	for (i = lo; hcs12mcu_flash_next_extent(buf, hi, chunk, unit, &i, &j); i = j)
+		++ n;
+
+	ext = malloc((n + 1) * 2 * sizeof(uint32_t));
+	tmp = malloc(chunk);
+	if (ext == NULL || tmp == NULL)
+	{
+		free(ext);
+		free(tmp);
+		error("not enough memory\n");
+		return ENOMEM;
+	}
+
+	/* k - number of extents started before the mark */
+
+	n = 0;
+	k = 0;
+	for (i = lo; hcs12mcu_flash_next_extent(buf, hi, chunk, unit, &i, &j); i = j)
+	{
+		ext[n * 2] = i;
+		ext[n * 2 + 1] = j;
+		++ n;
+		if (i < mark)
+			k = n;
+	}
+
+	/* last written extent must match image, when it is blank
+	   the mark goes back to previous one */
+
+	ret = 0;
+	for (; k > 0; -- k)
+	{
+		i = ext[(k - 1) * 2];
+		e = ext[(k - 1) * 2 + 1];
+		if (e > mark)
+			e = mark;
+
+		ret = (*hcs12mcu_readback)(i, tmp, e - i);
+		if (ret != 0)
+			goto done;
+
+		if (hcs12mcu_flash_blank(tmp, e - i))
+		{
+			mark = i;
+			continue;
+		}
+		if (memcmp(tmp, buf + i, e - i) != 0)
+		{
+			error("FLASH contents at <0x%05X> differ from image, erase FLASH before writing\n",
+				(unsigned int)(i + base));
+			ret = EIO;
+			goto done;
+		}
+		break;
+	}
+
+	/* extents following the mark may be already written (when writes
+	   are recorded after several of them are programmed) - fully
+	   programmed ones are skipped, so is programmed part of the
+	   first one which is not, its rest must be blank */
+
+	for (k = 0; k < n && ext[k * 2 + 1] <= mark; ++ k)
+		;
+	for (; k < n; ++ k)
+	{
+		i = (ext[k * 2] > mark ? ext[k * 2] : mark);
+		j = ext[k * 2 + 1];
+
+		ret = (*hcs12mcu_readback)(i, tmp, j - i);
+		if (ret != 0)
+			goto done;
+
+		/* programmed part is found in programming units (words or
+		   phrases) - interrupted write may stop within planning unit */
+
+		for (e = 0; e < j - i && memcmp(tmp + e, buf + i + e, hcs12mcu_target.flash_phrase) == 0;
+		     e += hcs12mcu_target.flash_phrase)
+			;
+		if (e == j - i)
+		{
+			mark = j;
+			continue;
+		}
+		if (!hcs12mcu_flash_blank(tmp + e, j - i - e))
+		{
+			error("FLASH contents at <0x%05X> differ from image, erase FLASH before writing\n",
+				(unsigned int)(i + e + base));
+			ret = EIO;
+			goto done;
+		}
+		if (e != 0)
+			mark = i + e;
+		break;
+	}
+
+	if (options.verbose)
+	{
+		printf("FLASH write: resuming stream <%d> at <0x%05X>\n",
+		       stream, (unsigned int)(mark + base));
+	}
+	hcs12mcu_journal.mark[stream] = mark;
+
+done:
+	free(ext);
+	free(tmp);
+	return ret;
+}
+
+
+/*
+ *  create FLASH write journal, with marks left by resumed write
+ *  (journal is not essential, so failure to create it is not an error)
+ *
+ *  in:
+ *    buf - image data
+ *    size - image size
+ *    streams - number of write streams
+ *  out:
+ *    void
+ */
+
+static void hcs12mcu_journal_create(const uint8_t *buf, uint32_t size, int streams)
+{
+	int n;
+
+	hcs12mcu_journal.f = fopen(hcs12mcu_journal.file, "wt");
+	if (hcs12mcu_journal.f == NULL)
+	{
+		if (options.verbose)
 		{
-			/* no endianness conversion required for 0xffffffff */
-			if (*((uint32_t *)(buf + j)) == 0xffffffff)
-				break;
+			printf("FLASH write: can't create journal <%s>\n",
+			       (const char *)hcs12mcu_journal.file);
+		}
+		return;
+	}
+
+	fprintf(hcs12mcu_journal.f, "image %08lx\n",
+		(unsigned long)hcs12mcu_crc32(buf, size));
+	fprintf(hcs12mcu_journal.f, "size %lx\n", (unsigned long)size);
+	fprintf(hcs12mcu_journal.f, "partid %04x\n",
+		(unsigned int)hcs12mcu_target.partid);
+	fprintf(hcs12mcu_journal.f, "streams %d\n", streams);
+	for (n = 0; n < streams; ++ n)
+	{
+		if (hcs12mcu_journal.mark[n] != 0)
+		{
+			fprintf(hcs12mcu_journal.f, "done %d %lx\n", n,
+				(unsigned long)hcs12mcu_journal.mark[n]);
+		}
+	}
+	fflush(hcs12mcu_journal.f);
+}
+
+
+/*
+ *  record extent confirmed written in FLASH write journal
+ *
+ *  in:
+ *    stream - write stream
+ *    end - extent end
+ *  out:
+ *    void
+ */
+
+static void hcs12mcu_journal_mark(int stream, uint32_t end)
+{
+	hcs12mcu_journal.mark[stream] = end;
+	if (hcs12mcu_journal.f == NULL)
+		return;
+
+	fprintf(hcs12mcu_journal.f, "done %d %lx\n", stream, (unsigned long)end);
+	fflush(hcs12mcu_journal.f);
+}
+
+
+/*
+ *  close FLASH write journal - it is removed when write completed,
+ *  otherwise it is kept for resume
+ *
+ *  in:
+ *    ret - FLASH write status
+ *  out:
+ *    void
+ */
+
+static void hcs12mcu_journal_close(int ret)
+{
+	if (hcs12mcu_journal.f == NULL)
+		return;
+
+	fclose(hcs12mcu_journal.f);
+	hcs12mcu_journal.f = NULL;
+
+	if (ret == 0)
+		remove(hcs12mcu_journal.file);
+	else
+		printf("FLASH write: interrupted, journal kept in <%s>, use -J option to resume\n",
+		       (const char *)hcs12mcu_journal.file);
+}
+
+
+/*
+ *  set up deferred programming for next FLASH write - write callback
+ *  may only queue data, which is programmed later by the callback itself
+ *  or by flush callback called after last extent; journal is removed
+ *  only when flush succeeds
+ *
+ *  in:
+ *    f - flush callback, programming all data queued so far
+ *  out:
+ *    void
+ */
+
+void hcs12mcu_flash_defer(int (*f)(void))
+{
+	hcs12mcu_defer.flush = f;
+}
+
+
+/*
+ *  confirm that data queued by deferred FLASH write callback so far
+ *  has been programmed - it is recorded in journal and progress
+ *
+ *  in:
+ *    void
+ *  out:
+ *    void
+ */
+
+void hcs12mcu_flash_confirm(void)
+{
+	if (hcs12mcu_defer.pending == 0)
+		return;
+
+	hcs12mcu_journal_mark(0, hcs12mcu_defer.end);
+	hcs12mcu_defer.cnt += hcs12mcu_defer.pending;
+	hcs12mcu_defer.pending = 0;
+	progress_report(hcs12mcu_defer.cnt, hcs12mcu_defer.len);
+}
+
+
+/*
+ *  write target FLASH
+ *
+ *  in:
+ *    file - file name with data for programming
+ *    chunk - write chunk size
+ *    f - FLASH write callback
+ *  out:
+ *    status code (errno-like)
+ */
+
+int hcs12mcu_flash_write(const char *file, size_t chunk,
+	int (*f)(uint32_t addr, const void *buf, size_t size))
+{
+	int (*flush)(void);
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t unit;
+	uint32_t len;
+	uint32_t i, j;
+	unsigned long t;
+	int ret;
+
+	flush = hcs12mcu_defer.flush;
+	hcs12mcu_defer.flush = NULL;
+
+	ret = hcs12mcu_flash_image_load(file, chunk, &buf, &size, &unit, &len);
+	if (ret != 0)
+		return ret;
+
+	hcs12mcu_flash_plan(buf, size, chunk, unit, len, &len);
+
+	hcs12mcu_journal_read(buf, size, 1);
+	ret = hcs12mcu_journal_resume(buf, chunk, unit, 0, 0, size);
+	if (ret != 0)
+	{
+		free(buf);
+		return ret;
+	}
+	hcs12mcu_journal_create(buf, size, 1);
+
+	hcs12mcu_defer.cnt = 0;
+	hcs12mcu_defer.len = len;
+	hcs12mcu_defer.pending = 0;
+	t = progress_start("FLASH write: image");
+	for (i = 0; hcs12mcu_flash_next_extent(buf, size, chunk, unit, &i, &j); i = j)
+	{
+		/* skip data written before interruption */
+
+		if (i < hcs12mcu_journal.mark[0])
+		{
+			hcs12mcu_defer.cnt += (j < hcs12mcu_journal.mark[0] ? j : hcs12mcu_journal.mark[0]) - i;
+			if (j <= hcs12mcu_journal.mark[0])
+				continue;
+			i = hcs12mcu_journal.mark[0];
+		}
+
+		ret = (*f)(i, buf + i, j - i);
+		if (ret != 0)
+			goto done;
+
+		hcs12mcu_defer.end = j;
+		hcs12mcu_defer.pending += j - i;
+		if (flush == NULL)
+			hcs12mcu_flash_confirm();
+	}
+
+	/* deferred data is programmed before write counts as completed */
+
+	if (flush != NULL)
+	{
+		ret = (*flush)();
+		if (ret != 0)
+			goto done;
+		hcs12mcu_flash_confirm();
+	}
+	progress_stop(t, "FLASH write: image", len);
+
+done:
+	hcs12mcu_journal_close(ret);
+	free(buf);
+	return ret;
+}
+
+
+/*
+ *  update target FLASH - erase sectors containing image data and write
+ *  them, erasure of next sector is started before current sector is
+ *  written, so that it runs while data is transferred
+ *
+ *  in:
+ *    file - file name with data for programming
+ *    chunk - write chunk size
+ *    erase - sector erase callback, wait flag set when erase must be
+ *            completed on return, otherwise erase is only started
+ *    f - FLASH write callback
+ *  out:
+ *    status code (errno-like)
+ */
+
+int hcs12mcu_flash_update(const char *file, size_t chunk,
+	int (*erase)(uint32_t addr, int wait),
+	int (*f)(uint32_t addr, const void *buf, size_t size))
+{
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t unit;
+	uint32_t len;
+	uint32_t i, j, k, n;
+	uint32_t sector;
+	uint32_t started;
+	uint32_t cnt;
+	uint32_t sectors;
+	uint32_t fsec;
+	unsigned long t;
+	uint8_t v;
+	int ret;
+
+	ret = hcs12mcu_flash_image_load(file, chunk, &buf, &size, &unit, &len);
+	if (ret != 0)
+		return ret;
+
+	/* with patched image, device is taken to hold base image already -
+	   only sectors touched by patch are erased and written */
+
+	if (hcs12mcu_patch_sectors != NULL)
+	{
+		len = 0;
+		for (i = 0; i < size; i += unit)
+		{
+			if (!hcs12mcu_patch_sectors[i / hcs12mcu_target.flash_sector])
+				memset(buf + i, 0xff, (size_t)unit);
+			else if (!hcs12mcu_flash_blank(buf + i, unit))
+				len += unit;
+		}
+	}
+
+	/* erasure of sector holding security byte would leave part secured
+	   after reset - it is erased only when forced, and security byte
+	   not given by image is programmed back (unsecured, when part was
+	   not unsecured by its own security byte) */
+
+	fsec = size - HCS12_FLASH_PAGE_SIZE + (HCS12_FLASH_FSEC - HCS12_FLASH_PAGE_3F_ADDR);
+	sector = fsec - (fsec % hcs12mcu_target.flash_sector);
+	if (!hcs12mcu_flash_blank(buf + sector, hcs12mcu_target.flash_sector))
+	{
+		if (!options.force)
+		{
+			error("FLASH update: sector with security byte would be erased (-f option forces the operation)\n");
+			free(buf);
+			return EIO;
+		}
+
+		if (buf[fsec] == 0xff)
+		{
+			ret = (*hcs12mcu_target.read_byte)(HCS12_IO_FSEC, &v);
+			if (ret != 0)
+			{
+				free(buf);
+				return ret;
+			}
+			if (!hcs12mcu_target.fsec_unsecured)
+				v = (uint8_t)((v & ~HCS12_FLASH_FSEC_SEC) | 0x02);
+
+			if (hcs12mcu_flash_blank(buf + fsec - (fsec % unit), unit))
+				len += unit;
+			buf[fsec] = v;
+
+			if (options.verbose)
+				printf("FLASH update: security byte <0x%02X> programmed back\n", (unsigned int)v);
+		}
+	}
+
+	hcs12mcu_flash_plan(buf, size, chunk, unit, len, &len);
+
+	cnt = 0;
+	sectors = 0;
+	sector = size;
+	started = size;
+	t = progress_start("FLASH update: image");
+	for (i = 0; hcs12mcu_flash_next_extent(buf, size, chunk, unit, &i, &j); i = j)
+	{
+		if (i - (i % hcs12mcu_target.flash_sector) != sector)
+		{
+			sector = i - (i % hcs12mcu_target.flash_sector);
+
+			/* first sector is erased before anything else, so that
+			   at most one command is pending on write */
+
+			if (sector != started)
+			{
+				ret = (*erase)(sector, TRUE);
+				if (ret != 0)
+					goto done;
+				++ sectors;
+			}
+
+			k = sector + hcs12mcu_target.flash_sector;
+			if (hcs12mcu_flash_next_extent(buf, size, chunk, unit, &k, &n))
+			{
+				started = k - (k % hcs12mcu_target.flash_sector);
+				ret = (*erase)(started, FALSE);
+				if (ret != 0)
+					goto done;
+				++ sectors;
+			}
 		}
 
 		ret = (*f)(i, buf + i, j - i);
+		if (ret != 0)
+			goto done;
+
+		cnt += j - i;
+		progress_report(cnt, len);
+	}
+	progress_stop(t, "FLASH update: image", len);
+
+	if (options.verbose)
+	{
+		printf("FLASH update: <%lu> sectors erased\n",
+		       (unsigned long)sectors);
+	}
+
+done:
+	free(buf);
+	return ret;
+}
+
+
+/*
+ *  write target FLASH, interleaving data for different FLASH blocks -
+ *  each callback gets at most one extent per block, so that blocks can
+ *  be programmed at the same time
+ *
+ *  in:
+ *    file - file name with data for programming
+ *    chunk - write chunk size (per block)
+ *    f - FLASH write callback, with extents array
+ *  out:
+ *    status code (errno-like)
+ */
+
+int hcs12mcu_flash_write_blocks(const char *file, size_t chunk,
+	int (*f)(const hcs12mcu_extent_t *e, int n))
+{
+	hcs12mcu_extent_t e[HCS12_FLASH_BLOCKS_MAX];
+	uint32_t pos[HCS12_FLASH_BLOCKS_MAX];
+	int stream[HCS12_FLASH_BLOCKS_MAX];
+	uint32_t next;
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t unit;
+	uint32_t len;
+	uint32_t cnt;
+	uint32_t b;
+	unsigned long t;
+	int blocks;
+	int found;
+	int n;
+	int ret;
+
+	ret = hcs12mcu_flash_image_load(file, chunk, &buf, &size, &unit, &len);
+	if (ret != 0)
+		return ret;
+
+	/* per block search position, block ranges are contiguous
+	   within linear address space */
+
+	blocks = hcs12mcu_target.flash_blocks;
+	if (blocks < 1 || blocks > HCS12_FLASH_BLOCKS_MAX ||
+	    options.flash_addr == HCS12MEM_FLASH_ADDR_NON_BANKED)
+		blocks = 1;
+	for (n = 0; n < blocks; ++ n)
+		pos[n] = (uint32_t)n * (size / (uint32_t)blocks);
+
+	hcs12mcu_flash_plan(buf, size, chunk, unit, len, &len);
+
+	hcs12mcu_journal_read(buf, size, blocks);
+	for (n = 0; n < blocks; ++ n)
+	{
+		ret = hcs12mcu_journal_resume(buf, chunk, unit, n, pos[n],
+			(uint32_t)(n + 1) * (size / (uint32_t)blocks));
 		if (ret != 0)
 		{
 			free(buf);
 			return ret;
 		}
+	}
+	hcs12mcu_journal_create(buf, size, blocks);
+
+	cnt = 0;
+	t = progress_start("FLASH write: image");
+	for (;;)
+	{
+		n = 0;
+		for (b = 0; b < (uint32_t)blocks; ++ b)
+		{
+			/* skip data written before interruption */
+
+			for (;;)
+			{
+				found = hcs12mcu_flash_next_extent(buf,
+					(b + 1) * (size / (uint32_t)blocks),
+					chunk, unit, &pos[b], &next);
+				if (!found || next > hcs12mcu_journal.mark[b])
+					break;
+				cnt += next - pos[b];
+				pos[b] = next;
+			}
+			if (!found)
+				continue;
+			if (pos[b] < hcs12mcu_journal.mark[b])
+			{
+				cnt += hcs12mcu_journal.mark[b] - pos[b];
+				pos[b] = hcs12mcu_journal.mark[b];
+			}
+
+			e[n].addr = pos[b];
+			e[n].buf = buf + pos[b];
+			e[n].size = next - pos[b];
+			stream[n] = (int)b;
+			cnt += next - pos[b];
+			pos[b] = next;
+			++ n;
+		}
+		if (n == 0)
+			break;
+
+		ret = (*f)(e, n);
+		if (ret != 0)
+		{
+			hcs12mcu_journal_close(ret);
+			free(buf);
+			return ret;
+		}
+		while (n -- > 0)
+			hcs12mcu_journal_mark(stream[n], (uint32_t)(e[n].addr + e[n].size));
 
-		cnt += j - i;
 		progress_report(cnt, len);
-		i = j;
 	}
 	progress_stop(t, "FLASH write: image", len);
 
+	hcs12mcu_journal_close(0);
 	free(buf);
 	return 0;
 }
@@ -1233,7 +2910,7 @@ int hcs12mcu_flash_write(const char *file, size_t chunk,
  *  read target EEPROM
  *
  *  in:
- *    file - file name to write EEPROM data
+ *    file - file name to write EEPROM data, optionally with address ranges
  *  out:
  *    status code (errno-like)
  */
@@ -1243,9 +2920,13 @@ int hcs12mcu_eeprom_read(const char *file, size_t chunk,
 {
 	int ret;
 	uint8_t *buf;
+	uint8_t *map;
+	char name[SYS_MAX_PATH + 1];
 	unsigned long t;
 	uint32_t size;
-	uint32_t i;
+	uint32_t len;
+	uint32_t cnt;
+	uint32_t i, j;
 
 	size = hcs12mcu_target.eeprom_size;
 	if (size == 0)
@@ -1254,28 +2935,39 @@ int hcs12mcu_eeprom_read(const char *file, size_t chunk,
 		return EINVAL;
 	}
 
+	ret = hcs12mcu_read_ranges(file, name, sizeof(name),
+		hcs12mcu_eeprom_read_address, size, &map, &len);
+	if (ret != 0)
+		return ret;
+
 	buf = malloc(size);
 	if (buf == NULL)
 	{
+		free(map);
 		error("not enough memory\n");
 		return ENOMEM;
 	}
+	memset(buf, 0xff, (size_t)size);
 
+	cnt = 0;
 	t = progress_start("EEPROM read: data");
-	for (i = 0; i < size; i += (uint16_t)chunk)
+	for (i = 0; hcs12mcu_read_next(map, size, chunk, &i, &j); i = j)
 	{
-		ret = (*f)((uint16_t)(i + hcs12mcu_target.eeprom_base), buf + i, chunk);
+		ret = (*f)((uint16_t)(i + hcs12mcu_target.eeprom_base), buf + i, j - i);
 		if (ret != 0)
 		{
+			free(map);
 			free(buf);
 			return ret;
 		}
-		progress_report(i + chunk, size);
+
+		cnt += j - i;
+		progress_report(cnt, len);
 	}
-	progress_stop(t, "EEPROM read: data", size);
+	progress_stop(t, "EEPROM read: data", len);
 
-	ret = srec_write(
-		file,
+	ret = srec_write_map(
+		name,
 		"EEPROM data",
 		hcs12mcu_target.eeprom_base,
 		size,
@@ -1284,8 +2976,10 @@ int hcs12mcu_eeprom_read(const char *file, size_t chunk,
 		NULL,
 		!options.include_erased,
 		options.srec_size,
-		SREC_ENTRY_MODE_RAW
+		SREC_ENTRY_MODE_RAW,
+		map
 		);
+	free(map);
 	if (ret != 0)
 	{
 		free(buf);
@@ -1295,7 +2989,7 @@ int hcs12mcu_eeprom_read(const char *file, size_t chunk,
 	if (options.verbose)
 	{
 		printf("EEPROM read: data file <%s> written\n",
-		       (const char *)file);
+		       (const char *)name);
 	}
 
 	free(buf);
@@ -1355,7 +3049,7 @@ int hcs12mcu_eeprom_write(const char *file, size_t chunk,
 		       (const char *)file);
 	}
 
-	ret = srec_read(
+	ret = image_read(
 		file,
 		info,
 		sizeof(info),
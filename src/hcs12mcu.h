@@ -79,6 +79,16 @@
 #define HCS12_IO_MEMSIZ_ROM_SW        0x00c0
 #define HCS12_IO_MEMSIZ_PAG_SW        0x0003
 #define HCS12_IO_PPAGE          0x0030
+#define HCS12_IO_SYNR           0x0034
+#define HCS12_IO_SYNR_SYN             0x3f
+#define HCS12_IO_REFDV          0x0035
+#define HCS12_IO_REFDV_REFDV          0x0f
+#define HCS12_IO_CRGFLG         0x0037
+#define HCS12_IO_CRGFLG_LOCK          0x08
+#define HCS12_IO_CLKSEL         0x0039
+#define HCS12_IO_CLKSEL_PLLSEL        0x80
+#define HCS12_IO_PLLCTL         0x003a
+#define HCS12_IO_PLLCTL_PLLON         0x40
 
 /* HCS12X I/O registers and bit flags */
 
@@ -94,7 +104,7 @@
 #define HCS12_IO_FCLKDIV_PRDIV8       0x40
 #define HCS12_IO_FCLKDIV_FDIV         0x3f
 #define HCS12_IO_FSEC           0x0101
-#define HCS12_IO_FTSTMOD        0x0101
+#define HCS12_IO_FTSTMOD        0x0102
 #define HCS12_IO_FTSTMOD_WRALL        0x10
 #define HCS12_IO_FCNFG          0x0103
 #define HCS12_IO_FPROT          0x0104
@@ -131,6 +141,7 @@
 #define HCS12_IO_ECMD_PROGRAM         0x20
 #define HCS12_IO_ECMD_SECTOR_ERASE    0x40
 #define HCS12_IO_ECMD_MASS_ERASE      0x41
+#define HCS12_IO_ECMD_SECTOR_MODIFY   0x60
 #define HCS12_IO_EADDR          0x0118
 #define HCS12_IO_EDATA          0x011a
 
@@ -143,6 +154,12 @@
 
 #define HCS12_FLASH_INVALID_ADDRESS (uint32_t)0xffffffff
 
+/* S12X global address of FLASH page 0x00 (PPAGE value scales from here) */
+
+#define HCS12X_FLASH_GLOBAL_BASE     0x400000
+#define HCS12_FLASH_PHRASE_MAX      8 /* largest programming unit, bytes */
+#define HCS12_FLASH_BLOCKS_MAX      4
+
 /* HCS12 FLASH/EEPROM addresses and bit masks */
 
 #define HCS12_FLASH_BACKDOOR   0xff00
@@ -163,6 +180,7 @@
 #define HCS12_FLASH_FSEC_NV2         0x04
 #define HCS12_FLASH_FSEC_SEC         0x03
 
+#define HCS12_EEPROM_SECTOR_SIZE 4
 #define HCS12_EEPROM_RESERVED_SIZE 16
 #define HCS12_EEPROM_RESERVED_EPROT_OFFSET 13
 
@@ -171,6 +189,14 @@
 #define HCS12_FCLK_MIN 150000
 #define HCS12_FCLK_MAX 200000
 
+/* FLASH program time per word, microseconds (with FCLK in range) */
+
+#define HCS12_FLASH_WORD_TIME 50
+
+/* HCS12 PLL reference clock minimum */
+
+#define HCS12_PLL_REF_MIN 500000
+
 /* target characteristics */
 
 typedef struct
@@ -191,6 +217,7 @@ typedef struct
 	int fsec_keyen_bits;
 	uint32_t flash_size;
 	uint32_t flash_sector;
+	uint32_t flash_phrase;
 	uint32_t flash_nb_base;
 	uint32_t flash_nb_size;
 	uint32_t flash_linear_base;
@@ -201,6 +228,7 @@ typedef struct
 
 	/* values read from target device */
 
+	uint16_t partid;
 	uint32_t reg_base;
 	uint32_t reg_space;
 	uint32_t reg_size;
@@ -232,6 +260,27 @@ hcs12mcu_target_t;
 
 extern hcs12mcu_target_t hcs12mcu_target;
 
+/* FLASH image extent, for interleaved multi-block writing */
+
+typedef struct
+{
+	uint32_t addr;
+	const uint8_t *buf;
+	size_t size;
+}
+hcs12mcu_extent_t;
+
+/* FLASH write cost model, for merging extents separated by short
+   blank gaps - programming the gap must be cheaper than next command */
+
+typedef struct
+{
+	uint32_t overhead; /* per write callback, microseconds */
+	uint32_t rate;     /* data transfer, bytes per second */
+	uint32_t word;     /* program time per word, microseconds */
+}
+hcs12mcu_cost_t;
+
 extern int hcs12mcu_target_parse(void);
 extern int hcs12mcu_partid(uint16_t id, int verbose);
 extern int hcs12mcu_identify(int verbose);
@@ -251,8 +300,17 @@ extern uint8_t hcs12mcu_block_to_ppage_base(uint32_t block);
 
 extern int hcs12mcu_flash_read(const char *file, size_t chunk,
 	int (*f)(uint32_t addr, void *buf, size_t size));
+extern int hcs12mcu_flash_cost(uint32_t overhead, uint32_t rate, uint32_t word);
+extern void hcs12mcu_flash_readback(int (*f)(uint32_t addr, void *buf, size_t size));
+extern void hcs12mcu_flash_defer(int (*f)(void));
+extern void hcs12mcu_flash_confirm(void);
 extern int hcs12mcu_flash_write(const char *file, size_t chunk,
 	int (*f)(uint32_t addr, const void *buf, size_t size));
+extern int hcs12mcu_flash_update(const char *file, size_t chunk,
+	int (*erase)(uint32_t addr, int wait),
+	int (*f)(uint32_t addr, const void *buf, size_t size));
+extern int hcs12mcu_flash_write_blocks(const char *file, size_t chunk,
+	int (*f)(const hcs12mcu_extent_t *e, int n));
 extern int hcs12mcu_eeprom_read(const char *file, size_t chunk,
 	int (*f)(uint16_t addr, void *buf, size_t size));
 extern int hcs12mcu_eeprom_write(const char *file, size_t chunk,
@@ -26,6 +26,7 @@
 #include "hcs12lrae.h"
 #include "hcs12sm.h"
 #include "hcs12bdm.h"
+#include "patch.h"
 
 #if HAVE_GETOPT_H
 # include <getopt.h>
@@ -73,6 +74,16 @@ static const char *PRG_USAGE =
 	"      banked-linear - Freescale banked linear format\n"
 	"      banked-ppage  - banked format with PPAGE value as MSB\n"
 	"      (when not specified, default is non-banked)\n"
+	"  -L <address>, --binary-base <address>\n"
+	"      address of first byte of raw binary (.bin) image file, in format\n"
+	"      given by -a option (default is start of memory)\n"
+	"  -M <policy>, --merge <policy>\n"
+	"      policy for data conflicts when several comma separated image\n"
+	"      files are merged for FLASH write:\n"
+	"      error - conflicting data is an error\n"
+	"      first - data from file given earlier is kept\n"
+	"      last  - data from file given later is kept\n"
+	"      (when not specified, default is error)\n"
 	"  -e, --include-erased\n"
 	"      include erased areas of memory in written S-record file\n"
 	"      (default is to skip 0xff blocks)\n"
@@ -80,6 +91,8 @@ static const char *PRG_USAGE =
 	"      size of single S-record written to file, default: 16\n"
 	"  -v, --verify\n"
 	"      verify result of all erase/write operations\n"
+	"Input files can be S-record, Intel HEX, ELF (68HC12) or raw binary\n"
+	"(.bin) images, format is detected automatically.\n"
 	"Following options can be specified multiple times, any of them,\n"
 	"processing is according to occurence order:\n"
 	"  -R, --reset\n"
@@ -92,8 +105,9 @@ static const char *PRG_USAGE =
 	"      load S-record file into RAM and execute\n"
 	"  -A, --eeprom-erase\n"
 	"      erase EEPROM memory\n"
-	"  -B <file>, --eeprom-read <file>\n"
-	"      read EEPROM memory contents into S-record file\n"
+	"  -B <file>[@<ranges>], --eeprom-read <file>[@<ranges>]\n"
+	"      read EEPROM memory contents into S-record file, optionally\n"
+	"      only comma separated ranges <start>-<end> or <start>+<size>\n"
 	"  -C <file>, --eeprom-write <file>\n"
 	"      write EEPROM memory contents from S-record file\n"
 	"  -D <range>, --eeprom-protect <range>\n"
@@ -105,18 +119,49 @@ static const char *PRG_USAGE =
 	"      erase FLASH memory, leave security byte in secured state\n"
 	"  -F, --flash-erase-unsecure\n"
 	"      erase FLASH memory, program security byte to unsecured state\n"
-	"  -G <file>, --flash-read <file>\n"
-	"      read FLASH memory contents into S-record file\n"
+	"  -G <file>[@<ranges>], --flash-read <file>[@<ranges>]\n"
+	"      read FLASH memory contents into S-record file, optionally\n"
+	"      only comma separated ranges <start>-<end> or <start>+<size>,\n"
+	"      addresses are in format given by -a option\n"
 	"  -H <file>, --flash-write <file>\n"
-	"      write FLASH memory contents from S-record file\n"
+	"      write FLASH memory contents from S-record file (several files\n"
+	"      separated by commas are merged and written in one pass)\n"
+	"  -I <file>, --flash-update <file>\n"
+	"      erase FLASH sectors covered by S-record file and write them,\n"
+	"      erasing next sector while current one is written\n"
+	"  -J, --resume\n"
+	"      resume FLASH write interrupted earlier, skipping data recorded\n"
+	"      as written in journal for interface and target\n"
+	"  -g, --image-cache\n"
+	"      keep parsed FLASH image in cache for interface and target, it is\n"
+	"      reused by later writes of unchanged image files\n"
+	"  -P <file>, --patch <file>\n"
+	"      patch FLASH image with per-device data (serial numbers, keys)\n"
+	"      given by patch specification file, device index kept for\n"
+	"      interface and target is advanced after each write; with -I\n"
+	"      only sectors touched by patch are erased and written\n"
+	"  -K, --calibrate\n"
+	"      benchmark available transfer methods, store the fastest ones\n"
+	"      in tuning profile for interface and target, used by later runs\n"
 	"Special options for LRAE:\n"
 	"  -Z, --keep-lrae\n"
 	"      keep LRAE boot loader in FLASH memory when erasing FLASH\n"
 	"      memory (default is to erase it)\n"
+	"Special options for serial monitor:\n"
+	"  -W <baud>, --sm-turbo <baud>\n"
+	"      load high speed RAM agent via monitor for FLASH/EEPROM\n"
+	"      read/write, switching to given baud rate (0 - keep monitor's)\n"
 	"Special options for TBDML:\n"
 	"  -Y, --tbdml-bulk\n"
 	"      enable bulk USB transfers for TBDML (faster, but non-standard\n"
-	"      according to USB specification)\n";
+	"      according to USB specification)\n"
+	"Special options for BDM12POD and TBDML:\n"
+	"  -N, --pll-boost\n"
+	"      run target from PLL at bus clock given by target description\n"
+	"      and switch BDM to bus clock for faster communication\n"
+	"  -k, --keep-agent\n"
+	"      load RAM agent once per session, keep it between operations\n"
+	"      and target re-initializations\n";
 
 /* target connection handlers */
 
@@ -134,6 +179,8 @@ static const hcs12mem_target_handler_t *hcs12mem_target_handler_table[] =
 hcs12mem_options_t options;
 char hcs12mem_data_dir[SYS_MAX_PATH + 1];
 hcs12mem_target_info_t *hcs12mem_target_info_head = NULL;
+static hcs12mem_target_info_t *hcs12mem_profile_head = NULL;
+static char hcs12mem_profile_file[SYS_MAX_PATH + 1];
 static int progress_last;
 
 
@@ -294,41 +341,59 @@ static unsigned long hcs12mem_parse_osc(const char *str)
 
 
 /*
- *  free target info data
+ *  free key-value list
  *
  *  in:
- *    void
+ *    head - list head
  *  out:
  *    void
  */
 
-static void hcs12mem_target_info_free(void)
+static void hcs12mem_info_free(hcs12mem_target_info_t **head)
 {
 	hcs12mem_target_info_t *next;
 
-	while (hcs12mem_target_info_head != NULL)
+	while (*head != NULL)
 	{
-		free(hcs12mem_target_info_head->key);
-		free(hcs12mem_target_info_head->value);
-		next = hcs12mem_target_info_head->next;
-		free(hcs12mem_target_info_head);
-		hcs12mem_target_info_head = next;
+		free((*head)->key);
+		free((*head)->value);
+		next = (*head)->next;
+		free(*head);
+		*head = next;
 	}
 }
 
 
 /*
- *  read target info data
+ *  free target info data, including tuning profile
  *
  *  in:
  *    void
  *  out:
+ *    void
+ */
+
+static void hcs12mem_target_info_free(void)
+{
+	hcs12mem_info_free(&hcs12mem_target_info_head);
+	hcs12mem_info_free(&hcs12mem_profile_head);
+}
+
+
+/*
+ *  read key-value list from file
+ *
+ *  in:
+ *    file - file name
+ *    what - file description for error messages
+ *    head - list head, records are appended
+ *  out:
  *    status code (0 - ok, other value - error code)
  */
 
-static int hcs12mem_target_info_read(void)
+static int hcs12mem_info_read(const char *file, const char *what,
+	hcs12mem_target_info_t **head)
 {
-	char file[SYS_MAX_PATH + 1];
 	char buf[256];
 	FILE *f;
 	int ret;
@@ -337,22 +402,12 @@ static int hcs12mem_target_info_read(void)
 	hcs12mem_target_info_t *rec;
 	hcs12mem_target_info_t **node;
 
-	if (access(options.target, R_OK) == -1 &&
-	    strchr(options.target, SYS_PATH_SEPARATOR) == NULL)
-	{
-		snprintf(file, sizeof(file), "%s%c%s.dat",
-			 (const char *)hcs12mem_data_dir,
-			 (char)SYS_PATH_SEPARATOR,
-			 (const char *)options.target);
-	}
-	else
-		strlcpy(file, options.target, sizeof(file));
-
 	f = fopen(file, "rt");
 	if (f == NULL)
 	{
 		ret = errno;
-		error("cannot open target description file %s (%s)\n",
+		error("cannot open %s file %s (%s)\n",
+		      (const char *)what,
 		      (const char *)file,
 		      (const char *)strerror(ret));
 		return ret;
@@ -391,7 +446,7 @@ static int hcs12mem_target_info_read(void)
 		if (rec == NULL)
 		{
 		  err_mem:
-			hcs12mem_target_info_free();
+			hcs12mem_info_free(head);
 			error("not enough memory\n");
 			ret = ENOMEM;
 			break;
@@ -410,7 +465,7 @@ static int hcs12mem_target_info_read(void)
 			goto err_mem;
 		}
 
-		node = &hcs12mem_target_info_head;
+		node = head;
 		while (*node != NULL)
 			node = &((*node)->next);
 		*node = rec;
@@ -420,7 +475,8 @@ static int hcs12mem_target_info_read(void)
 	{
 		if (ret == 0)
 			ret = errno;
-		error("cannot read target description file %s (%s)\n",
+		error("cannot read %s file %s (%s)\n",
+		      (const char *)what,
 		      (const char *)file,
 		      (const char *)strerror(errno));
 	}
@@ -429,7 +485,8 @@ static int hcs12mem_target_info_read(void)
 	{
 		if (ret == 0)
 			ret = errno;
-		error("cannot close target description file %s (%s)\n",
+		error("cannot close %s file %s (%s)\n",
+		      (const char *)what,
 		      (const char *)file,
 		      (const char *)strerror(errno));
 		return ret;
@@ -439,6 +496,223 @@ static int hcs12mem_target_info_read(void)
 }
 
 
+/*
+ *  read target info data
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (0 - ok, other value - error code)
+ */
+
+static int hcs12mem_target_info_read(void)
+{
+	char file[SYS_MAX_PATH + 1];
+
+	if (access(options.target, R_OK) == -1 &&
+	    strchr(options.target, SYS_PATH_SEPARATOR) == NULL)
+	{
+		snprintf(file, sizeof(file), "%s%c%s.dat",
+			 (const char *)hcs12mem_data_dir,
+			 (char)SYS_PATH_SEPARATOR,
+			 (const char *)options.target);
+	}
+	else
+		strlcpy(file, options.target, sizeof(file));
+
+	return hcs12mem_info_read(file, "target description",
+		&hcs12mem_target_info_head);
+}
+
+
+/*
+ *  make name of state file kept for used interface and target
+ *  (tuning profile, FLASH write journal)
+ *
+ *  in:
+ *    buf - buffer for file name
+ *    size - buffer size
+ *    ext - file name extension
+ *  out:
+ *    void
+ */
+
+void hcs12mem_state_file(char *buf, size_t size, const char *ext)
+{
+	const char *dir;
+	const char *target;
+	char name[SYS_MAX_PATH + 1];
+	char *ptr;
+
+	/* file name is made of interface and target base name */
+
+	target = strrchr(options.target, SYS_PATH_SEPARATOR);
+	target = (target == NULL ? options.target : target + 1);
+	strlcpy(name, target, sizeof(name));
+	ptr = strrchr(name, '.');
+	if (ptr != NULL && strcmp(ptr, ".dat") == 0)
+		*ptr = '\0';
+
+	dir = getenv("HOME");
+	if (dir == NULL || *dir == '\0')
+		dir = hcs12mem_data_dir;
+
+	snprintf(buf, size, "%s%c.hcs12mem-%s-%s.%s",
+		 (const char *)dir,
+		 (char)SYS_PATH_SEPARATOR,
+		 (const char *)options.iface,
+		 (const char *)name,
+		 ext);
+}
+
+
+/*
+ *  read tuning profile for used interface and target, if there is one
+ *  (profile file is written by calibration run, its values take
+ *  precedence over target info data)
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (0 - ok, other value - error code)
+ */
+
+static int hcs12mem_profile_read(void)
+{
+	hcs12mem_state_file(hcs12mem_profile_file,
+		sizeof(hcs12mem_profile_file), "prf");
+
+	if (access(hcs12mem_profile_file, R_OK) == -1)
+		return 0;
+
+	if (options.verbose)
+	{
+		printf("tuning profile <%s>\n",
+		       (const char *)hcs12mem_profile_file);
+	}
+
+	return hcs12mem_info_read(hcs12mem_profile_file, "tuning profile",
+		&hcs12mem_profile_head);
+}
+
+
+/*
+ *  set tuning profile value, effective immediately
+ *
+ *  in:
+ *    key - key name
+ *    value - key value
+ *  out:
+ *    0 - ok, other value - errno status code
+ */
+
+int hcs12mem_profile_set(const char *key, const char *value)
+{
+	hcs12mem_target_info_t *rec;
+	hcs12mem_target_info_t **node;
+	char *v;
+
+	v = strdup(value);
+	if (v == NULL)
+	{
+		error("not enough memory\n");
+		return ENOMEM;
+	}
+
+	for (node = &hcs12mem_profile_head; *node != NULL; node = &((*node)->next))
+	{
+		if (strcmp((*node)->key, key) == 0)
+		{
+			free((*node)->value);
+			(*node)->value = v;
+			return 0;
+		}
+	}
+
+	rec = malloc(sizeof(*rec));
+	if (rec == NULL)
+	{
+		free(v);
+		error("not enough memory\n");
+		return ENOMEM;
+	}
+
+	rec->key = strdup(key);
+	rec->value = v;
+	rec->next = NULL;
+	if (rec->key == NULL)
+	{
+		free(v);
+		free(rec);
+		error("not enough memory\n");
+		return ENOMEM;
+	}
+
+	*node = rec;
+	return 0;
+}
+
+
+/*
+ *  write tuning profile
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (0 - ok, other value - error code)
+ */
+
+static int hcs12mem_profile_write(void)
+{
+	hcs12mem_target_info_t *rec;
+	FILE *f;
+	int ret;
+
+	f = fopen(hcs12mem_profile_file, "wt");
+	if (f == NULL)
+	{
+		ret = errno;
+		error("cannot create tuning profile file %s (%s)\n",
+		      (const char *)hcs12mem_profile_file,
+		      (const char *)strerror(ret));
+		return ret;
+	}
+
+	fprintf(f, "# hcs12mem tuning profile, written by calibration run\n");
+	for (rec = hcs12mem_profile_head; rec != NULL; rec = rec->next)
+	{
+		fprintf(f, "%s %s\n",
+			(const char *)rec->key,
+			(const char *)rec->value);
+	}
+
+	ret = 0;
+	if (ferror(f))
+	{
+		ret = errno;
+		error("cannot write tuning profile file %s (%s)\n",
+		      (const char *)hcs12mem_profile_file,
+		      (const char *)strerror(ret));
+	}
+
+	if (fclose(f) == -1 && ret == 0)
+	{
+		ret = errno;
+		error("cannot close tuning profile file %s (%s)\n",
+		      (const char *)hcs12mem_profile_file,
+		      (const char *)strerror(ret));
+	}
+
+	if (ret == 0 && options.verbose)
+	{
+		printf("tuning profile <%s> written\n",
+		       (const char *)hcs12mem_profile_file);
+	}
+
+	return ret;
+}
+
+
 /*
  *  get target info record value as string
  *
@@ -458,6 +732,21 @@ const char *hcs12mem_target_info(const char *key, int first)
 		rec = hcs12mem_target_info_head;
 	if (key == NULL)
 		return NULL;
+
+	/* tuning profile value replaces all target info records */
+
+	if (first)
+	{
+		for (ptr = hcs12mem_profile_head; ptr != NULL; ptr = ptr->next)
+		{
+			if (strcmp(key, ptr->key) == 0)
+			{
+				rec = NULL;
+				return ptr->value;
+			}
+		}
+	}
+
 	while (rec != NULL)
 	{
 		ptr = rec;
@@ -520,12 +809,13 @@ int main(int argc, char *argv[])
 	const hcs12mem_target_handler_t *h;
 	int c;
 	char *end;
+	uint32_t v;
 	int i;
 	int ret;
 
 	/* valid options */
 
-	static const char *opt_string = "hqdfi:p:b:c:t:o:j:a:es:vX:USAB:C:D:EFG:H:RZY";
+	static const char *opt_string = "hqdfi:p:b:c:t:o:j:a:L:M:es:vX:USAB:C:D:EFG:H:I:JgP:KRZYNkW:";
 #if HAVE_GETOPT_LONG
 	static const struct option opt_long[] =
 #else
@@ -551,6 +841,8 @@ int main(int argc, char *argv[])
 		{ "osc",            1, NULL, 'o' },
 		{ "start-address",  1, NULL, 'j' },
 		{ "flash-address",  1, NULL, 'a' },
+		{ "binary-base",    1, NULL, 'L' },
+		{ "merge",          1, NULL, 'M' },
 		{ "include-erased", 0, NULL, 'e' },
 		{ "srec-size",      1, NULL, 's' },
 		{ "verify",         0, NULL, 'V' },
@@ -566,8 +858,16 @@ int main(int argc, char *argv[])
 		{ "flash-erase-unsecure", 0, NULL, 'F' },
 		{ "flash-read",     1, NULL, 'G' },
 		{ "flash-write",    1, NULL, 'H' },
+		{ "flash-update",   1, NULL, 'I' },
+		{ "resume",         0, NULL, 'J' },
+		{ "image-cache",    0, NULL, 'g' },
+		{ "patch",          1, NULL, 'P' },
+		{ "calibrate",      0, NULL, 'K' },
 		{ "keep-lrae",      0, NULL, 'Z' },
 		{ "tbdml-bulk",     0, NULL, 'Y' },
+		{ "pll-boost",      0, NULL, 'N' },
+		{ "keep-agent",     0, NULL, 'k' },
+		{ "sm-turbo",       1, NULL, 'W' },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -627,13 +927,23 @@ int main(int argc, char *argv[])
 	options.osc = 0;
 	options.start = 0;
 	options.start_valid = FALSE;
+	options.binary_base = 0;
+	options.binary_base_valid = FALSE;
 	options.flash_addr = HCS12MEM_FLASH_ADDR_NON_BANKED;
+	options.merge = HCS12MEM_MERGE_ERROR;
 	options.include_erased = FALSE;
 	options.srec_size = HCS12MEM_DEFAULT_SREC_SIZE;
 	options.podex_25 = FALSE;
 	options.podex_mem_bug = FALSE;
 	options.keep_lrae = FALSE;
 	options.tbdml_bulk = FALSE;
+	options.pll_boost = FALSE;
+	options.keep_agent = FALSE;
+	options.resume = FALSE;
+	options.image_cache = FALSE;
+	options.patch = NULL;
+	options.sm_turbo = FALSE;
+	options.sm_turbo_baud = 0;
 
 	/* parse options */
 
@@ -732,6 +1042,17 @@ int main(int argc, char *argv[])
 				options.start_valid = TRUE;
 				break;
 
+			case 'L':
+				options.binary_base = strtoul(optarg, &end, 0);
+				if (*end != '\0')
+				{
+					error("invalid binary base address: %s\n",
+					      (const char *)optarg);
+					exit(EXIT_FAILURE);
+				}
+				options.binary_base_valid = TRUE;
+				break;
+
 			case 'a':
 				if (strcmp(optarg, "non-banked") == 0)
 					options.flash_addr = HCS12MEM_FLASH_ADDR_NON_BANKED;
@@ -747,6 +1068,21 @@ int main(int argc, char *argv[])
 				}
 				break;
 
+			case 'M':
+				if (strcmp(optarg, "error") == 0)
+					options.merge = HCS12MEM_MERGE_ERROR;
+				else if (strcmp(optarg, "first") == 0)
+					options.merge = HCS12MEM_MERGE_FIRST;
+				else if (strcmp(optarg, "last") == 0)
+					options.merge = HCS12MEM_MERGE_LAST;
+				else
+				{
+					error("invalid merge policy: %s\n",
+					      (const char *)optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+
 			case 'e':
 				options.include_erased = TRUE;
 				break;
@@ -777,6 +1113,8 @@ int main(int argc, char *argv[])
 			case 'F':
 			case 'G':
 			case 'H':
+			case 'I':
+			case 'K':
 				break;
 
 			case 'Z':
@@ -787,6 +1125,38 @@ int main(int argc, char *argv[])
 				options.tbdml_bulk = TRUE;
 				break;
 
+			case 'N':
+				options.pll_boost = TRUE;
+				break;
+
+			case 'k':
+				options.keep_agent = TRUE;
+				break;
+
+			case 'J':
+				options.resume = TRUE;
+				break;
+
+			case 'g':
+				options.image_cache = TRUE;
+				break;
+
+			case 'P':
+				options.patch = optarg;
+				break;
+
+			case 'W':
+				options.sm_turbo_baud = (unsigned long)
+					strtoul(optarg, &end, 10);
+				if (*end != '\0')
+				{
+					error("invalid baud rate: %s\n",
+					      (const char *)optarg);
+					exit(EXIT_FAILURE);
+				}
+				options.sm_turbo = TRUE;
+				break;
+
 			default:
 #				ifdef HAVE_GETOPT_OWN
 				error("%c unknown option: %s (use -h option for help on usage)\n",
@@ -861,6 +1231,13 @@ int main(int argc, char *argv[])
 	if (ret != 0)
 		exit(EXIT_FAILURE);
 
+	ret = hcs12mem_profile_read();
+	if (ret != 0)
+	{
+		hcs12mem_target_info_free();
+		exit(EXIT_FAILURE);
+	}
+
 	ret = hcs12mcu_target_parse();
 	if (ret != 0)
 	{
@@ -868,6 +1245,30 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	/* transfer modes chosen by calibration, if not forced by options */
+
+	if (!options.tbdml_bulk)
+	{
+		ret = hcs12mem_target_param("tbdml_bulk", &v, FALSE);
+		if (ret != 0)
+		{
+			hcs12mem_target_info_free();
+			exit(EXIT_FAILURE);
+		}
+		options.tbdml_bulk = (v != 0);
+	}
+
+	if (!options.podex_mem_bug)
+	{
+		ret = hcs12mem_target_param("podex_mem_bug", &v, FALSE);
+		if (ret != 0)
+		{
+			hcs12mem_target_info_free();
+			exit(EXIT_FAILURE);
+		}
+		options.podex_mem_bug = (v != 0);
+	}
+
 	/* open target connection */
 
 	if ((*h->open)() != 0)
@@ -931,6 +1332,34 @@ int main(int argc, char *argv[])
 				break;
 			case 'H':
 				ret = (*h->flash_write)(optarg);
+				if (ret == 0)
+					ret = patch_next();
+				else
+					patch_release();
+				break;
+			case 'I':
+				if (h->flash_update == NULL)
+				{
+					error("FLASH update not supported for this interface\n");
+					ret = EINVAL;
+					break;
+				}
+				ret = (*h->flash_update)(optarg);
+				if (ret == 0)
+					ret = patch_next();
+				else
+					patch_release();
+				break;
+			case 'K':
+				if (h->calibrate == NULL)
+				{
+					error("calibration not supported for this interface\n");
+					ret = EINVAL;
+					break;
+				}
+				ret = (*h->calibrate)();
+				if (ret == 0)
+					ret = hcs12mem_profile_write();
 				break;
 			default:
 				ret = 0;
@@ -40,6 +40,20 @@
 #define HCS12MEM_FLASH_ADDR_BANKED_LINEAR 1
 #define HCS12MEM_FLASH_ADDR_BANKED_PPAGE  2
 
+/* conflict policies for merged FLASH image files */
+
+#define HCS12MEM_MERGE_ERROR 0
+#define HCS12MEM_MERGE_FIRST 1
+#define HCS12MEM_MERGE_LAST  2
+
+/* separator of merged FLASH image file names */
+
+#define HCS12MEM_IMAGE_SEPARATOR ','
+
+/* separator of address ranges appended to file name of read operation */
+
+#define HCS12MEM_RANGE_SEPARATOR '@'
+
 /* program options */
 
 typedef struct
@@ -54,15 +68,25 @@ typedef struct
 	const char *chip;
 	unsigned long start;
 	int start_valid;
+	unsigned long binary_base;
+	int binary_base_valid;
 	const char *target;
 	unsigned long osc;
 	int flash_addr;
+	int merge;
 	int include_erased;
 	size_t srec_size;
 	int podex_25;
 	int podex_mem_bug;
 	int keep_lrae;
 	int tbdml_bulk;
+	int pll_boost;
+	int keep_agent;
+	int resume;
+	int image_cache;
+	const char *patch;
+	int sm_turbo;
+	unsigned long sm_turbo_baud;
 }
 hcs12mem_options_t;
 
@@ -95,6 +119,8 @@ typedef struct
 	int (*flash_write)(const char *file);
 	int (*flash_protect)(const char *opt);
 	int (*reset)(void);
+	int (*calibrate)(void);
+	int (*flash_update)(const char *file);
 }
 hcs12mem_target_handler_t;
 
@@ -109,5 +135,7 @@ void progress_stop(unsigned long t, const char *title, uint32_t bytes);
 void progress_report(uint32_t n, uint32_t total);
 const char *hcs12mem_target_info(const char *key, int first);
 int hcs12mem_target_param(const char *key, uint32_t *value, uint32_t def);
+int hcs12mem_profile_set(const char *key, const char *value);
+void hcs12mem_state_file(char *buf, size_t size, const char *ext);
 
 #endif /* __HCS12MEM_H */
@@ -26,12 +26,29 @@
 #include "hcs12bdm.h"
 #include "serial.h"
 #include "srec.h"
+#include "image.h"
 #include "../target/agent.h"
 
 
 /* globals */
 
 static serial_t hcs12sm_serial;
+static int hcs12sm_turbo_loaded;
+static int hcs12sm_turbo_active;
+static uint16_t hcs12sm_turbo_entry;
+static uint16_t hcs12sm_turbo_bd;
+static uint16_t hcs12sm_turbo_loops;
+static uint8_t hcs12sm_turbo_defer[HCS12SM_FLASH_IMAGE_SIZE];
+static uint32_t hcs12sm_turbo_defer_addr;
+static int hcs12sm_turbo_deferred;
+
+/* shadow copies of bank selection registers, monitor itself changes
+   them only when running code or erasing */
+
+static int hcs12sm_ppage_valid;
+static uint8_t hcs12sm_ppage;
+static int hcs12sm_fcnfg_valid;
+static uint8_t hcs12sm_fcnfg;
 
 
 /*
@@ -77,6 +94,28 @@ static int hcs12sm_cmd(uint8_t cmd, const void *tx, size_t ntx, void *rx, size_t
 	size_t n;
 	int ret;
 
+	switch (cmd)
+	{
+		case HCS12SM_CMD_READ_BYTE:
+		case HCS12SM_CMD_WRITE_BYTE:
+		case HCS12SM_CMD_READ_WORD:
+		case HCS12SM_CMD_WRITE_WORD:
+		case HCS12SM_CMD_READ_NEXT:
+		case HCS12SM_CMD_WRITE_NEXT:
+		case HCS12SM_CMD_READ_BLOCK:
+		case HCS12SM_CMD_READ_REGS:
+		case HCS12SM_CMD_DEVICE_INFO:
+			break;
+		case HCS12SM_CMD_WRITE_BLOCK:
+			/* FLASH programming may switch block */
+			hcs12sm_fcnfg_valid = FALSE;
+			break;
+		default:
+			hcs12sm_ppage_valid = FALSE;
+			hcs12sm_fcnfg_valid = FALSE;
+			break;
+	}
+
 	n = 1;
 	ret = serial_write(&hcs12sm_serial, &cmd, &n, HCS12SM_TX_TIMEOUT);
 	if (ret != 0)
@@ -208,6 +247,21 @@ static int hcs12sm_cmd_write_byte(uint16_t addr, uint8_t v)
 	uint8_t cmd[3];
 	int ret;
 
+	/* skip writes not changing bank selection */
+
+	if (addr == HCS12_IO_PPAGE)
+	{
+		if (hcs12sm_ppage_valid && hcs12sm_ppage == v)
+			return 0;
+		hcs12sm_ppage_valid = FALSE;
+	}
+	else if (addr == HCS12_IO_FCNFG)
+	{
+		if (hcs12sm_fcnfg_valid && hcs12sm_fcnfg == v)
+			return 0;
+		hcs12sm_fcnfg_valid = FALSE;
+	}
+
 	uint16_host2be_to_buf(cmd + 0, addr);
 	cmd[2] = v;
 	ret = hcs12sm_cmd(HCS12SM_CMD_WRITE_BYTE, cmd, 3, NULL, 0);
@@ -218,6 +272,17 @@ static int hcs12sm_cmd_write_byte(uint16_t addr, uint8_t v)
 	if (ret != 0)
 		return ret;
 
+	if (addr == HCS12_IO_PPAGE)
+	{
+		hcs12sm_ppage = v;
+		hcs12sm_ppage_valid = TRUE;
+	}
+	else if (addr == HCS12_IO_FCNFG)
+	{
+		hcs12sm_fcnfg = v;
+		hcs12sm_fcnfg_valid = TRUE;
+	}
+
 	return 0;
 }
 
@@ -349,6 +414,53 @@ static int hcs12sm_cmd_device_info(uint16_t *partid)
 }
 
 
+static int hcs12sm_cmd_write_pc(uint16_t pc)
+{
+	uint8_t cmd[2];
+	int ret;
+
+	uint16_host2be_to_buf(cmd, pc);
+	ret = hcs12sm_cmd(HCS12SM_CMD_WRITE_PC, cmd, 2, NULL, 0);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_prompt(FALSE);
+	if (ret != 0)
+		return ret;
+
+	return 0;
+}
+
+
+static int hcs12sm_cmd_go(void)
+{
+	return hcs12sm_cmd(HCS12SM_CMD_GO, NULL, 0, NULL, 0);
+}
+
+
+/*
+ *  set serial port baud rate
+ *
+ *  in:
+ *    baud - baud rate
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_set_baud(unsigned long baud)
+{
+	serial_cfg_t cfg;
+
+	cfg.baud_rate = baud;
+	cfg.char_size = SERIAL_CFG_CHAR_SIZE_8;
+	cfg.parity = SERIAL_CFG_PARITY_NONE;
+	cfg.stop_bits = SERIAL_CFG_STOP_BITS_1;
+	cfg.handshake = SERIAL_CFG_HANDSHAKE_NONE;
+
+	return serial_set_cfg(&hcs12sm_serial, &cfg);
+}
+
+
 /*
  *  open connection with target via LRAE bootloader
  *
@@ -360,7 +472,6 @@ static int hcs12sm_cmd_device_info(uint16_t *partid)
 
 static int hcs12sm_open(void)
 {
-	serial_cfg_t cfg;
 	uint8_t b;
 	size_t size;
 	uint16_t id;
@@ -391,13 +502,8 @@ static int hcs12sm_open(void)
 
 	if (options.baud == 0)
 		options.baud = HCS12SM_BAUD_RATE;
-	cfg.baud_rate = options.baud;
-	cfg.char_size = SERIAL_CFG_CHAR_SIZE_8;
-	cfg.parity = SERIAL_CFG_PARITY_NONE;
-	cfg.stop_bits = SERIAL_CFG_STOP_BITS_1;
-	cfg.handshake = SERIAL_CFG_HANDSHAKE_NONE;
 
-	ret = serial_set_cfg(&hcs12sm_serial, &cfg);
+	ret = hcs12sm_set_baud(options.baud);
 	if (ret != 0)
 	{
 		serial_close(&hcs12sm_serial);
@@ -447,118 +553,200 @@ static int hcs12sm_open(void)
 		return ret;
 	}
 
+	hcs12sm_turbo_loaded = FALSE;
+	hcs12sm_turbo_active = FALSE;
+
 	return 0;
 }
 
 
 /*
- *  close connection with target via sm bootloader
+ *  RAM address translation (for reading S-record file)
  *
  *  in:
- *    void
+ *    addr - address to translate
  *  out:
- *    status code (errno-like)
+ *    translated address
  */
 
-static int hcs12sm_close(void)
+static uint32_t hcs12sm_ram_address(uint32_t addr)
 {
-	return serial_close(&hcs12sm_serial);
+	if (addr < hcs12mcu_target.ram_base ||
+	    addr >= hcs12mcu_target.ram_base + hcs12mcu_target.ram_size)
+		return hcs12mcu_target.ram_size;
+	return addr - hcs12mcu_target.ram_base;
 }
 
 
 /*
- *  load code and run from target RAM
+ *  load data into target RAM
  *
  *  in:
  *    file - data file name to read
+ *    agent - flag when loading target RAM agent
+ *    entry_addr - entry address (on return)
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12sm_ram_run(const char *file)
+static int hcs12sm_ram_load(const char *file, int agent, uint16_t *entry_addr)
 {
-	error("RAM run: operation not supported\n");
-	return EINVAL;
-}
+	int ret;
+	uint8_t *buf;
+	char info[256];
+	uint32_t entry;
+	uint32_t addr_min;
+	uint32_t addr_max;
+	uint32_t len;
+	uint32_t i;
+	uint32_t chunk;
+	unsigned long t;
 
+	if (!agent)
+		hcs12sm_turbo_loaded = FALSE;
 
-/*
- *  verify erasure of EEPROM
- *
- *  in:
- *    void
- *  out:
- *    status code (errno-like)
- */
+	buf = malloc(hcs12mcu_target.ram_size);
+	if (buf == NULL)
+	{
+		error("not enough memory\n");
+		return ENOMEM;
+	}
 
-static int hcs12sm_eeprom_erase_verify(void)
-{
-	int ret;
-	uint32_t i;
-	uint8_t buf[HCS12SM_BLOCK_SIZE_MAX];
-	int j;
+	entry = 0xffffffff;
 
-	for (i = 0; i < hcs12mcu_target.eeprom_size; i += HCS12SM_BLOCK_SIZE_MAX)
+	if (options.verbose)
 	{
-		ret = hcs12sm_cmd_read_block(
-			(uint16_t)(i + hcs12mcu_target.eeprom_base),
-			buf, HCS12SM_BLOCK_SIZE_MAX);
+		printf("RAM load: %s file <%s>\n",
+		       (const char *)(agent ? "agent" : "image"),
+		       (const char *)file);
+	}
+
+	ret = image_read(
+		file,
+		info,
+		sizeof(info),
+		buf,
+		hcs12mcu_target.ram_size,
+		NULL,
+		&entry,
+		&addr_min,
+		&addr_max,
+		hcs12sm_ram_address);
+	if (ret != 0)
+	{
+		free(buf);
+		return ret;
+	}
+
+	if (entry == 0xffffffff && (agent || !options.start_valid))
+	{
+		error("entry address not specified\n");
+		free(buf);
+		return EINVAL;
+	}
+
+	len = addr_max - addr_min + 1;
+	addr_min += hcs12mcu_target.ram_base;
+	addr_max += hcs12mcu_target.ram_base;
+	entry += hcs12mcu_target.ram_base;
+	if (!agent && options.start_valid)
+		entry = options.start;
+
+	if (options.verbose)
+	{
+		if (agent)
+		{
+			printf("RAM load: address range <0x%04X-0x%04X> length <0x%04X> entry <0x%04X>\n",
+			       (unsigned int)addr_min,
+			       (unsigned int)addr_max,
+			       (unsigned int)len,
+			       (unsigned int)entry);
+		}
+		else
+		{
+			printf("RAM load: image info <%s>\n"
+			       "RAM load: address range <0x%04X-0x%04X> length <0x%04X> entry <0x%04X>\n",
+			       (const char *)info,
+			       (unsigned int)addr_min,
+			       (unsigned int)addr_max,
+			       (unsigned int)len,
+			       (unsigned int)entry);
+		}
+	}
+
+	chunk = HCS12SM_BLOCK_SIZE_MAX;
+	t = progress_start("RAM load: data");
+	for (i = 0; i < len; i += chunk)
+	{
+		if (i + chunk > len)
+			chunk = len - i;
+
+		ret = hcs12sm_cmd_write_block(
+			(uint16_t)(addr_min + i),
+			buf + addr_min - hcs12mcu_target.ram_base + i,
+			chunk);
 		if (ret != 0)
-			return ret;
-		for (j = 0; j < HCS12SM_BLOCK_SIZE_MAX; ++j)
 		{
-			if (buf[j] != 0xff)
-			{
-				error("EEPROM memory not erased: value 0x%02X @ 0x%04X\n",
-				      (unsigned int)buf[j],
-				      (unsigned int)(i + hcs12mcu_target.eeprom_base));
-				return EIO;
-			}
+			free(buf);
+			return ret;
 		}
+
+		progress_report(i + chunk, len);
 	}
+	progress_stop(t, NULL, 0);
 
-	if (options.verbose)
-		printf("EEPROM erase: memory verified\n");
+	*entry_addr = (uint16_t)entry;
 
+	free(buf);
 	return 0;
 }
 
 
 /*
- *  erase target EEPROM
+ *  send command to turbo mode agent
  *
  *  in:
- *    void
+ *    cmd - command
+ *    param - parameter block
+ *    n - parameter block size
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12sm_eeprom_erase(void)
+static int hcs12sm_agent_cmd(uint8_t cmd, const uint8_t *param, size_t n)
 {
+	uint8_t b[2 + 8 + 1];
+	size_t i;
 	int ret;
 
-	if (hcs12mcu_target.eeprom_size == 0)
-	{
-		error("EEPROM erase not possible - no EEPROM memory\n");
+	if (n > 8)
 		return EINVAL;
-	}
 
-	ret = hcs12sm_cmd(HCS12SM_CMD_ERASE_EEPROM, NULL, 0, NULL, 0);
+	b[0] = cmd;
+	b[1] = (uint8_t)(n + 3);
+	memcpy(b + 2, param, n);
+	b[n + 2] = 0;
+	for (i = 0; i < n + 2; ++ i)
+		b[n + 2] += b[i];
+
+	n += 3;
+	ret = serial_write(&hcs12sm_serial, b, &n, HCS12SM_TX_TIMEOUT);
 	if (ret != 0)
 		return ret;
 
-	ret = hcs12sm_prompt(FALSE);
+	ret = hcs12sm_rx(b, 1, HCS12SM_TURBO_RX_TIMEOUT);
 	if (ret != 0)
 		return ret;
 
-	if (options.verbose)
-		printf("EEPROM erase: memory erased\n");
-
-	if (options.verify)
+	if (b[0] == HCS12_AGENT_ERROR_SUM)
 	{
-		ret = hcs12sm_eeprom_erase_verify();
-		if (ret != 0)
-			return ret;
+		error("communication failed, invalid checksum\n");
+		return EIO;
+	}
+	if (b[0] != HCS12_AGENT_ERROR_NONE)
+	{
+		error("communication failed, unexpected answer\n");
+		return EIO;
 	}
 
 	return 0;
@@ -566,162 +754,923 @@ static int hcs12sm_eeprom_erase(void)
 
 
 /*
- *  read target EEPROM
+ *  get command completion status from turbo mode agent
  *
  *  in:
- *    file - file name to write EEPROM data
+ *    void
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12sm_eeprom_read(const char *file)
+static int hcs12sm_agent_status(void)
 {
-	return hcs12mcu_eeprom_read(file, HCS12SM_BLOCK_SIZE_MAX, hcs12sm_cmd_read_block);
-}
-
+	uint8_t b;
+	int ret;
 
-/*
- *  write target EEPROM
- *
- *  in:
- *    file - file name with data to write
- *  out:
- *    status code (errno-like)
- */
+	ret = hcs12sm_rx(&b, 1, HCS12SM_TURBO_RX_TIMEOUT);
+	if (ret != 0)
+		return ret;
 
-static int hcs12sm_eeprom_write(const char *file)
-{
-	return hcs12mcu_eeprom_write(file, HCS12SM_BLOCK_SIZE_MAX, hcs12sm_cmd_write_block);
-}
+	switch (b)
+	{
+		case HCS12_AGENT_ERROR_NONE:
+			return 0;
 
+		case HCS12_AGENT_ERROR_SUM:
+			error("communication failed, checksum error\n");
+			return EIO;
 
-/*
- *  protect target EEPROM
- *
- *  in:
- *    opt - protection option string
- *  out:
- *    status code (errno-like)
- */
+		case HCS12_AGENT_ERROR_PGM:
+			error("programming failed (access error or protection violation)\n");
+			return EIO;
 
-static int hcs12sm_eeprom_protect(const char *opt)
-{
-	return hcs12mcu_eeprom_protect(opt, hcs12sm_cmd_write_word);
+		default:
+			error("invalid response\n");
+			return EIO;
+	}
 }
 
 
 /*
- *  FLASH read callback
+ *  read data block from turbo mode agent
  *
  *  in:
- *    addr - FLASH linear address
- *    size - block size
+ *    cmd - command
+ *    param - parameter block
+ *    n - parameter block size
  *    buf - data buffer
+ *    size - data size
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12sm_flash_read_cb(uint32_t addr, void *buf, size_t size)
+static int hcs12sm_agent_read(uint8_t cmd, const uint8_t *param, size_t n,
+	void *buf, size_t size)
 {
+	uint8_t sum;
+	uint8_t b;
+	size_t i;
 	int ret;
 
-	ret = hcs12sm_cmd_write_byte(HCS12_IO_PPAGE, hcs12mcu_linear_to_ppage(addr));
+	ret = hcs12sm_agent_cmd(cmd, param, n);
 	if (ret != 0)
 		return ret;
 
-	ret = hcs12sm_cmd_read_block((uint16_t)
-		(HCS12_FLASH_PAGE_BANKED_ADDR + (addr % HCS12_FLASH_PAGE_SIZE)),
-		buf, size);
+	ret = hcs12sm_rx(buf, size, HCS12SM_TURBO_RX_TIMEOUT);
 	if (ret != 0)
 		return ret;
 
-	return 0;
-}
+	ret = hcs12sm_rx(&b, 1, HCS12SM_TURBO_RX_TIMEOUT);
+	if (ret != 0)
+		return ret;
 
+	sum = 0;
+	for (i = 0; i < size; ++ i)
+		sum += ((uint8_t *)buf)[i];
 
-/*
- *  read target FLASH
- *
- *  in:
- *    file - file name to write
- *  out:
- *    status code (errno-like)
- */
+	if (sum != b)
+	{
+		error("invalid checksum received\n");
+		return EIO;
+	}
 
-static int hcs12sm_flash_read(const char *file)
-{
-	return hcs12mcu_flash_read(file, HCS12SM_BLOCK_SIZE_MAX, hcs12sm_flash_read_cb);
+	return 0;
 }
 
 
 /*
- *  FLASH write callback
+ *  write data block via turbo mode agent
  *
  *  in:
- *    addr - FLASH linear address
- *    size - block size
+ *    cmd - command
+ *    param - parameter block
+ *    n - parameter block size
  *    buf - data buffer
+ *    size - data size
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12sm_flash_write_cb(uint32_t addr, const void *buf, size_t size)
+static int hcs12sm_agent_write(uint8_t cmd, const uint8_t *param, size_t n,
+	const void *buf, size_t size)
 {
+	uint8_t b[HCS12SM_TURBO_BLOCK_SIZE + 1];
+	size_t i;
 	int ret;
-	uint8_t ppage;
-	uint16_t a;
-
-	ppage = hcs12mcu_linear_to_ppage(addr);
-	a = (uint16_t)hcs12mcu_flash_addr_window(addr);
 
-	ret = hcs12sm_cmd_write_byte(HCS12_IO_FCNFG, hcs12mcu_linear_to_block(addr));
-	if (ret != 0)
-		return ret;
+	if (size == 0 || size > HCS12SM_TURBO_BLOCK_SIZE)
+		return EINVAL;
 
-	ret = hcs12sm_cmd_write_byte(HCS12_IO_PPAGE, ppage);
+	ret = hcs12sm_agent_cmd(cmd, param, n);
 	if (ret != 0)
 		return ret;
 
-	/* if requested address covers serial monitor image in FLASH,
-	   change address into direct address from last FLASH page */
-
-	if (ppage == hcs12mcu_target.ppage_base + hcs12mcu_target.ppage_count - 1 &&
-	    a >= hcs12mcu_flash_addr_window(HCS12SM_FLASH_IMAGE_START))
-		a += HCS12_FLASH_PAGE_SIZE;
+	memcpy(b, buf, size);
+	b[size] = 0;
+	for (i = 0; i < size; ++ i)
+		b[size] += b[i];
 
-	ret = hcs12sm_cmd_write_block(a, buf, size);
+	++ size;
+	ret = serial_write(&hcs12sm_serial, b, &size, HCS12SM_TX_TIMEOUT);
 	if (ret != 0)
 		return ret;
 
-	return 0;
+	return hcs12sm_agent_status();
 }
 
 
 /*
- *  write target FLASH
+ *  calculate SCI divisor for turbo mode baud rate
  *
  *  in:
- *    file - file name with data for programming
+ *    void
  *  out:
  *    status code (errno-like)
  */
 
-static int hcs12sm_flash_write(const char *file)
+static int hcs12sm_turbo_divisor(void)
 {
-	return hcs12mcu_flash_write(file, HCS12SM_BLOCK_SIZE_MAX, hcs12sm_flash_write_cb);
-}
+	uint16_t bd;
+	unsigned long bus;
+	unsigned long baud;
+	unsigned long e;
+	int ret;
 
+	hcs12sm_turbo_bd = 0;
 
-/*
- *  verify erasure of FLASH
- *
- *  in:
- *    void
- *  out:
- *    status code (errno-like)
- */
+	ret = hcs12sm_cmd_read_word(HCS12SM_IO_SCI0BD, &bd);
+	if (ret != 0)
+		return ret;
 
-static int hcs12sm_flash_erase_verify(void)
+	bd &= 0x1fff;
+	bus = (unsigned long)bd * 16 * options.baud;
+
+	if (options.sm_turbo_baud == 0 || options.sm_turbo_baud == options.baud)
+		return 0;
+
+	if (bd == 0)
+	{
+		error("SM turbo: SCI not initialized by monitor\n");
+		return EIO;
+	}
+
+	hcs12sm_turbo_bd = (uint16_t)((bus / 16 + options.sm_turbo_baud / 2) /
+		options.sm_turbo_baud);
+	if (hcs12sm_turbo_bd == 0)
+		hcs12sm_turbo_bd = 1;
+
+	baud = bus / 16 / hcs12sm_turbo_bd;
+	if (baud >= options.sm_turbo_baud)
+		e = baud - options.sm_turbo_baud;
+	else
+		e = options.sm_turbo_baud - baud;
+	e = e * 10000 / options.sm_turbo_baud;
+
+	if (options.verbose)
+	{
+		printf("SM turbo: bus clock <%lu.%06lu MHz> target <%lu bps> local <%lu bps> error <%u.%u%%>\n",
+		       (unsigned long)(bus / 1000000),
+		       (unsigned long)(bus % 1000000),
+		       (unsigned long)baud,
+		       (unsigned long)options.sm_turbo_baud,
+		       (unsigned int)(((e + 5) / 10) / 10),
+		       (unsigned int)(((e + 5) / 10) % 10));
+	}
+
+	if (e >= HCS12SM_TURBO_BAUD_ERROR_LIMIT)
+	{
+		if (options.verbose)
+		{
+			printf("SM turbo: baud rate not possible with target bus clock, staying at <%lu bps>\n",
+			       (unsigned long)options.baud);
+		}
+		hcs12sm_turbo_bd = 0;
+		return 0;
+	}
+
+	hcs12sm_turbo_loops = (uint16_t)(bus / 1000 * HCS12SM_TURBO_BAUD_TIMEOUT /
+		HCS12SM_TURBO_LOOP_CYCLES + 1);
+
+	return 0;
+}
+
+
+/*
+ *  switch turbo mode agent and serial port to higher baud rate,
+ *  fall back to monitor's baud rate when the target doesn't respond
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_turbo_baud(void)
+{
+	uint8_t param[4];
+	uint8_t b;
+	size_t size;
+	int i;
+	int ret;
+
+	uint16_host2be_to_buf(param + 0, hcs12sm_turbo_bd);
+	uint16_host2be_to_buf(param + 2, hcs12sm_turbo_loops);
+	ret = hcs12sm_agent_cmd(HCS12_AGENT_CMD_SCI_BAUD, param, sizeof(param));
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_set_baud(options.sm_turbo_baud);
+	if (ret == 0)
+	{
+		serial_flush(&hcs12sm_serial);
+		for (i = 0; i < HCS12SM_TURBO_SYNC_RETRIES; ++ i)
+		{
+			b = HCS12_AGENT_SCI_SYNC_MSG;
+			size = 1;
+			ret = serial_write(&hcs12sm_serial, &b, &size, HCS12SM_TX_TIMEOUT);
+			if (ret != 0)
+				return ret;
+
+			size = 1;
+			ret = serial_read(&hcs12sm_serial, &b, &size, HCS12SM_TURBO_SYNC_TIMEOUT);
+			if (ret == 0 && b == HCS12_AGENT_SCI_SYNC_ACK)
+			{
+				if (options.verbose)
+				{
+					printf("SM turbo: baud rate <%lu bps>\n",
+					       (unsigned long)options.sm_turbo_baud);
+				}
+				return 0;
+			}
+		}
+	}
+
+	/* agent restores monitor's divisor after its sync timeout */
+
+	if (options.verbose)
+	{
+		printf("SM turbo: no response at <%lu bps>, staying at <%lu bps>\n",
+		       (unsigned long)options.sm_turbo_baud,
+		       (unsigned long)options.baud);
+	}
+
+	hcs12sm_turbo_bd = 0;
+	sys_delay(2 * HCS12SM_TURBO_BAUD_TIMEOUT);
+
+	ret = hcs12sm_set_baud(options.baud);
+	if (ret != 0)
+		return ret;
+	serial_flush(&hcs12sm_serial);
+
+	ret = hcs12sm_agent_cmd(HCS12_AGENT_CMD_INIT, NULL, 0);
+	if (ret != 0)
+		return ret;
+
+	return hcs12sm_agent_status();
+}
+
+
+/*
+ *  enter turbo mode - load agent via monitor (once) and start it
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_turbo_start(void)
+{
+	const char *ptr;
+	char file[SYS_MAX_PATH + 1];
+	uint8_t b;
+	int i;
+	int ret;
+
+	if (hcs12sm_turbo_active)
+		return 0;
+
+	if (!hcs12sm_turbo_loaded)
+	{
+		ptr = hcs12mem_target_info("sm_agent", TRUE);
+		if (ptr == NULL)
+			ptr = HCS12SM_TURBO_AGENT;
+		if (access(ptr, R_OK) == -1 &&
+		    strchr(ptr, SYS_PATH_SEPARATOR) == NULL)
+		{
+			snprintf(file, sizeof(file), "%s%c%s",
+				 (const char *)hcs12mem_data_dir,
+				 (char)SYS_PATH_SEPARATOR,
+				 (const char *)ptr);
+		}
+		else
+			strlcpy(file, ptr, sizeof(file));
+
+		ret = hcs12sm_turbo_divisor();
+		if (ret != 0)
+			return ret;
+
+		ret = hcs12sm_ram_load(file, TRUE, &hcs12sm_turbo_entry);
+		if (ret != 0)
+			return ret;
+
+		hcs12sm_turbo_loaded = TRUE;
+	}
+
+	ret = hcs12sm_cmd_write_pc(hcs12sm_turbo_entry);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_cmd_go();
+	if (ret != 0)
+		return ret;
+
+	/* skip anything monitor sends on GO, up to agent presence byte */
+
+	for (i = 0; i < 16; ++ i)
+	{
+		ret = hcs12sm_rx(&b, 1, HCS12SM_TURBO_RX_TIMEOUT);
+		if (ret != 0)
+			return ret;
+		if (b == HCS12_AGENT_ERROR_NONE)
+			break;
+	}
+	if (i == 16)
+	{
+		error("SM turbo: agent not responding\n");
+		return EIO;
+	}
+
+	hcs12sm_turbo_active = TRUE;
+
+	if (options.debug)
+		printf("SM turbo: agent started\n");
+
+	if (hcs12sm_turbo_bd != 0)
+	{
+		ret = hcs12sm_turbo_baud();
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  leave turbo mode - return control to monitor
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_turbo_stop(void)
+{
+	int ret;
+
+	if (!hcs12sm_turbo_active)
+		return 0;
+
+	hcs12sm_turbo_active = FALSE;
+
+	ret = hcs12sm_agent_cmd(HCS12_AGENT_CMD_EXIT, NULL, 0);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_set_baud(options.baud);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_prompt(TRUE);
+	if (ret != 0)
+		return ret;
+
+	if (options.debug)
+		printf("SM turbo: control returned to monitor\n");
+
+	return 0;
+}
+
+
+/*
+ *  load code and run from target RAM
+ *
+ *  in:
+ *    file - data file name to read
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_ram_run(const char *file)
+{
+	uint16_t entry;
+	int ret;
+
+	ret = hcs12sm_ram_load(file, FALSE, &entry);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_cmd_write_pc(entry);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_cmd_go();
+	if (ret != 0)
+		return ret;
+
+	if (options.verbose)
+		printf("RAM run: image loaded and started\n");
+
+	return 0;
+}
+
+
+/*
+ *  close connection with target via sm bootloader
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_close(void)
+{
+	hcs12sm_turbo_stop();
+	return serial_close(&hcs12sm_serial);
+}
+
+
+/*
+ *  verify erasure of EEPROM
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_eeprom_erase_verify(void)
+{
+	int ret;
+	uint32_t i;
+	uint8_t buf[HCS12SM_BLOCK_SIZE_MAX];
+	int j;
+
+	for (i = 0; i < hcs12mcu_target.eeprom_size; i += HCS12SM_BLOCK_SIZE_MAX)
+	{
+		ret = hcs12sm_cmd_read_block(
+			(uint16_t)(i + hcs12mcu_target.eeprom_base),
+			buf, HCS12SM_BLOCK_SIZE_MAX);
+		if (ret != 0)
+			return ret;
+		for (j = 0; j < HCS12SM_BLOCK_SIZE_MAX; ++j)
+		{
+			if (buf[j] != 0xff)
+			{
+				error("EEPROM memory not erased: value 0x%02X @ 0x%04X\n",
+				      (unsigned int)buf[j],
+				      (unsigned int)(i + hcs12mcu_target.eeprom_base));
+				return EIO;
+			}
+		}
+	}
+
+	if (options.verbose)
+		printf("EEPROM erase: memory verified\n");
+
+	return 0;
+}
+
+
+/*
+ *  erase target EEPROM
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_eeprom_erase(void)
+{
+	int ret;
+
+	if (hcs12mcu_target.eeprom_size == 0)
+	{
+		error("EEPROM erase not possible - no EEPROM memory\n");
+		return EINVAL;
+	}
+
+	ret = hcs12sm_cmd(HCS12SM_CMD_ERASE_EEPROM, NULL, 0, NULL, 0);
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_prompt(FALSE);
+	if (ret != 0)
+		return ret;
+
+	if (options.verbose)
+		printf("EEPROM erase: memory erased\n");
+
+	if (options.verify)
+	{
+		ret = hcs12sm_eeprom_erase_verify();
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  EEPROM read callback for turbo mode
+ *
+ *  in:
+ *    addr - EEPROM address
+ *    buf - data buffer
+ *    size - block size
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_eeprom_read_cb_turbo(uint16_t addr, void *buf, size_t size)
+{
+	uint8_t param[4];
+
+	uint16_host2be_to_buf(param + 0, addr);
+	uint16_host2be_to_buf(param + 2, (uint16_t)size);
+
+	return hcs12sm_agent_read(HCS12_AGENT_CMD_EEPROM_READ,
+		param, sizeof(param), buf, size);
+}
+
+
+/*
+ *  EEPROM write callback for turbo mode
+ *
+ *  in:
+ *    addr - EEPROM address
+ *    buf - data buffer
+ *    size - block size
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_eeprom_write_cb_turbo(uint16_t addr, const void *buf, size_t size)
+{
+	uint8_t param[4];
+
+	uint16_host2be_to_buf(param + 0, addr);
+	uint16_host2be_to_buf(param + 2, (uint16_t)size);
+
+	return hcs12sm_agent_write(HCS12_AGENT_CMD_EEPROM_WRITE,
+		param, sizeof(param), buf, size);
+}
+
+
+/*
+ *  read target EEPROM
+ *
+ *  in:
+ *    file - file name to write EEPROM data
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_eeprom_read(const char *file)
+{
+	int ret;
+
+	if (!options.sm_turbo)
+		return hcs12mcu_eeprom_read(file, HCS12SM_BLOCK_SIZE_MAX, hcs12sm_cmd_read_block);
+
+	ret = hcs12sm_turbo_start();
+	if (ret == 0)
+		ret = hcs12mcu_eeprom_read(file, HCS12SM_TURBO_BLOCK_SIZE, hcs12sm_eeprom_read_cb_turbo);
+	if (hcs12sm_turbo_stop() != 0 && ret == 0)
+		ret = EIO;
+
+	return ret;
+}
+
+
+/*
+ *  write target EEPROM
+ *
+ *  in:
+ *    file - file name with data to write
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_eeprom_write(const char *file)
+{
+	int ret;
+
+	if (!options.sm_turbo)
+		return hcs12mcu_eeprom_write(file, HCS12SM_BLOCK_SIZE_MAX, hcs12sm_cmd_write_block);
+
+	ret = hcs12sm_turbo_start();
+	if (ret == 0)
+		ret = hcs12mcu_eeprom_write(file, HCS12SM_TURBO_BLOCK_SIZE, hcs12sm_eeprom_write_cb_turbo);
+	if (hcs12sm_turbo_stop() != 0 && ret == 0)
+		ret = EIO;
+
+	return ret;
+}
+
+
+/*
+ *  protect target EEPROM
+ *
+ *  in:
+ *    opt - protection option string
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_eeprom_protect(const char *opt)
+{
+	return hcs12mcu_eeprom_protect(opt, hcs12sm_cmd_write_word);
+}
+
+
+/*
+ *  FLASH read callback
+ *
+ *  in:
+ *    addr - FLASH linear address
+ *    size - block size
+ *    buf - data buffer
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_flash_read_cb(uint32_t addr, void *buf, size_t size)
+{
+	int ret;
+
+	ret = hcs12sm_cmd_write_byte(HCS12_IO_PPAGE, hcs12mcu_linear_to_ppage(addr));
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_cmd_read_block((uint16_t)
+		(HCS12_FLASH_PAGE_BANKED_ADDR + (addr % HCS12_FLASH_PAGE_SIZE)),
+		buf, size);
+	if (ret != 0)
+		return ret;
+
+	return 0;
+}
+
+
+/*
+ *  FLASH read callback for turbo mode
+ *
+ *  in:
+ *    addr - FLASH linear address
+ *    size - block size
+ *    buf - data buffer
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_flash_read_cb_turbo(uint32_t addr, void *buf, size_t size)
+{
+	uint8_t param[6];
+
+	param[0] = hcs12mcu_linear_to_block(addr);
+	param[1] = hcs12mcu_linear_to_ppage(addr);
+	uint16_host2be_to_buf(param + 2, (uint16_t)hcs12mcu_flash_addr_window(addr));
+	uint16_host2be_to_buf(param + 4, (uint16_t)size);
+
+	return hcs12sm_agent_read(HCS12_AGENT_CMD_FLASH_READ,
+		param, sizeof(param), buf, size);
+}
+
+
+/*
+ *  read target FLASH
+ *
+ *  in:
+ *    file - file name to write
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_flash_read(const char *file)
+{
+	int ret;
+
+	if (!options.sm_turbo)
+		return hcs12mcu_flash_read(file, HCS12SM_BLOCK_SIZE_MAX, hcs12sm_flash_read_cb);
+
+	ret = hcs12sm_turbo_start();
+	if (ret == 0)
+		ret = hcs12mcu_flash_read(file, HCS12SM_TURBO_READ_CHUNK, hcs12sm_flash_read_cb_turbo);
+	if (hcs12sm_turbo_stop() != 0 && ret == 0)
+		ret = EIO;
+
+	return ret;
+}
+
+
+/*
+ *  FLASH write callback
+ *
+ *  in:
+ *    addr - FLASH linear address
+ *    size - block size
+ *    buf - data buffer
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_flash_write_cb(uint32_t addr, const void *buf, size_t size)
+{
+	int ret;
+	uint8_t ppage;
+	uint16_t a;
+
+	ppage = hcs12mcu_linear_to_ppage(addr);
+	a = (uint16_t)hcs12mcu_flash_addr_window(addr);
+
+	ret = hcs12sm_cmd_write_byte(HCS12_IO_FCNFG, hcs12mcu_linear_to_block(addr));
+	if (ret != 0)
+		return ret;
+
+	ret = hcs12sm_cmd_write_byte(HCS12_IO_PPAGE, ppage);
+	if (ret != 0)
+		return ret;
+
+	/* if requested address covers serial monitor image in FLASH,
+	   change address into direct address from last FLASH page */
+
+	if (ppage == hcs12mcu_target.ppage_base + hcs12mcu_target.ppage_count - 1 &&
+	    a >= hcs12mcu_flash_addr_window(HCS12SM_FLASH_IMAGE_START))
+		a += HCS12_FLASH_PAGE_SIZE;
+
+	ret = hcs12sm_cmd_write_block(a, buf, size);
+	if (ret != 0)
+		return ret;
+
+	return 0;
+}
+
+
+/*
+ *  FLASH write callback for turbo mode
+ *
+ *  in:
+ *    addr - FLASH linear address
+ *    size - block size
+ *    buf - data buffer
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_flash_write_cb_turbo(uint32_t addr, const void *buf, size_t size)
+{
+	uint8_t param[6];
+	uint8_t ppage;
+	uint32_t a;
+	uint32_t image;
+
+	ppage = hcs12mcu_linear_to_ppage(addr);
+	a = hcs12mcu_flash_addr_window(addr);
+	image = hcs12mcu_flash_addr_window(HCS12SM_FLASH_IMAGE_START);
+
+	/* data written so far is programmed, unless some of it waits
+	   for the monitor */
+
+	if (!hcs12sm_turbo_deferred)
+		hcs12mcu_flash_confirm();
+
+	/* monitor image area (with user vectors redirection) is left
+	   for the monitor itself, see hcs12sm_flash_write_monitor() */
+
+	if (ppage == hcs12mcu_target.ppage_base + hcs12mcu_target.ppage_count - 1 &&
+	    a >= image)
+	{
+		memcpy(hcs12sm_turbo_defer + (a - image), buf, size);
+		hcs12sm_turbo_defer_addr = addr - (a - image);
+		hcs12sm_turbo_deferred = TRUE;
+		return 0;
+	}
+
+	param[0] = hcs12mcu_linear_to_block(addr);
+	param[1] = ppage;
+	uint16_host2be_to_buf(param + 2, (uint16_t)a);
+	uint16_host2be_to_buf(param + 4, (uint16_t)size);
+
+	return hcs12sm_agent_write(HCS12_AGENT_CMD_FLASH_WRITE,
+		param, sizeof(param), buf, size);
+}
+
+
+/*
+ *  finish FLASH write in turbo mode - data covering monitor image area
+ *  is programmed by the monitor, after turbo mode agent exits
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_flash_write_monitor(void)
+{
+	uint32_t i, j;
+	int ret;
+
+	if (hcs12sm_turbo_stop() != 0)
+		return EIO;
+	if (!hcs12sm_turbo_deferred)
+		return 0;
+
+	for (i = 0; i < HCS12SM_FLASH_IMAGE_SIZE; i += HCS12SM_BLOCK_SIZE_MAX)
+	{
+		for (j = 0; j < HCS12SM_BLOCK_SIZE_MAX; ++ j)
+		{
+			if (hcs12sm_turbo_defer[i + j] != 0xff)
+				break;
+		}
+		if (j == HCS12SM_BLOCK_SIZE_MAX)
+			continue;
+
+		ret = hcs12sm_flash_write_cb(hcs12sm_turbo_defer_addr + i,
+			hcs12sm_turbo_defer + i, HCS12SM_BLOCK_SIZE_MAX);
+		if (ret != 0)
+			return ret;
+	}
+
+	if (options.verbose)
+		printf("FLASH write: monitor area data written via monitor\n");
+
+	return 0;
+}
+
+
+/*
+ *  write target FLASH
+ *
+ *  in:
+ *    file - file name with data for programming
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_flash_write(const char *file)
+{
+	int ret;
+
+	ret = hcs12mcu_flash_cost(HCS12SM_COST_OVERHEAD,
+		(uint32_t)((options.sm_turbo && options.sm_turbo_baud != 0 ?
+		options.sm_turbo_baud : options.baud) / 10),
+		HCS12_FLASH_WORD_TIME);
+	if (ret != 0)
+		return ret;
+
+	if (!options.sm_turbo)
+	{
+		hcs12mcu_flash_readback(hcs12sm_flash_read_cb);
+		return hcs12mcu_flash_write(file, HCS12SM_BLOCK_SIZE_MAX, hcs12sm_flash_write_cb);
+	}
+
+	memset(hcs12sm_turbo_defer, 0xff, sizeof(hcs12sm_turbo_defer));
+	hcs12sm_turbo_deferred = FALSE;
+
+	/* data deferred for the monitor is recorded in the journal only
+	   after the monitor has programmed it */
+
+	hcs12mcu_flash_readback(hcs12sm_flash_read_cb_turbo);
+	ret = hcs12sm_turbo_start();
+	if (ret == 0)
+	{
+		hcs12mcu_flash_defer(hcs12sm_flash_write_monitor);
+		ret = hcs12mcu_flash_write(file, HCS12SM_TURBO_BLOCK_SIZE, hcs12sm_flash_write_cb_turbo);
+	}
+	if (hcs12sm_turbo_stop() != 0 && ret == 0)
+		ret = EIO;
+
+	return ret;
+}
+
+
+/*
+ *  verify erasure of FLASH
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int hcs12sm_flash_erase_verify(void)
 {
 	int ret;
 	uint32_t size;
@@ -866,5 +1815,7 @@ hcs12mem_target_handler_t hcs12mem_target_handler_sm =
 	hcs12sm_flash_erase,
 	hcs12sm_flash_write,
 	NULL,
-	hcs12sm_reset
+	hcs12sm_reset,
+	NULL,
+	NULL
 };
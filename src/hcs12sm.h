@@ -29,6 +29,7 @@
 #define HCS12SM_PROMPT_TIMEOUT  1000 /* ms */
 #define HCS12SM_FLUSH_TIMEOUT    100
 #define HCS12SM_BLOCK_SIZE_MAX   256
+#define HCS12SM_COST_OVERHEAD   3000 /* us, command and prompt latency */
 
 #define HCS12SM_SYNC_QUERY      0x0d
 #define HCS12SM_PROMPT_SYMBOL   '>'
@@ -40,6 +41,20 @@
 #define HCS12SM_FLASH_ID_ADDR     0xfef8
 #define HCS12SM_FLASH_ID_SIZE     8
 
+/* turbo mode - high speed RAM agent loaded via monitor */
+
+#define HCS12SM_TURBO_AGENT          "sm.s19"
+#define HCS12SM_TURBO_BLOCK_SIZE      256 /* agent buffer size */
+#define HCS12SM_TURBO_READ_CHUNK     1024
+#define HCS12SM_TURBO_RX_TIMEOUT     2000 /* ms */
+#define HCS12SM_TURBO_SYNC_RETRIES     10
+#define HCS12SM_TURBO_SYNC_TIMEOUT     50 /* ms */
+#define HCS12SM_TURBO_BAUD_TIMEOUT   1000 /* ms, agent waits for sync */
+#define HCS12SM_TURBO_BAUD_ERROR_LIMIT 390 /* 3.9% */
+#define HCS12SM_TURBO_LOOP_CYCLES  524288 /* bus cycles of agent wait loop */
+
+#define HCS12SM_IO_SCI0BD        0x00c8
+
 #define HCS12SM_CMD_READ_BYTE    0xa1
 #define HCS12SM_CMD_WRITE_BYTE   0xa2
 #define HCS12SM_CMD_READ_WORD    0xa3
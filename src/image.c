@@ -0,0 +1,644 @@
+/*
+    hcs12mem - HC12/S12 memory reader & writer
+    Copyright (C) 2005,2006,2007 Michal Konieczny <mk@cml.mfk.net.pl>
+
+    image.c: image file loaders (S-record, Intel HEX, binary, ELF)
+
+    $Id$
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "hcs12mem.h"
+#include "srec.h"
+#include "image.h"
+
+/* address translation is linear within 16kB windows (FLASH pages),
+   so data blocks are stored by windows */
+
+#define IMAGE_WINDOW 0x4000
+
+/* entry address not given in file */
+
+#define IMAGE_NO_ENTRY 0xffffffff
+
+/* image being loaded */
+
+typedef struct
+{
+	uint8_t *buf;
+	size_t buf_len;
+	uint32_t (*atc)(uint32_t addr);
+	uint8_t *map;
+	uint32_t *addr_min;
+	uint32_t *addr_max;
+}
+image_t;
+
+
+/*
+ *  default address translation
+ */
+
+static uint32_t image_addr_straight(uint32_t addr)
+{
+	return addr;
+}
+
+
+/*
+ *  store data block into image
+ *
+ *  in:
+ *    img - image
+ *    addr - block address (before translation)
+ *    data - block data
+ *    len - block length
+ *  out:
+ *    status code (errno-like), EINVAL when block is out of range
+ */
+
+static int image_store(image_t *img, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+	uint32_t lo, hi;
+	uint32_t n;
+
+	while (len > 0)
+	{
+		n = IMAGE_WINDOW - (addr % IMAGE_WINDOW);
+		if (n > len)
+			n = len;
+
+		lo = (*img->atc)(addr);
+		hi = (*img->atc)(addr + n - 1);
+		if (lo >= (uint32_t)img->buf_len || hi >= (uint32_t)img->buf_len ||
+		    hi - lo != n - 1)
+			return EINVAL;
+
+		memcpy(img->buf + lo, data, (size_t)n);
+		if (img->map != NULL)
+			memset(img->map + lo, 1, (size_t)n);
+		if (img->addr_min != NULL && lo < *img->addr_min)
+			*img->addr_min = lo;
+		if (img->addr_max != NULL && hi > *img->addr_max)
+			*img->addr_max = hi;
+
+		addr += n;
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  convert two chars from string into hex number
+ *
+ *  in:
+ *    str - string to convert (2 chars are taken into conversion)
+ *    b - hex number, on return
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int image_str2hex(const char *str, uint8_t *b)
+{
+	int i;
+
+	*b = 0;
+	for (i = 0; i < 2; ++ i)
+	{
+		if (!isxdigit((unsigned char)str[i]))
+			return EINVAL;
+
+		*b *= 0x10;
+		if (isupper((unsigned char)str[i]))
+			*b += str[i] - 'A' + 0x0a;
+		else if (islower((unsigned char)str[i]))
+			*b += str[i] - 'a' + 0x0a;
+		else
+			*b += str[i] - '0';
+	}
+
+	return 0;
+}
+
+
+/*
+ *  parse Intel HEX line
+ *
+ *  in:
+ *    str - Intel HEX text
+ *    type - record type (on return)
+ *    cnt - bytes count (on return)
+ *    addr - record address (on return)
+ *    data - data buffer (written on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int image_ihex_parse(const char *str, uint8_t *type, uint8_t *cnt,
+	uint16_t *addr, uint8_t *data)
+{
+	uint8_t b[4];
+	uint8_t sum;
+	int i;
+
+	if (*str++ != IHEX_HEADER)
+		return EINVAL;
+
+	for (i = 0; i < 4; ++ i, str += 2)
+	{
+		if (image_str2hex(str, &b[i]) != 0)
+			return EINVAL;
+	}
+	*cnt = b[0];
+	*addr = (uint16_t)((b[1] << 8) | b[2]);
+	*type = b[3];
+	sum = (uint8_t)(b[0] + b[1] + b[2] + b[3]);
+
+	for (i = 0; i < (int)*cnt; ++ i, str += 2)
+	{
+		if (image_str2hex(str, &data[i]) != 0)
+			return EINVAL;
+		sum += data[i];
+	}
+
+	if (image_str2hex(str, &b[0]) != 0)
+		return EINVAL;
+	if ((uint8_t)(sum + b[0]) != 0)
+		return EINVAL;
+	str += 2;
+
+	/* end of line */
+
+	if (*str != '\0' && *str != '\r' && *str != '\n')
+		return EINVAL;
+
+	return 0;
+}
+
+
+/*
+ *  read Intel HEX file
+ *
+ *  in:
+ *    file - file name to read
+ *    img - image
+ *    entry_raw - entry address (on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int image_read_ihex(const char *file, image_t *img, uint32_t *entry_raw)
+{
+	FILE *f;
+	char str[IHEX_LINE_LEN_MAX + 1];
+	uint8_t data[256];
+	uint32_t base;
+	uint16_t addr;
+	uint8_t type;
+	uint8_t cnt;
+	int line;
+	int ret;
+
+	f = fopen(file, "rt");
+	if (f == NULL)
+	{
+		ret = errno;
+		error("unable to open %s (%s)\n",
+		      (const char *)file,
+		      (const char *)strerror(ret));
+		return ret;
+	}
+
+	ret = 0;
+	base = 0;
+	line = 0;
+	while (ret == 0 && line != -1 && fgets(str, sizeof(str), f) != NULL)
+	{
+		++ line;
+
+		if (str[0] == '\r' || str[0] == '\n' || str[0] == '\0')
+			continue;
+
+		if (image_ihex_parse(str, &type, &cnt, &addr, data) != 0)
+		{
+			error("%s:%u: invalid Intel HEX record\n",
+				(const char *)file,
+				(unsigned int)line
+				);
+			ret = EINVAL;
+			break;
+		}
+
+		/* address records carry fixed size address */
+
+		if (((type == IHEX_TYPE_SEGMENT_ADDR || type == IHEX_TYPE_LINEAR_ADDR) && cnt != 2) ||
+		    ((type == IHEX_TYPE_SEGMENT_START || type == IHEX_TYPE_LINEAR_START) && cnt != 4))
+		{
+			error("%s:%u: invalid Intel HEX address record length\n",
+				(const char *)file,
+				(unsigned int)line
+				);
+			ret = EINVAL;
+			break;
+		}
+
+		switch (type)
+		{
+			case IHEX_TYPE_DATA:
+				if (cnt == 0)
+					break;
+				ret = image_store(img, base + addr, data, cnt);
+				if (ret != 0)
+				{
+					error("%s:%u: data block address <0x%lX> out of range\n",
+						(const char *)file,
+						(unsigned int)line,
+						(unsigned long)(base + addr)
+						);
+				}
+				break;
+
+			case IHEX_TYPE_EOF:
+				line = -1;
+				break;
+
+			case IHEX_TYPE_SEGMENT_ADDR:
+				base = ((uint32_t)data[0] << 12) | ((uint32_t)data[1] << 4);
+				break;
+
+			case IHEX_TYPE_LINEAR_ADDR:
+				base = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16);
+				break;
+
+			case IHEX_TYPE_SEGMENT_START:
+				*entry_raw = ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+				break;
+
+			case IHEX_TYPE_LINEAR_START:
+				*entry_raw = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+					((uint32_t)data[2] << 8) | (uint32_t)data[3];
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	fclose(f);
+	return ret;
+}
+
+
+/*
+ *  read raw binary file - file is a linear image, placed at address
+ *  given by --binary-base option (at image start by default)
+ *
+ *  in:
+ *    file - file name to read
+ *    img - image
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int image_read_bin(const char *file, image_t *img)
+{
+	sys_map_t m;
+	uint32_t lo;
+	int ret;
+
+	ret = sys_map_open(&m, file);
+	if (ret != 0)
+	{
+		error("unable to open %s (%s)\n",
+		      (const char *)file,
+		      (const char *)strerror(ret));
+		return ret;
+	}
+
+	lo = (options.binary_base_valid ? (*img->atc)(options.binary_base) : 0);
+	if (lo >= (uint32_t)img->buf_len ||
+	    m.size > img->buf_len - (size_t)lo)
+	{
+		error("%s: binary image <0x%lX> bytes at <0x%lX> out of range\n",
+			(const char *)file,
+			(unsigned long)m.size,
+			(unsigned long)options.binary_base
+			);
+		sys_map_close(&m);
+		return EINVAL;
+	}
+
+	if (m.size != 0)
+	{
+		memcpy(img->buf + lo, m.data, m.size);
+		if (img->map != NULL)
+			memset(img->map + lo, 1, m.size);
+		if (img->addr_min != NULL && lo < *img->addr_min)
+			*img->addr_min = lo;
+		if (img->addr_max != NULL && lo + (uint32_t)m.size - 1 > *img->addr_max)
+			*img->addr_max = lo + (uint32_t)m.size - 1;
+	}
+
+	sys_map_close(&m);
+	return 0;
+}
+
+
+/*
+ *  get big endian values from ELF file
+ */
+
+static uint32_t image_elf32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static uint16_t image_elf16(const uint8_t *p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+
+/*
+ *  read ELF file - PT_LOAD segments are loaded at their physical
+ *  (load) addresses, translated like S-record addresses, so banked
+ *  LMAs are handled by selected FLASH address format
+ *
+ *  in:
+ *    file - file name to read
+ *    img - image
+ *    entry_raw - entry address (on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int image_read_elf(const char *file, image_t *img, uint32_t *entry_raw)
+{
+	sys_map_t m;
+	const uint8_t *ph;
+	uint32_t phoff;
+	uint32_t offset;
+	uint32_t paddr;
+	uint32_t filesz;
+	uint16_t phentsize;
+	uint16_t phnum;
+	uint16_t i;
+	int ret;
+
+	ret = sys_map_open(&m, file);
+	if (ret != 0)
+	{
+		error("unable to open %s (%s)\n",
+		      (const char *)file,
+		      (const char *)strerror(ret));
+		return ret;
+	}
+
+	ret = EINVAL;
+	if (m.size < ELF_EHDR_SIZE ||
+	    m.data[4] != ELF_CLASS_32 || m.data[5] != ELF_DATA_MSB)
+	{
+		error("%s: not a 32-bit big endian ELF file\n",
+		      (const char *)file);
+		goto done;
+	}
+	if (image_elf16(m.data + 16) != ELF_TYPE_EXEC ||
+	    image_elf16(m.data + 18) != ELF_MACHINE_68HC12)
+	{
+		error("%s: not a 68HC12 ELF executable\n",
+		      (const char *)file);
+		goto done;
+	}
+
+	*entry_raw = image_elf32(m.data + 24);
+	phoff = image_elf32(m.data + 28);
+	phentsize = image_elf16(m.data + 42);
+	phnum = image_elf16(m.data + 44);
+	if (phentsize < ELF_PHDR_SIZE || phoff > m.size ||
+	    (size_t)phnum * phentsize > m.size - phoff)
+	{
+		error("%s: invalid ELF program header table\n",
+		      (const char *)file);
+		goto done;
+	}
+
+	for (i = 0; i < phnum; ++ i)
+	{
+		ph = m.data + phoff + (uint32_t)i * phentsize;
+		if (image_elf32(ph) != ELF_PT_LOAD)
+			continue;
+
+		offset = image_elf32(ph + 4);
+		paddr = image_elf32(ph + 12);
+		filesz = image_elf32(ph + 16);
+		if (filesz == 0)
+			continue;
+
+		if (offset > m.size || filesz > m.size - offset)
+		{
+			error("%s: ELF segment %u beyond end of file\n",
+			      (const char *)file,
+			      (unsigned int)i);
+			goto done;
+		}
+
+		if (image_store(img, paddr, m.data + offset, filesz) != 0)
+		{
+			error("%s: ELF segment %u address <0x%lX> out of range\n",
+			      (const char *)file,
+			      (unsigned int)i,
+			      (unsigned long)paddr);
+			goto done;
+		}
+	}
+	ret = 0;
+
+done:
+	sys_map_close(&m);
+	return ret;
+}
+
+
+/*
+ *  read image file, format is taken from file name extension (.bin)
+ *  or from file contents (ELF, Intel HEX, S-record), marking bytes
+ *  present in file
+ *
+ *  in:
+ *    file - file name to read (NULL - S-record from standard input)
+ *    info - buffer for info record data (on return)
+ *    info_len - length of buffer for info record data
+ *    buf - buffer for data
+ *    buf_len - data buffer length
+ *    entry_raw - entry address, as given in file (on return)
+ *    entry - translated entry address (on return)
+ *    addr_min - minimum address encountered (on return)
+ *    addr_max - maximum address encountered (on return)
+ *    atc - address translation callback
+ *    map - byte map, entries for data read from file are set to 1
+ *          (may be NULL)
+ *  out:
+ *    status code (errno-like)
+ */
+
+int image_read_map(
+	const char *file,
+	char *info,
+	size_t info_len,
+	void *buf,
+	size_t buf_len,
+	uint32_t *entry_raw,
+	uint32_t *entry,
+	uint32_t *addr_min,
+	uint32_t *addr_max,
+	uint32_t (*atc)(uint32_t addr),
+	uint8_t *map
+	)
+{
+	image_t img;
+	const char *ext;
+	uint32_t start;
+	char head[4];
+	FILE *f;
+	size_t n;
+	int ret;
+
+	if (file == NULL)
+	{
+		return srec_read_map(file, info, info_len, buf, buf_len,
+			entry_raw, entry, addr_min, addr_max, atc, map);
+	}
+
+	/* check file type */
+
+	ext = strrchr(file, '.');
+	if (ext != NULL && strcasecmp(ext, ".bin") == 0)
+		n = 0;
+	else
+	{
+		f = fopen(file, "rb");
+		if (f == NULL)
+		{
+			ret = errno;
+			error("unable to open %s (%s)\n",
+			      (const char *)file,
+			      (const char *)strerror(ret));
+			return ret;
+		}
+		n = fread(head, 1, sizeof(head), f);
+		fclose(f);
+
+		if (n > 0 && head[0] == SREC_HEADER)
+		{
+			return srec_read_map(file, info, info_len, buf, buf_len,
+				entry_raw, entry, addr_min, addr_max, atc, map);
+		}
+	}
+
+	img.buf = (uint8_t *)buf;
+	img.buf_len = buf_len;
+	img.atc = (atc == NULL ? image_addr_straight : atc);
+	img.map = map;
+	img.addr_min = addr_min;
+	img.addr_max = addr_max;
+
+	if (info != NULL)
+		*info = '\0';
+	if (addr_min != NULL)
+		*addr_min = (uint32_t)buf_len;
+	if (addr_max != NULL)
+		*addr_max = 0;
+
+	start = IMAGE_NO_ENTRY;
+	if (n == 0)
+		ret = image_read_bin(file, &img);
+	else if (n == sizeof(head) && memcmp(head, "\177ELF", sizeof(head)) == 0)
+		ret = image_read_elf(file, &img, &start);
+	else if (head[0] == IHEX_HEADER)
+		ret = image_read_ihex(file, &img, &start);
+	else
+	{
+		error("%s: unknown image file format\n",
+		      (const char *)file);
+		ret = EINVAL;
+	}
+	if (ret != 0)
+		return ret;
+
+	/* entry is not known for binary files, when it is not given
+	   by other formats, return values are left untouched, like
+	   for S-record files without end record */
+
+	if (start == IMAGE_NO_ENTRY)
+		return 0;
+
+	if (entry_raw != NULL)
+		*entry_raw = start;
+	if (entry != NULL)
+	{
+		*entry = (*img.atc)(start);
+		if (start != 0 && *entry >= (uint32_t)buf_len)
+		{
+			error("%s: entry address <0x%lX> out of range\n",
+				(const char *)file,
+				(unsigned long)start
+				);
+			return EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ *  read image file
+ *
+ *  in:
+ *    file - file name to read
+ *    info - buffer for info record data (on return)
+ *    info_len - length of buffer for info record data
+ *    buf - buffer for data
+ *    buf_len - data buffer length
+ *    entry_raw - entry address, as given in file (on return)
+ *    entry - translated entry address (on return)
+ *    addr_min - minimum address encountered (on return)
+ *    addr_max - maximum address encountered (on return)
+ *    atc - address translation callback
+ *  out:
+ *    status code (errno-like)
+ */
+
+int image_read(
+	const char *file,
+	char *info,
+	size_t info_len,
+	void *buf,
+	size_t buf_len,
+	uint32_t *entry_raw,
+	uint32_t *entry,
+	uint32_t *addr_min,
+	uint32_t *addr_max,
+	uint32_t (*atc)(uint32_t addr)
+	)
+{
+	return image_read_map(file, info, info_len, buf, buf_len,
+		entry_raw, entry, addr_min, addr_max, atc, NULL);
+}
@@ -0,0 +1,86 @@
+/*
+    hcs12mem - HC12/S12 memory reader & writer
+    Copyright (C) 2005,2006,2007 Michal Konieczny <mk@cml.mfk.net.pl>
+
+    image.h: image file loaders (S-record, Intel HEX, binary, ELF)
+
+    $Id$
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __IMAGE_H
+#define __IMAGE_H
+
+/* Intel HEX record types */
+
+#define IHEX_HEADER            ':'
+#define IHEX_TYPE_DATA         0x00
+#define IHEX_TYPE_EOF          0x01
+#define IHEX_TYPE_SEGMENT_ADDR 0x02
+#define IHEX_TYPE_SEGMENT_START 0x03
+#define IHEX_TYPE_LINEAR_ADDR  0x04
+#define IHEX_TYPE_LINEAR_START 0x05
+
+/* max Intel HEX line length:
+   1 char: header
+   2 chars: record length
+   4 chars: address
+   2 chars: type
+   255*2 chars: data
+   2 chars: checksum
+   2 chars: CR/LF
+   1 char: NUL */
+
+#define IHEX_LINE_LEN_MAX (1 + 2 + 4 + 2 + 255 * 2 + 2 + 2 + 1)
+
+/* ELF32 definitions used by loader */
+
+#define ELF_EHDR_SIZE      52
+#define ELF_PHDR_SIZE      32
+#define ELF_CLASS_32       1
+#define ELF_DATA_MSB       2
+#define ELF_TYPE_EXEC      2
+#define ELF_MACHINE_68HC12 53
+#define ELF_PT_LOAD        1
+
+int image_read(
+	const char *file,
+	char *info,
+	size_t info_len,
+	void *buf,
+	size_t buf_len,
+	uint32_t *entry_raw,
+	uint32_t *entry,
+	uint32_t *addr_min,
+	uint32_t *addr_max,
+	uint32_t (*atc)(uint32_t addr)
+	);
+
+int image_read_map(
+	const char *file,
+	char *info,
+	size_t info_len,
+	void *buf,
+	size_t buf_len,
+	uint32_t *entry_raw,
+	uint32_t *entry,
+	uint32_t *addr_min,
+	uint32_t *addr_max,
+	uint32_t (*atc)(uint32_t addr),
+	uint8_t *map
+	);
+
+#endif /* __IMAGE_H */
@@ -0,0 +1,200 @@
+/*
+    hcs12mem - HC12/S12 memory reader & writer
+    Copyright (C) 2005,2006,2007 Michal Konieczny <mk@cml.mfk.net.pl>
+
+    pack.c: packed data transfer through target RAM agents
+
+    $Id$
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "hcs12mem.h"
+#include "pack.h"
+#include "../target/agent.h"
+
+/*
+ *  count bytes equal to the first one
+ *
+ *  in:
+ *    buf - data
+ *    limit - max count (at least 1)
+ *  out:
+ *    count
+ */
+
+static size_t pack_run(const uint8_t *buf, size_t limit)
+{
+	size_t n;
+
+	for (n = 1; n < limit && buf[n] == buf[0]; ++ n)
+		;
+	return n;
+}
+
+
+/*
+ *  check that packed data placed at agent buffer end can be unpacked
+ *  in place to buffer start - unpacked data must never overwrite
+ *  packed data not read yet
+ *
+ *  in:
+ *    in - packed data
+ *    in_len - packed data length
+ *    size - agent buffer size
+ *  out:
+ *    TRUE when data can be unpacked in place
+ */
+
+static int pack_inplace(const uint8_t *in, size_t in_len, size_t size)
+{
+	size_t i;
+	size_t n;
+
+	n = 0;
+	for (i = 0; i < in_len;)
+	{
+		if (in[i] < HCS12_AGENT_PACK_RUN)
+		{
+			n += (size_t)in[i] + 1;
+			i += (size_t)in[i] + 2;
+		}
+		else
+		{
+			n += (size_t)(in[i] - HCS12_AGENT_PACK_RUN) + HCS12_AGENT_PACK_RUN_MIN;
+			i += 2;
+		}
+		if (n > size - in_len + i)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+
+/*
+ *  pack data for agent (run-length encoding, format in agent.h)
+ *
+ *  in:
+ *    buf - data to pack
+ *    len - data length
+ *    out - buffer for packed data, size bytes long
+ *    size - agent buffer size
+ *    out_len - packed data length (on return)
+ *  out:
+ *    status code (errno-like), ENOSPC when packing does not pay off
+ *    or packed data cannot be unpacked in agent buffer
+ */
+
+int pack_encode(
+	const uint8_t *buf,
+	size_t len,
+	uint8_t *out,
+	size_t size,
+	size_t *out_len
+	)
+{
+	size_t i, j;
+	size_t n, k;
+	size_t limit;
+
+	n = 0;
+	for (i = 0; i < len;)
+	{
+		limit = len - i;
+		if (limit > HCS12_AGENT_PACK_RUN_MAX)
+			limit = HCS12_AGENT_PACK_RUN_MAX;
+		k = pack_run(buf + i, limit);
+		if (k >= HCS12_AGENT_PACK_RUN_MIN)
+		{
+			if (n + 2 > size)
+				return ENOSPC;
+			out[n ++] = (uint8_t)(HCS12_AGENT_PACK_RUN + k - HCS12_AGENT_PACK_RUN_MIN);
+			out[n ++] = buf[i];
+			i += k;
+			continue;
+		}
+
+		/* literal bytes up to next run */
+
+		for (j = i + 1; j < len && j - i < HCS12_AGENT_PACK_LITERAL_MAX; ++ j)
+		{
+			limit = len - j;
+			if (limit > HCS12_AGENT_PACK_RUN_MIN)
+				limit = HCS12_AGENT_PACK_RUN_MIN;
+			if (pack_run(buf + j, limit) == HCS12_AGENT_PACK_RUN_MIN)
+				break;
+		}
+		if (n + 1 + (j - i) > size)
+			return ENOSPC;
+		out[n ++] = (uint8_t)(j - i - 1);
+		memcpy(out + n, buf + i, j - i);
+		n += j - i;
+		i = j;
+	}
+
+	if (n >= len || !pack_inplace(out, n, size))
+		return ENOSPC;
+
+	*out_len = n;
+	return 0;
+}
+
+
+/*
+ *  unpack data received from agent
+ *
+ *  in:
+ *    in - packed data
+ *    in_len - packed data length
+ *    buf - buffer for unpacked data
+ *    len - expected unpacked data length
+ *  out:
+ *    status code (errno-like)
+ */
+
+int pack_decode(
+	const uint8_t *in,
+	size_t in_len,
+	uint8_t *buf,
+	size_t len
+	)
+{
+	size_t i;
+	size_t n, k;
+
+	n = 0;
+	for (i = 0; i < in_len;)
+	{
+		if (in[i] < HCS12_AGENT_PACK_RUN)
+		{
+			k = (size_t)in[i] + 1;
+			if (k > len - n || k > in_len - i - 1)
+				return EINVAL;
+			memcpy(buf + n, in + i + 1, k);
+			i += k + 1;
+		}
+		else
+		{
+			k = (size_t)(in[i] - HCS12_AGENT_PACK_RUN) + HCS12_AGENT_PACK_RUN_MIN;
+			if (k > len - n || i + 1 >= in_len)
+				return EINVAL;
+			memset(buf + n, in[i + 1], k);
+			i += 2;
+		}
+		n += k;
+	}
+
+	return (n == len ? 0 : EINVAL);
+}
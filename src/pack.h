@@ -0,0 +1,42 @@
+/*
+    hcs12mem - HC12/S12 memory reader & writer
+    Copyright (C) 2005,2006,2007 Michal Konieczny <mk@cml.mfk.net.pl>
+
+    pack.h: packed data transfer through target RAM agents
+
+    $Id$
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __PACK_H
+#define __PACK_H
+
+int pack_encode(
+	const uint8_t *buf,
+	size_t len,
+	uint8_t *out,
+	size_t size,
+	size_t *out_len
+	);
+
+int pack_decode(
+	const uint8_t *in,
+	size_t in_len,
+	uint8_t *buf,
+	size_t len
+	);
+
+#endif /* __PACK_H */
@@ -0,0 +1,606 @@
+/*
+    hcs12mem - HC12/S12 memory reader & writer
+    Copyright (C) 2005,2006,2007 Michal Konieczny <mk@cml.mfk.net.pl>
+
+    patch.c: per-device FLASH image patches
+
+    $Id$
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "hcs12mem.h"
+#include "patch.h"
+
+#define PATCH_ARGS 5
+
+/* device index used by last applied patch, advanced when image was
+   written; index file is kept per patch specification and reserved by
+   lock file while image is written */
+
+static unsigned long patch_index;
+static int patch_index_used = FALSE;
+static char patch_index_file[SYS_MAX_PATH + 1];
+static char patch_lock_file[SYS_MAX_PATH + 8];
+
+
+/*
+ *  reserve device index file for patch specification - index file is
+ *  kept for interface, target and specification base name, lock file
+ *  created next to it must not exist
+ *
+ *  in:
+ *    spec - patch specification file name
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int patch_index_lock(const char *spec)
+{
+	char ext[SYS_MAX_PATH + 1];
+	const char *base;
+	char *ptr;
+	int ret;
+
+	base = strrchr(spec, SYS_PATH_SEPARATOR);
+	base = (base == NULL ? spec : base + 1);
+	strlcpy(ext, base, sizeof(ext));
+	ptr = strrchr(ext, '.');
+	if (ptr != NULL && ptr != ext)
+		*ptr = '\0';
+	strlcpy(ext + strlen(ext), ".pat", sizeof(ext) - strlen(ext));
+
+	hcs12mem_state_file(patch_index_file, sizeof(patch_index_file), ext);
+	snprintf(patch_lock_file, sizeof(patch_lock_file), "%s.lck",
+		 (const char *)patch_index_file);
+
+	ret = sys_lock_create(patch_lock_file);
+	if (ret == EEXIST)
+	{
+		error("patch device index file %s in use (remove %s if no other write is running)\n",
+		      (const char *)patch_index_file,
+		      (const char *)patch_lock_file);
+		return ret;
+	}
+	if (ret != 0)
+	{
+		error("cannot create patch device index lock file %s (%s)\n",
+		      (const char *)patch_lock_file,
+		      (const char *)strerror(ret));
+		return ret;
+	}
+	return 0;
+}
+
+
+/*
+ *  read device index from index file (first device when there is
+ *  no file)
+ *
+ *  in:
+ *    index - device index (on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int patch_index_read(unsigned long *index)
+{
+	FILE *f;
+	int ret;
+
+	*index = 0;
+
+	f = fopen(patch_index_file, "rt");
+	if (f == NULL)
+		return 0;
+
+	ret = 0;
+	if (fscanf(f, "%lu", index) != 1)
+	{
+		error("invalid patch device index file %s\n",
+		      (const char *)patch_index_file);
+		ret = EINVAL;
+	}
+	fclose(f);
+	return ret;
+}
+
+
+/*
+ *  parse hex bytes, ':', '-' and '.' separators between bytes are
+ *  skipped
+ *
+ *  in:
+ *    str - string to parse
+ *    buf - buffer for bytes
+ *    len - expected number of bytes
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int patch_hex(const char *str, uint8_t *buf, uint32_t len)
+{
+	uint32_t n;
+	int digits;
+	int d;
+
+	n = 0;
+	digits = 0;
+	for (; *str != '\0'; ++ str)
+	{
+		if (*str == ':' || *str == '-' || *str == '.')
+		{
+			if (digits != 0)
+				return EINVAL;
+			continue;
+		}
+
+		if (*str >= '0' && *str <= '9')
+			d = *str - '0';
+		else if (*str >= 'a' && *str <= 'f')
+			d = *str - 'a' + 10;
+		else if (*str >= 'A' && *str <= 'F')
+			d = *str - 'A' + 10;
+		else
+			return EINVAL;
+
+		if (n == len)
+			return EINVAL;
+		if (digits == 0)
+		{
+			buf[n] = (uint8_t)(d << 4);
+			digits = 1;
+		}
+		else
+		{
+			buf[n ++] |= (uint8_t)d;
+			digits = 0;
+		}
+	}
+
+	return (n == len && digits == 0 ? 0 : EINVAL);
+}
+
+
+/*
+ *  get value from CSV file field - rows are counted from first line,
+ *  skipping empty lines and lines starting with '#'
+ *
+ *  in:
+ *    file - CSV file name
+ *    row - row number (from 0)
+ *    column - column number (from 1)
+ *    buf - buffer for value
+ *    len - value length
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int patch_csv(const char *file, unsigned long row, unsigned long column, uint8_t *buf, uint32_t len)
+{
+	char line[1024];
+	FILE *f;
+	char *ptr;
+	char *end;
+	unsigned long n;
+	int ret;
+
+	f = fopen(file, "rt");
+	if (f == NULL)
+	{
+		ret = errno;
+		error("cannot open patch CSV file %s (%s)\n",
+		      (const char *)file,
+		      (const char *)strerror(ret));
+		return ret;
+	}
+
+	n = 0;
+	ptr = NULL;
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		for (ptr = line; isspace(*ptr); ++ ptr)
+			;
+		if (*ptr == '\0' || *ptr == '#')
+			continue;
+		if (n ++ == row)
+			break;
+		ptr = NULL;
+	}
+	fclose(f);
+
+	if (ptr == NULL)
+	{
+		error("patch CSV file %s has no row %lu\n",
+		      (const char *)file,
+		      row);
+		return EINVAL;
+	}
+
+	for (n = 1; n < column && ptr != NULL; ++ n)
+	{
+		ptr = strchr(ptr, ',');
+		if (ptr != NULL)
+			++ ptr;
+	}
+	if (ptr == NULL || column == 0)
+	{
+		error("patch CSV file %s has no column %lu in row %lu\n",
+		      (const char *)file,
+		      column,
+		      row);
+		return EINVAL;
+	}
+
+	end = strchr(ptr, ',');
+	if (end != NULL)
+		*end = '\0';
+	while (isspace(*ptr))
+		++ ptr;
+	for (end = ptr + strlen(ptr); end > ptr && isspace(end[-1]); -- end)
+		;
+	*end = '\0';
+
+	if (patch_hex(ptr, buf, len) != 0)
+	{
+		error("patch CSV file %s row %lu column %lu is not %lu hex bytes: %s\n",
+		      (const char *)file,
+		      row,
+		      column,
+		      (unsigned long)len,
+		      (const char *)ptr);
+		return EINVAL;
+	}
+	return 0;
+}
+
+
+/*
+ *  get value from binary file holding consecutive records, one per
+ *  device
+ *
+ *  in:
+ *    file - file name
+ *    index - record number (from 0)
+ *    buf - buffer for value
+ *    len - value (record) length
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int patch_file(const char *file, unsigned long index, uint8_t *buf, uint32_t len)
+{
+	FILE *f;
+	int ret;
+
+	f = fopen(file, "rb");
+	if (f == NULL)
+	{
+		ret = errno;
+		error("cannot open patch data file %s (%s)\n",
+		      (const char *)file,
+		      (const char *)strerror(ret));
+		return ret;
+	}
+
+	ret = 0;
+	if (fseek(f, (long)(index * len), SEEK_SET) != 0 ||
+	    fread(buf, 1, (size_t)len, f) != (size_t)len)
+	{
+		error("patch data file %s has no record %lu\n",
+		      (const char *)file,
+		      index);
+		ret = EINVAL;
+	}
+	fclose(f);
+	return ret;
+}
+
+
+/*
+ *  get patch value for current device
+ *
+ *  in:
+ *    arg - source arguments: source type and its parameters
+ *    args - number of source arguments
+ *    buf - buffer for value
+ *    len - value length
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int patch_value(char *arg[], int args, uint8_t *buf, uint32_t len)
+{
+	unsigned long value;
+	unsigned long step;
+	unsigned long column;
+	char *end;
+	uint32_t i;
+
+	if (strcmp(arg[0], "counter") == 0 && (args == 2 || args == 3))
+	{
+		/* big endian number, start + step * device index */
+
+		value = strtoul(arg[1], &end, 0);
+		if (*end != '\0')
+			return EINVAL;
+		step = 1;
+		if (args == 3)
+		{
+			step = strtoul(arg[2], &end, 0);
+			if (*end != '\0')
+				return EINVAL;
+		}
+		value += step * patch_index;
+		for (i = len; i > 0; -- i)
+		{
+			buf[i - 1] = (uint8_t)(value & 0xff);
+			value >>= 8;
+		}
+		return 0;
+	}
+
+	if (strcmp(arg[0], "csv") == 0 && args == 3)
+	{
+		column = strtoul(arg[2], &end, 0);
+		if (*end != '\0')
+			return EINVAL;
+		return patch_csv(arg[1], patch_index, column, buf, len);
+	}
+
+	if (strcmp(arg[0], "file") == 0 && args == 2)
+		return patch_file(arg[1], patch_index, buf, len);
+
+	if (strcmp(arg[0], "hex") == 0 && args == 2)
+		return patch_hex(arg[1], buf, len);
+
+	return EINVAL;
+}
+
+
+/*
+ *  apply patch specification to FLASH image - each line of
+ *  specification holds image address and length of patched data,
+ *  followed by value source:
+ *    counter <start> [<step>] - big endian number, start + step * index
+ *    csv <file> <column> - hex bytes from CSV file row given by index
+ *    file <file> - record given by index from binary file
+ *    hex <bytes> - constant hex bytes
+ *  where index is device index kept in state file for interface, target
+ *  and specification, advanced by patch_next() once patched image is
+ *  written (index stays reserved until patch_next() or patch_release())
+ *
+ *  in:
+ *    spec - patch specification file name
+ *    buf - image buffer
+ *    size - image buffer size
+ *    atc - address translation callback (as for image_read())
+ *    map - image map, patched bytes are set to 1 (may be NULL)
+ *  out:
+ *    status code (errno-like)
+ */
+
+int patch_apply(
+	const char *spec,
+	uint8_t *buf,
+	uint32_t size,
+	uint32_t (*atc)(uint32_t addr),
+	uint8_t *map
+	)
+{
+	char line[512];
+	uint8_t value[PATCH_VALUE_MAX];
+	char *arg[PATCH_ARGS + 1];
+	FILE *f;
+	char *ptr;
+	char *end;
+	int args;
+	int n;
+	unsigned long addr;
+	unsigned long len;
+	uint32_t off;
+	uint32_t i;
+	int ret;
+
+	if (!patch_index_used)
+	{
+		ret = patch_index_lock(spec);
+		if (ret != 0)
+			return ret;
+		patch_index_used = TRUE;
+	}
+
+	ret = patch_index_read(&patch_index);
+	if (ret != 0)
+		return ret;
+
+	if (options.verbose)
+	{
+		printf("FLASH write: patch file <%s> device index <%lu>\n",
+		       (const char *)spec,
+		       patch_index);
+	}
+
+	f = fopen(spec, "rt");
+	if (f == NULL)
+	{
+		ret = errno;
+		error("cannot open patch file %s (%s)\n",
+		      (const char *)spec,
+		      (const char *)strerror(ret));
+		return ret;
+	}
+
+	n = 0;
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		++ n;
+
+		/* split line into arguments */
+
+		args = 0;
+		for (ptr = line; args <= PATCH_ARGS;)
+		{
+			while (isspace(*ptr))
+				++ ptr;
+			if (*ptr == '\0' || *ptr == '#')
+				break;
+			arg[args ++] = ptr;
+			while (*ptr != '\0' && !isspace(*ptr))
+				++ ptr;
+			if (*ptr != '\0')
+				*ptr ++ = '\0';
+		}
+		if (args == 0)
+			continue;
+
+		ret = EINVAL;
+		if (args >= 4 && args <= PATCH_ARGS)
+		{
+			addr = strtoul(arg[0], &end, 0);
+			if (*end == '\0')
+			{
+				len = strtoul(arg[1], &end, 0);
+				if (*end == '\0' && len > 0 && len <= PATCH_VALUE_MAX)
+					ret = 0;
+			}
+		}
+		if (ret != 0)
+		{
+			error("invalid patch in file %s line %d\n",
+			      (const char *)spec,
+			      n);
+			break;
+		}
+
+		ret = patch_value(arg + 2, args - 2, value, (uint32_t)len);
+		if (ret != 0)
+		{
+			error("invalid patch value in file %s line %d\n",
+			      (const char *)spec,
+			      n);
+			break;
+		}
+
+		for (i = 0; i < len; ++ i)
+		{
+			off = (uint32_t)addr + i;
+			if (atc != NULL)
+				off = (*atc)(off);
+			if (off >= size)
+			{
+				error("patch in file %s line %d out of FLASH at address 0x%lX\n",
+				      (const char *)spec,
+				      n,
+				      (unsigned long)(addr + i));
+				ret = EINVAL;
+				break;
+			}
+			buf[off] = value[i];
+			if (map != NULL)
+				map[off] = 1;
+		}
+		if (ret != 0)
+			break;
+
+		if (options.verbose)
+		{
+			printf("FLASH write: patch address <0x%05lX> length <0x%04lX> source <%s>\n",
+			       addr,
+			       len,
+			       (const char *)arg[2]);
+		}
+	}
+
+	if (ret == 0 && ferror(f))
+	{
+		ret = errno;
+		error("cannot read patch file %s (%s)\n",
+		      (const char *)spec,
+		      (const char *)strerror(ret));
+	}
+
+	fclose(f);
+	return ret;
+}
+
+
+/*
+ *  advance device index, after image patched for current device was
+ *  written, and release index file
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+int patch_next(void)
+{
+	FILE *f;
+	int ret;
+
+	if (!patch_index_used)
+		return 0;
+
+	f = fopen(patch_index_file, "wt");
+	if (f == NULL)
+	{
+		ret = errno;
+		error("cannot create patch device index file %s (%s)\n",
+		      (const char *)patch_index_file,
+		      (const char *)strerror(ret));
+		patch_release();
+		return ret;
+	}
+
+	fprintf(f, "%lu\n", patch_index + 1);
+	if (fclose(f) != 0)
+	{
+		ret = errno;
+		error("cannot write patch device index file %s (%s)\n",
+		      (const char *)patch_index_file,
+		      (const char *)strerror(ret));
+		patch_release();
+		return ret;
+	}
+
+	patch_release();
+
+	if (options.verbose)
+		printf("FLASH write: next patch device index <%lu>\n", patch_index + 1);
+	return 0;
+}
+
+
+/*
+ *  release device index file without advancing index, when patched
+ *  image was not written
+ *
+ *  in:
+ *    void
+ *  out:
+ *    void
+ */
+
+void patch_release(void)
+{
+	if (!patch_index_used)
+		return;
+	patch_index_used = FALSE;
+
+	remove(patch_lock_file);
+}
@@ -0,0 +1,40 @@
+/*
+    hcs12mem - HC12/S12 memory reader & writer
+    Copyright (C) 2005,2006,2007 Michal Konieczny <mk@cml.mfk.net.pl>
+
+    patch.h: per-device FLASH image patches
+
+    $Id$
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __PATCH_H
+#define __PATCH_H
+
+#define PATCH_VALUE_MAX 256 /* longest patched value, bytes */
+
+int patch_apply(
+	const char *spec,
+	uint8_t *buf,
+	uint32_t size,
+	uint32_t (*atc)(uint32_t addr),
+	uint8_t *map
+	);
+
+int patch_next(void);
+void patch_release(void);
+
+#endif /* __PATCH_H */
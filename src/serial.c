@@ -126,6 +126,30 @@ serial_speed_table[] =
 #	endif
 #	ifdef B115200
 	{ 115200, B115200 },
+#	endif
+#	ifdef B230400
+	{ 230400, B230400 },
+#	endif
+#	ifdef B460800
+	{ 460800, B460800 },
+#	endif
+#	ifdef B500000
+	{ 500000, B500000 },
+#	endif
+#	ifdef B576000
+	{ 576000, B576000 },
+#	endif
+#	ifdef B921600
+	{ 921600, B921600 },
+#	endif
+#	ifdef B1000000
+	{ 1000000, B1000000 },
+#	endif
+#	ifdef B1152000
+	{ 1152000, B1152000 },
+#	endif
+#	ifdef B1500000
+	{ 1500000, B1500000 },
 #	endif
 	{ 0, 0 }
 };
@@ -147,6 +147,33 @@ SOURCE=.\hcs12sm.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\image.c
+# SUBTRACT CPP /YX
+# End Source File
+# Begin Source File
+
+SOURCE=.\image.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\pack.c
+# SUBTRACT CPP /YX
+# End Source File
+# Begin Source File
+
+SOURCE=.\pack.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\patch.c
+# SUBTRACT CPP /YX
+# End Source File
+# Begin Source File
+
+SOURCE=.\patch.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\serial.c
 # SUBTRACT CPP /YX
 # End Source File
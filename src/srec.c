@@ -34,6 +34,45 @@ static uint32_t srec_addr_straight(uint32_t addr)
 }
 
 
+/*
+ *  hex digit values, 0x10 for chars which are not hex digits
+ */
+
+static uint8_t srec_hex[256];
+
+
+/*
+ *  fill hex digit values table
+ *
+ *  in:
+ *    void
+ *  out:
+ *    void
+ */
+
+static void srec_hex_init(void)
+{
+	static int done = FALSE;
+	int i;
+
+	if (done)
+		return;
+
+	for (i = 0; i < 256; ++ i)
+	{
+		if (i >= '0' && i <= '9')
+			srec_hex[i] = (uint8_t)(i - '0');
+		else if (i >= 'A' && i <= 'F')
+			srec_hex[i] = (uint8_t)(i - 'A' + 0x0a);
+		else if (i >= 'a' && i <= 'f')
+			srec_hex[i] = (uint8_t)(i - 'a' + 0x0a);
+		else
+			srec_hex[i] = 0x10;
+	}
+	done = TRUE;
+}
+
+
 /*
  *  convert two chars from string into hex number
  *
@@ -46,25 +85,15 @@ static uint32_t srec_addr_straight(uint32_t addr)
 
 static int srec_str2hex(const char *str, uint8_t *b)
 {
-	if (!isxdigit(str[0]) || !isxdigit(str[1]))
-		return EINVAL;
+	uint8_t h;
+	uint8_t l;
 
-	if (isupper(str[0]))
-		*b = str[0] - 'A' + 0x0a;
-	else if (islower(str[0]))
-		*b = str[0] - 'a' + 0x0a;
-	else
-		*b = str[0] - '0';
-
-	*b *= 0x10;
-
-	if (isupper(str[1]))
-		*b += str[1] - 'A' + 0x0a;
-	else if (islower(str[1]))
-		*b += str[1] - 'a' + 0x0a;
-	else
-		*b += str[1] - '0';
+	h = srec_hex[(uint8_t)str[0]];
+	l = srec_hex[(uint8_t)str[1]];
+	if (((h | l) & 0x10) != 0)
+		return EINVAL;
 
+	*b = (uint8_t)((h << 4) | l);
 	return 0;
 }
 
@@ -74,6 +103,7 @@ static int srec_str2hex(const char *str, uint8_t *b)
  *
  *  in:
  *    buf - S-record text
+ *    len - S-record text length, without line end
  *    type - record type (on return)
  *    cnt - bytes count (on return)
  *    addr - block address (on return)
@@ -84,6 +114,7 @@ static int srec_str2hex(const char *str, uint8_t *b)
 
 static int srec_parse(
 	const char *buf,
+	size_t len,
 	char *type,
 	uint8_t *cnt,
 	uint32_t *addr,
@@ -95,7 +126,7 @@ static int srec_parse(
 	int addr_len;
 	int i;
 
-	if (*buf++ != SREC_HEADER)
+	if (len < 4 || *buf++ != SREC_HEADER)
 		return EINVAL;
 
 	/* record type */
@@ -127,6 +158,11 @@ static int srec_parse(
 		return EINVAL;
 	buf += 2;
 
+	/* record must end where line ends */
+
+	if (len != 4 + 2 * (size_t)b)
+		return EINVAL;
+
 	switch (*type)
 	{
 		case SREC_TYPE_REC_NUM:
@@ -177,17 +213,12 @@ static int srec_parse(
 	/*if (sum != 0xff)
 		return EINVAL;*/
 
-	/* end of line */
-
-	if (*buf != '\0' && *buf != '\r' && *buf != '\n')
-		return EINVAL;
-
 	return 0;
 }
 
 
 /*
- *  read S-record file
+ *  read S-record file, marking bytes present in file
  *
  *  in:
  *    file - file name to read
@@ -199,11 +230,13 @@ static int srec_parse(
  *    addr_min - minimum address encountered (on return)
  *    addr_max - maximum address encountered (on return)
  *    atc - address translation callback
+ *    map - byte map, entries for data read from file are set to 1
+ *          (may be NULL)
  *  out:
  *    status code (errno-like)
  */
 
-int srec_read(
+int srec_read_map(
 	const char *file,
 	char *info,
 	size_t info_len,
@@ -213,11 +246,18 @@ int srec_read(
 	uint32_t *entry,
 	uint32_t *addr_min,
 	uint32_t *addr_max,
-	uint32_t (*atc)(uint32_t addr)
+	uint32_t (*atc)(uint32_t addr),
+	uint8_t *map
 	)
 {
+	sys_map_t m;
 	FILE *f;
 	char str[SREC_LINE_LEN_MAX + 1];
+	const char *ptr;
+	const char *pos;
+	const char *end;
+	const char *eol;
+	size_t len;
 	int line;
 	int ret;
 	char type;
@@ -230,19 +270,28 @@ int srec_read(
 	if (atc == NULL)
 		atc = srec_addr_straight;
 
+	srec_hex_init();
+
+	/* file is parsed straight from its memory mapped contents,
+	   standard input is read line by line */
+
+	f = NULL;
+	pos = NULL;
+	end = NULL;
 	if (file == NULL)
 		f = stdin;
 	else
 	{
-		f = fopen(file, "rt");
-		if (f == NULL)
+		ret = sys_map_open(&m, file);
+		if (ret != 0)
 		{
-			ret = errno;
 			error("unable to open %s (%s)\n",
 			      (const char *)file,
 			      (const char *)strerror(ret));
 			return ret;
 		}
+		pos = (const char *)m.data;
+		end = pos + m.size;
 	}
 
 	if (info != NULL)
@@ -254,21 +303,40 @@ int srec_read(
 
 	ret = 0;
 	line = 0;
-	while (ret == 0 && line != -1 && fgets(str, sizeof(str), f) != NULL)
+	while (ret == 0 && line != -1)
 	{
+		if (f != NULL)
+		{
+			if (fgets(str, sizeof(str), f) == NULL)
+				break;
+			ptr = str;
+			len = strlen(str);
+		}
+		else
+		{
+			if (pos == end)
+				break;
+			ptr = pos;
+			eol = memchr(pos, '\n', (size_t)(end - pos));
+			pos = (eol == NULL ? end : eol + 1);
+			len = (size_t)(pos - ptr);
+		}
 		++ line;
 
-		if (strlen(str) == sizeof(str) - 1)
+		if (len >= sizeof(str) - 1)
 		{
 			error("%s:%u: S-record line too long\n",
-				(const char *)file,
+				(const char *)(file == NULL ? "<stdin>" : file),
 				(unsigned int)line
 				);
 			ret = EINVAL;
 			break;
 		}
 
-		if (srec_parse(str, &type, &cnt, &addr, data) != 0)
+		while (len > 0 && (ptr[len - 1] == '\n' || ptr[len - 1] == '\r'))
+			-- len;
+
+		if (srec_parse(ptr, len, &type, &cnt, &addr, data) != 0)
 		{
 			error("%s:%u: invalid S-record\n",
 				(const char *)file,
@@ -307,6 +375,8 @@ int srec_read(
 				else
 				{
 					memcpy((uint8_t *)buf + addr_low, data, (size_t)cnt);
+					if (map != NULL)
+						memset(map + addr_low, 1, (size_t)cnt);
 					if (addr_min != NULL && addr_low < *addr_min)
 						*addr_min = addr_low;
 					if (addr_max != NULL && addr_high > *addr_max)
@@ -341,11 +411,13 @@ int srec_read(
 		}
 	}
 
-	if (fclose(f) == -1)
+	if (f == NULL)
+		sys_map_close(&m);
+	else if (fclose(f) == -1)
 	{
 		ret = errno;
 		error("cannot close file %s (%s)\n",
-		      (const char *)(file == NULL ? "<stdin>" : file),
+		      (const char *)"<stdin>",
 		      (const char *)strerror(ret));
 	}
 
@@ -353,6 +425,41 @@ int srec_read(
 }
 
 
+/*
+ *  read S-record file
+ *
+ *  in:
+ *    file - file name to read
+ *    info - buffer for info record data (on return)
+ *    info_len - length of buffer for info record data
+ *    buf - buffer for data
+ *    buf_len - data buffer length
+ *    entry - entry address (on return)
+ *    addr_min - minimum address encountered (on return)
+ *    addr_max - maximum address encountered (on return)
+ *    atc - address translation callback
+ *  out:
+ *    status code (errno-like)
+ */
+
+int srec_read(
+	const char *file,
+	char *info,
+	size_t info_len,
+	void *buf,
+	size_t buf_len,
+	uint32_t *entry_raw,
+	uint32_t *entry,
+	uint32_t *addr_min,
+	uint32_t *addr_max,
+	uint32_t (*atc)(uint32_t addr)
+	)
+{
+	return srec_read_map(file, info, info_len, buf, buf_len,
+		entry_raw, entry, addr_min, addr_max, atc, NULL);
+}
+
+
 /*
  *  write single S-record line
  *
@@ -442,15 +549,15 @@ static int srec_write_line(
 
 
 /*
- *  write S-record file
+ *  open S-record file for writing, data is written by following
+ *  srec_put() calls, so that file grows while data arrives
  *
  *  in:
+ *    s - S-record output file (on return)
  *    file - file name to write
  *    info - info record data
  *    addr - data starting address
  *    len - data length
- *    buf - data buffer
- *    entry - entry address
  *    atc - address translation callback
  *    skip_empty - skip empty (0xff) areas when this flag is set
  *    block_size - single S-record size
@@ -458,31 +565,30 @@ static int srec_write_line(
  *    status code (errno-like)
  */
 
-int srec_write(
+int srec_open(
+	srec_file_t *s,
 	const char *file,
 	const char *info,
 	uint32_t addr,
 	size_t len,
-	uint8_t *buf,
-	uint32_t entry,
 	uint32_t (*atc)(uint32_t addr),
 	int skip_empty,
-	size_t block_size,
-	int entry_mode
+	size_t block_size
 	)
 {
-	FILE *f;
 	size_t n;
-	size_t i;
-	char type_a;
-	char type_end;
 	int ret;
 
 	if (atc == NULL)
 		atc = srec_addr_straight;
 
-	f = fopen(file, "wt");
-	if (f == NULL)
+	s->file = file;
+	s->atc = atc;
+	s->skip_empty = skip_empty;
+	s->block_size = block_size;
+
+	s->f = fopen(file, "wt");
+	if (s->f == NULL)
 	{
 		ret = errno;
 		error("cannot open %s for writing (%s)\n",
@@ -496,35 +602,58 @@ int srec_write(
 		n = strlen(info);
 		if (n > 252) /* 255 less 3 bytes */
 			n = 252;
-		ret = srec_write_line(f, SREC_TYPE_INFO, 0, n, (const uint8_t *)info);
+		ret = srec_write_line(s->f, SREC_TYPE_INFO, 0, n, (const uint8_t *)info);
 		if (ret != 0)
 		{
-			fclose(f);
+			fclose(s->f);
 			return ret;
 		}
 	}
 
 	if ((*atc)(addr) + (uint32_t)len <= (uint32_t)0x00010000)
 	{
-		type_a = SREC_TYPE_A16;
-		type_end = SREC_TYPE_A16_END;
+		s->type_a = SREC_TYPE_A16;
+		s->type_end = SREC_TYPE_A16_END;
 	}
 	else if ((*atc)(addr) + (uint32_t)len <= (uint32_t)0x01000000)
 	{
-		type_a = SREC_TYPE_A24;
-		type_end = SREC_TYPE_A24_END;
+		s->type_a = SREC_TYPE_A24;
+		s->type_end = SREC_TYPE_A24_END;
 	}
 	else
 	{
-		type_a = SREC_TYPE_A32;
-		type_end = SREC_TYPE_A32_END;
+		s->type_a = SREC_TYPE_A32;
+		s->type_end = SREC_TYPE_A32_END;
 	}
 
+	return 0;
+}
+
+
+/*
+ *  write data to S-record file, file buffer is flushed, so that
+ *  written data is available to other processes
+ *
+ *  in:
+ *    s - S-record output file
+ *    addr - data address
+ *    len - data length
+ *    buf - data buffer
+ *  out:
+ *    status code (errno-like), file is closed on error
+ */
+
+int srec_put(srec_file_t *s, uint32_t addr, size_t len, const uint8_t *buf)
+{
+	size_t n;
+	size_t i;
+	int ret;
+
 	while (len > 0)
 	{
-		n = (len > block_size ? block_size : len);
+		n = (len > s->block_size ? s->block_size : len);
 
-		if (skip_empty)
+		if (s->skip_empty)
 		{
 			for (i = 0; i < n; ++i)
 			{
@@ -537,11 +666,11 @@ int srec_write(
 
 		if (i != n)
 		{
-			ret = srec_write_line(f, type_a,
-				(*atc)(addr), n, buf);
+			ret = srec_write_line(s->f, s->type_a,
+				(*s->atc)(addr), n, buf);
 			if (ret != 0)
 			{
-				fclose(f);
+				fclose(s->f);
 				return ret;
 			}
 		}
@@ -551,24 +680,178 @@ int srec_write(
 		buf += n;
 	}
 
+	if (fflush(s->f) == EOF)
+	{
+		ret = errno;
+		error("cannot write file %s (%s)\n",
+		      (const char *)s->file,
+		      (const char *)strerror(ret));
+		fclose(s->f);
+		return ret;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  finish S-record file - write end record and close file
+ *
+ *  in:
+ *    s - S-record output file
+ *    entry - entry address
+ *    entry_mode - entry address mode
+ *  out:
+ *    status code (errno-like)
+ */
+
+int srec_close(srec_file_t *s, uint32_t entry, int entry_mode)
+{
+	int ret;
+
 	if (entry_mode != SREC_ENTRY_MODE_RAW)
-		entry = (*atc)(entry);
+		entry = (*s->atc)(entry);
 
-	ret = srec_write_line(f, type_end, entry, 0, NULL);
+	ret = srec_write_line(s->f, s->type_end, entry, 0, NULL);
 	if (ret != 0)
 	{
-		fclose(f);
+		fclose(s->f);
 		return -1;
 	}
 
-	if (fclose(f) == -1)
+	if (fclose(s->f) == -1)
 	{
 		ret = errno;
 		error("cannot close file %s (%s)\n",
-		      (const char *)file,
+		      (const char *)s->file,
 		      (const char *)strerror(ret));
 		return ret;
 	}
 
 	return 0;
 }
+
+
+/*
+ *  close S-record file without end record, when data transfer failed
+ *  (data written so far is left in file)
+ *
+ *  in:
+ *    s - S-record output file
+ *  out:
+ *    void
+ */
+
+void srec_abort(srec_file_t *s)
+{
+	fclose(s->f);
+}
+
+
+/*
+ *  write S-record file, with data selected by byte map
+ *
+ *  in:
+ *    file - file name to write
+ *    info - info record data
+ *    addr - data starting address
+ *    len - data length
+ *    buf - data buffer
+ *    entry - entry address
+ *    atc - address translation callback
+ *    skip_empty - skip empty (0xff) areas when this flag is set
+ *    block_size - single S-record size
+ *    entry_mode - entry address mode
+ *    map - byte map, only data with non-zero entries is written
+ *          (may be NULL)
+ *  out:
+ *    status code (errno-like)
+ */
+
+int srec_write_map(
+	const char *file,
+	const char *info,
+	uint32_t addr,
+	size_t len,
+	uint8_t *buf,
+	uint32_t entry,
+	uint32_t (*atc)(uint32_t addr),
+	int skip_empty,
+	size_t block_size,
+	int entry_mode,
+	const uint8_t *map
+	)
+{
+	srec_file_t s;
+	size_t n;
+	int ret;
+
+	ret = srec_open(&s, file, info, addr, len, atc, skip_empty, block_size);
+	if (ret != 0)
+		return ret;
+
+	while (len > 0)
+	{
+		n = len;
+		if (map != NULL)
+		{
+			if (*map == 0)
+			{
+				++ addr;
+				-- len;
+				++ buf;
+				++ map;
+				continue;
+			}
+			for (n = 1; n < len && map[n] != 0; ++n)
+				;
+			map += n;
+		}
+
+		ret = srec_put(&s, addr, n, buf);
+		if (ret != 0)
+			return ret;
+
+		addr += n;
+		len -= n;
+		buf += n;
+	}
+
+	return srec_close(&s, entry, entry_mode);
+}
+
+
+/*
+ *  write S-record file
+ *
+ *  in:
+ *    file - file name to write
+ *    info - info record data
+ *    addr - data starting address
+ *    len - data length
+ *    buf - data buffer
+ *    entry - entry address
+ *    atc - address translation callback
+ *    skip_empty - skip empty (0xff) areas when this flag is set
+ *    block_size - single S-record size
+ *    entry_mode - entry address mode
+ *  out:
+ *    status code (errno-like)
+ */
+
+int srec_write(
+	const char *file,
+	const char *info,
+	uint32_t addr,
+	size_t len,
+	uint8_t *buf,
+	uint32_t entry,
+	uint32_t (*atc)(uint32_t addr),
+	int skip_empty,
+	size_t block_size,
+	int entry_mode
+	)
+{
+	return srec_write_map(file, info, addr, len, buf, entry, atc,
+		skip_empty, block_size, entry_mode, NULL);
+}
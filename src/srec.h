@@ -60,9 +60,51 @@ int srec_read(
 	uint32_t (*atc)(uint32_t addr)
 	);
 
+int srec_read_map(
+	const char *file,
+	char *info,
+	size_t info_len,
+	void *buf,
+	size_t buf_len,
+	uint32_t *entry_raw,
+	uint32_t *entry,
+	uint32_t *addr_min,
+	uint32_t *addr_max,
+	uint32_t (*atc)(uint32_t addr),
+	uint8_t *map
+	);
+
 #define SREC_ENTRY_MODE_RAW       0
 #define SREC_ENTRY_MODE_TRANSLATE 1
 
+/* S-record output file, written progressively */
+
+typedef struct
+{
+	FILE *f;
+	const char *file;
+	uint32_t (*atc)(uint32_t addr);
+	int skip_empty;
+	size_t block_size;
+	char type_a;
+	char type_end;
+}
+srec_file_t;
+
+int srec_open(
+	srec_file_t *s,
+	const char *file,
+	const char *info,
+	uint32_t addr,
+	size_t len,
+	uint32_t (*atc)(uint32_t addr),
+	int skip_empty,
+	size_t block_size
+	);
+int srec_put(srec_file_t *s, uint32_t addr, size_t len, const uint8_t *buf);
+int srec_close(srec_file_t *s, uint32_t entry, int entry_mode);
+void srec_abort(srec_file_t *s);
+
 int srec_write(
 	const char *file,
 	const char *info,
@@ -76,4 +118,18 @@ int srec_write(
 	int entry_mode
 	);
 
+int srec_write_map(
+	const char *file,
+	const char *info,
+	uint32_t addr,
+	size_t len,
+	uint8_t *buf,
+	uint32_t entry,
+	uint32_t (*atc)(uint32_t addr),
+	int skip_empty,
+	size_t block_size,
+	int entry_mode,
+	const uint8_t *map
+	);
+
 #endif /* __SREC_H */
@@ -24,8 +24,14 @@
 #include "sys.h"
 
 #if SYS_TYPE_UNIX
+# include <sys/types.h>
+# include <sys/stat.h>
 # include <sys/time.h>
+# include <fcntl.h>
 # include <dlfcn.h>
+# if HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+# endif
 #endif
 
 #if SYS_TYPE_WIN32
@@ -331,6 +337,206 @@ int sys_dl_func(sys_dl_t *dl, const char *symbol, sys_dl_func_t *func)
 #endif
 
 
+/*
+ *  memory mapped files under unix - file is read into memory when
+ *  mmap() is not available or fails
+ */
+
+#if SYS_TYPE_UNIX
+
+int sys_map_open(sys_map_t *m, const char *name)
+{
+	struct stat st;
+	uint8_t *data;
+	ssize_t n;
+	size_t i;
+	int fd;
+	int ret;
+
+	m->data = NULL;
+	m->size = 0;
+	m->mapped = FALSE;
+
+	fd = open(name, O_RDONLY);
+	if (fd == -1)
+		return sys_get_error();
+
+	if (fstat(fd, &st) == -1)
+	{
+		ret = sys_get_error();
+		close(fd);
+		return ret;
+	}
+	m->size = (size_t)st.st_size;
+	if (m->size == 0)
+	{
+		close(fd);
+		return 0;
+	}
+
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+	data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data != (uint8_t *)MAP_FAILED)
+	{
+		close(fd);
+		m->data = data;
+		m->mapped = TRUE;
+		return 0;
+	}
+#endif
+
+	data = malloc(m->size);
+	if (data == NULL)
+	{
+		close(fd);
+		return ENOMEM;
+	}
+	for (i = 0; i < m->size; i += (size_t)n)
+	{
+		n = read(fd, data + i, m->size - i);
+		if (n <= 0)
+		{
+			ret = (n == 0 ? EIO : sys_get_error());
+			free(data);
+			close(fd);
+			return ret;
+		}
+	}
+	close(fd);
+	m->data = data;
+	return 0;
+}
+
+
+int sys_map_close(sys_map_t *m)
+{
+	if (m->data == NULL)
+		return 0;
+
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+	if (m->mapped)
+	{
+		if (munmap((void *)m->data, m->size) == -1)
+			return sys_get_error();
+		m->data = NULL;
+		return 0;
+	}
+#endif
+
+	free((void *)m->data);
+	m->data = NULL;
+	return 0;
+}
+
+#endif
+
+
+/*
+ *  memory mapped files under win32
+ */
+
+#if SYS_TYPE_WIN32
+
+int sys_map_open(sys_map_t *m, const char *name)
+{
+	int ret;
+
+	m->data = NULL;
+	m->size = 0;
+	m->map = NULL;
+
+	m->file = CreateFile(name, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m->file == INVALID_HANDLE_VALUE)
+		return sys_get_error();
+
+	m->size = (size_t)GetFileSize(m->file, NULL);
+	if (m->size == 0)
+		return 0;
+
+	m->map = CreateFileMapping(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m->map == NULL)
+	{
+		ret = sys_get_error();
+		CloseHandle(m->file);
+		m->file = INVALID_HANDLE_VALUE;
+		return ret;
+	}
+
+	m->data = (const uint8_t *)MapViewOfFile(m->map, FILE_MAP_READ, 0, 0, 0);
+	if (m->data == NULL)
+	{
+		ret = sys_get_error();
+		CloseHandle(m->map);
+		CloseHandle(m->file);
+		m->map = NULL;
+		m->file = INVALID_HANDLE_VALUE;
+		return ret;
+	}
+
+	return 0;
+}
+
+
+int sys_map_close(sys_map_t *m)
+{
+	if (m->data != NULL)
+		UnmapViewOfFile((LPCVOID)m->data);
+	if (m->map != NULL)
+		CloseHandle(m->map);
+	if (m->file != INVALID_HANDLE_VALUE)
+		CloseHandle(m->file);
+	m->data = NULL;
+	m->map = NULL;
+	m->file = INVALID_HANDLE_VALUE;
+	return 0;
+}
+
+#endif
+
+
+/*
+ *  create lock file - fails with EEXIST when file exists already,
+ *  so that only one process holds the lock
+ *
+ *  in:
+ *    name - lock file name
+ *  out:
+ *    status code (errno-like)
+ */
+
+#if SYS_TYPE_UNIX
+
+int sys_lock_create(const char *name)
+{
+	int fd;
+
+	fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd == -1)
+		return sys_get_error();
+	close(fd);
+	return 0;
+}
+
+#endif
+
+#if SYS_TYPE_WIN32
+
+int sys_lock_create(const char *name)
+{
+	HANDLE h;
+
+	h = CreateFile(name, GENERIC_WRITE, 0, NULL,
+		CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+		return sys_get_error();
+	CloseHandle(h);
+	return 0;
+}
+
+#endif
+
+
 /* get string for given error */
 
 #if SYS_TYPE_WIN32
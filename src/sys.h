@@ -171,6 +171,7 @@ extern char *strerror(int error);
 #define ENOMEM    ERROR_NOT_ENOUGH_MEMORY
 #define EIO       ERROR_IO_DEVICE
 #define ENOENT    ERROR_FILE_NOT_FOUND
+#define EEXIST    ERROR_FILE_EXISTS
 
 #define strcasecmp _stricmp
 #define strncasecmp _strnicmp
@@ -269,4 +270,27 @@ int sys_dl_close(sys_dl_t *dl);
 int sys_dl_get(sys_dl_t *dl, const char *name, void **ptr);
 int sys_dl_func(sys_dl_t *dl, const char *name, sys_dl_func_t *ptr);
 
+/* memory mapped files (read only) */
+
+typedef struct
+{
+	const uint8_t *data;
+	size_t size;
+#if SYS_TYPE_UNIX
+	int mapped;
+#endif
+#if SYS_TYPE_WIN32
+	HANDLE file;
+	HANDLE map;
+#endif
+}
+sys_map_t;
+
+int sys_map_open(sys_map_t *m, const char *name);
+int sys_map_close(sys_map_t *m);
+
+/* lock files */
+
+int sys_lock_create(const char *name);
+
 #endif /* __SYSTEM_H */
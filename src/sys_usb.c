@@ -46,6 +46,13 @@ static libusb_bulk_read_t libusb_bulk_read_f;
 static libusb_bulk_write_t libusb_bulk_write_f;
 static libusb_get_string_simple_t libusb_get_string_simple_f;
 
+/* asynchronous transfers, optional (provided by libusb-win32 only) */
+static int libusb_async;
+static libusb_bulk_setup_async_t libusb_bulk_setup_async_f;
+static libusb_submit_async_t libusb_submit_async_f;
+static libusb_reap_async_t libusb_reap_async_f;
+static libusb_free_async_t libusb_free_async_f;
+
 
 /*
  *  open usb library
@@ -154,6 +161,21 @@ int sys_usb_open(void)
 	if (ret != 0)
 		goto nofunc;
 
+	libusb_async =
+		sys_dl_func(&libusb_dl, "usb_bulk_setup_async",
+			(sys_dl_func_t *)(void *)&libusb_bulk_setup_async_f) == 0 &&
+		sys_dl_func(&libusb_dl, "usb_submit_async",
+			(sys_dl_func_t *)(void *)&libusb_submit_async_f) == 0 &&
+		sys_dl_func(&libusb_dl, "usb_reap_async",
+			(sys_dl_func_t *)(void *)&libusb_reap_async_f) == 0 &&
+		sys_dl_func(&libusb_dl, "usb_free_async",
+			(sys_dl_func_t *)(void *)&libusb_free_async_f) == 0;
+	if (options.debug)
+	{
+		printf("libusb asynchronous transfers <%s>\n",
+		       (const char *)(libusb_async ? "available" : "not available"));
+	}
+
 	(*libusb_init_f)();
 
 #if SYS_TYPE_WIN32
@@ -579,3 +601,142 @@ int sys_usb_bulk_write(sys_usb_dev_t *d, uint8_t ep,
 	*len = (size_t)ret;
 	return 0;
 }
+
+
+/*
+ *  check if asynchronous transfers are available
+ *
+ *  in:
+ *    void
+ *  out:
+ *    TRUE when usb library supports asynchronous transfers
+ */
+
+int sys_usb_async_available(void)
+{
+	return libusb_ref != 0 && libusb_async;
+}
+
+
+/*
+ *  helper function - set up and submit asynchronous bulk transfer
+ *
+ *  in:
+ *    d - device handle
+ *    ep - endpoint address (with direction)
+ *    buf - data buffer, must be valid until transfer is reaped
+ *    len - data count to transfer
+ *    a - transfer handle (on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int sys_usb_bulk_submit(sys_usb_dev_t *d, int ep,
+	void *buf, size_t len, sys_usb_async_t *a)
+{
+	int ret;
+
+	if (!libusb_async)
+		return ENOSYS;
+
+	*a = NULL;
+	ret = (*libusb_bulk_setup_async_f)((usb_dev_handle *)(*d), a,
+		(unsigned char)ep);
+	if (ret < 0)
+	{
+		error("unable to set up USB transfer: %s\n",
+		      (*libusb_strerror_f)());
+		return EIO;
+	}
+
+	ret = (*libusb_submit_async_f)(*a, (char *)buf, (int)len);
+	if (ret < 0)
+	{
+		error("unable to submit USB transfer: %s\n",
+		      (*libusb_strerror_f)());
+		(*libusb_free_async_f)(a);
+		*a = NULL;
+		return EIO;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  submit asynchronous bulk read transfer from USB device
+ *
+ *  in:
+ *    d - device handle
+ *    ep - endpoint number
+ *    buf - data buffer, must be valid until transfer is reaped
+ *    len - data count to read
+ *    a - transfer handle (on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+int sys_usb_bulk_read_submit(sys_usb_dev_t *d, uint8_t ep,
+	void *buf, size_t len, sys_usb_async_t *a)
+{
+	return sys_usb_bulk_submit(d, USB_ENDPOINT_IN | (int)ep, buf, len, a);
+}
+
+
+/*
+ *  submit asynchronous bulk write transfer to USB device
+ *
+ *  in:
+ *    d - device handle
+ *    ep - endpoint number
+ *    buf - data buffer, must be valid until transfer is reaped
+ *    len - data count to write
+ *    a - transfer handle (on return)
+ *  out:
+ *    status code (errno-like)
+ */
+
+int sys_usb_bulk_write_submit(sys_usb_dev_t *d, uint8_t ep,
+	const void *buf, size_t len, sys_usb_async_t *a)
+{
+	return sys_usb_bulk_submit(d, USB_ENDPOINT_OUT | (int)ep,
+		(void *)buf, len, a);
+}
+
+
+/*
+ *  wait for asynchronous transfer completion and release it
+ *
+ *  in:
+ *    a - transfer handle (cleared on return)
+ *    len - transferred data count (on return), can be NULL
+ *    timeout - operation timeout, in ms
+ *  out:
+ *    status code (errno-like)
+ */
+
+int sys_usb_bulk_reap(sys_usb_async_t *a, size_t *len, unsigned int timeout)
+{
+	int ret;
+
+	if (*a == NULL)
+		return EINVAL;
+
+	ret = (*libusb_reap_async_f)(*a, (int)timeout);
+	(*libusb_free_async_f)(a);
+	*a = NULL;
+	if (ret < 0)
+	{
+		ret = -ret;
+#if SYS_TYPE_WIN32
+		if (ret == SYS_USB_WIN32_ETIMEDOUT)
+			ret = ETIMEDOUT;
+#endif
+		error("unable to complete USB transfer: %s\n",
+		      (*libusb_strerror_f)());
+		return ret;
+	}
+	if (len != NULL)
+		*len = (size_t)ret;
+	return 0;
+}
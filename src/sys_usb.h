@@ -56,8 +56,13 @@ typedef int (*libusb_control_msg_t)(usb_dev_handle *dev,
 typedef int (*libusb_bulk_read_t)(usb_dev_handle *dev, int ep, char *bytes, int size, int timeout);
 typedef int (*libusb_bulk_write_t)(usb_dev_handle *dev, int ep, char *bytes, int size, int timeout);
 typedef int (*libusb_get_string_simple_t)(usb_dev_handle *dev, int index, char *buf, size_t buflen);
+typedef int (*libusb_bulk_setup_async_t)(usb_dev_handle *dev, void **context, unsigned char ep);
+typedef int (*libusb_submit_async_t)(void *context, char *bytes, int size);
+typedef int (*libusb_reap_async_t)(void *context, int timeout);
+typedef int (*libusb_free_async_t)(void **context);
 
 typedef usb_dev_handle *sys_usb_dev_t;
+typedef void *sys_usb_async_t;
 
 extern int sys_usb_open(void);
 extern int sys_usb_close(void);
@@ -70,5 +75,11 @@ extern int sys_usb_bulk_read(sys_usb_dev_t *d, uint8_t ep,
 	void *buf, size_t *len, unsigned int timeout);
 extern int sys_usb_bulk_write(sys_usb_dev_t *d, uint8_t ep,
 	const void *buf, size_t *len, unsigned int timeout);
+extern int sys_usb_async_available(void);
+extern int sys_usb_bulk_read_submit(sys_usb_dev_t *d, uint8_t ep,
+	void *buf, size_t len, sys_usb_async_t *a);
+extern int sys_usb_bulk_write_submit(sys_usb_dev_t *d, uint8_t ep,
+	const void *buf, size_t len, sys_usb_async_t *a);
+extern int sys_usb_bulk_reap(sys_usb_async_t *a, size_t *len, unsigned int timeout);
 
 #endif /* __SYS_USB_H */
@@ -32,6 +32,23 @@
 /* usb device connection handle */
 static sys_usb_dev_t tbdml_device;
 
+/* bulk command queued as asynchronous transfers */
+typedef struct
+{
+	uint8_t tx[3 + 3 + TBDML_MAX_DATA_SIZE];
+	uint8_t rx[1 + TBDML_MAX_DATA_SIZE];
+	uint8_t cmd;
+	void *brx;
+	size_t nrx;
+	sys_usb_async_t atx;
+	sys_usb_async_t arx;
+} tbdml_async_t;
+
+static int tbdml_async_enabled;
+static tbdml_async_t tbdml_async[TBDML_ASYNC_DEPTH];
+static int tbdml_async_head;
+static int tbdml_async_count;
+
 
 /*
  *  send command to TBDML
@@ -107,25 +124,19 @@ static int tbdml_cmd(uint8_t cmd, const void *btx, int ntx, void *brx, int nrx)
 
 
 /*
- *  send command to TBDML via bulk transfer over EP2
+ *  build bulk transfer command packet
  *
  *  in:
+ *    buf - buffer for packet, 3 + ntx bytes at least
  *    cmd - command type
  *    btx - buffer with query data (tx)
  *    ntx - query data size
- *    brx - buffer for answer data (rx)
- *    ntx - answer data size 
  *  out:
- *    status code (errno-like)
+ *    packet size
  */
 
-static int tbdml_cmd_bulk(uint8_t cmd, const void *btx, size_t ntx, void *brx, size_t nrx)
+static size_t tbdml_bulk_packet(uint8_t *buf, uint8_t cmd, const void *btx, size_t ntx)
 {
-	/* dummy byte (1 byte) + answer length / status (1 byte) + cmd (1 byte) + address (2 bytes) + data length (1 byte) + data block */
-	uint8_t buf[3 + 3 + TBDML_MAX_DATA_SIZE];
-	size_t size;
-	int ret;
-
 	/* here we have a bug in the firmware of TBDML: for bulk transfers,
 	   it requires one more byte at the beginning, with data size for
 	   all the remaining data (starting with data size counter)
@@ -138,28 +149,71 @@ static int tbdml_cmd_bulk(uint8_t cmd, const void *btx, size_t ntx, void *brx, s
 	if (ntx != 0)
 		memcpy(buf + 3, btx, ntx);
 
-	size = ntx + 3; /* 3 more bytes: size, size again and cmd */
-	ret = sys_usb_bulk_write(&tbdml_device, 2, buf, &size, TBDML_TIMEOUT);
-	if (ret != 0)
-		return ret;
+	return ntx + 3; /* 3 more bytes: size, size again and cmd */
+}
 
-	size = nrx + 1; /* first returned byte before real data - status */
-	ret = sys_usb_bulk_read(&tbdml_device, 2, buf, &size, TBDML_TIMEOUT);
-	if (ret != 0)
-		return ret;
 
-	if (buf[0] == TBDML_CMD_UNKNOWN)
+/*
+ *  check bulk transfer answer status
+ *
+ *  in:
+ *    cmd - command type
+ *    status - first byte of answer
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int tbdml_bulk_status(uint8_t cmd, uint8_t status)
+{
+	if (status == TBDML_CMD_UNKNOWN)
 	{
 		error("device communication failed: unknown command\n");
 		return EIO;
 	}
-	if (buf[0] == TBDML_CMD_FAILED)
+	if (status == TBDML_CMD_FAILED)
 		return -1;
-	if (buf[0] != cmd)
+	if (status != cmd)
 	{
 		error("device communication failed: unknown response\n");
 		return EIO;
 	}
+	return 0;
+}
+
+
+/*
+ *  send command to TBDML via bulk transfer over EP2
+ *
+ *  in:
+ *    cmd - command type
+ *    btx - buffer with query data (tx)
+ *    ntx - query data size
+ *    brx - buffer for answer data (rx)
+ *    ntx - answer data size 
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int tbdml_cmd_bulk(uint8_t cmd, const void *btx, size_t ntx, void *brx, size_t nrx)
+{
+	/* dummy byte (1 byte) + answer length / status (1 byte) + cmd (1 byte) + address (2 bytes) + data length (1 byte) + data block */
+	uint8_t buf[3 + 3 + TBDML_MAX_DATA_SIZE];
+	size_t size;
+	int ret;
+
+	size = tbdml_bulk_packet(buf, cmd, btx, ntx);
+	ret = sys_usb_bulk_write(&tbdml_device, 2, buf, &size, TBDML_TIMEOUT);
+	if (ret != 0)
+		return ret;
+
+	size = nrx + 1; /* first returned byte before real data - status */
+	ret = sys_usb_bulk_read(&tbdml_device, 2, buf, &size, TBDML_TIMEOUT);
+	if (ret != 0)
+		return ret;
+
+	ret = tbdml_bulk_status(cmd, buf[0]);
+	if (ret != 0)
+		return ret;
 	if (nrx != 0)
 		memcpy(brx, buf + 1, nrx);
 
@@ -167,6 +221,118 @@ static int tbdml_cmd_bulk(uint8_t cmd, const void *btx, size_t ntx, void *brx, s
 }
 
 
+/*
+ *  complete the oldest queued bulk command
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int tbdml_async_complete(void)
+{
+	tbdml_async_t *a;
+	int ret;
+	int ret2;
+
+	a = &tbdml_async[tbdml_async_head];
+	tbdml_async_head = (tbdml_async_head + 1) % TBDML_ASYNC_DEPTH;
+	-- tbdml_async_count;
+
+	/* both transfers must be reaped to release them, even on error */
+
+	ret = sys_usb_bulk_reap(&a->atx, NULL, TBDML_TIMEOUT);
+	ret2 = sys_usb_bulk_reap(&a->arx, NULL, TBDML_TIMEOUT);
+	if (ret != 0)
+		return ret;
+	if (ret2 != 0)
+		return ret2;
+
+	ret = tbdml_bulk_status(a->cmd, a->rx[0]);
+	if (ret != 0)
+		return ret;
+	if (a->nrx != 0)
+		memcpy(a->brx, a->rx + 1, a->nrx);
+
+	return 0;
+}
+
+
+/*
+ *  complete all queued bulk commands
+ *
+ *  in:
+ *    void
+ *  out:
+ *    status code (errno-like), of the first failed command
+ */
+
+static int tbdml_async_flush(void)
+{
+	int ret;
+	int ret2;
+
+	ret = 0;
+	while (tbdml_async_count != 0)
+	{
+		ret2 = tbdml_async_complete();
+		if (ret == 0)
+			ret = ret2;
+	}
+	return ret;
+}
+
+
+/*
+ *  queue command to TBDML via asynchronous bulk transfers over EP2,
+ *  answer is stored on completion (tbdml_async_flush())
+ *
+ *  in:
+ *    cmd - command type
+ *    btx - buffer with query data (tx)
+ *    ntx - query data size
+ *    brx - buffer for answer data (rx), must be valid until completion
+ *    ntx - answer data size 
+ *  out:
+ *    status code (errno-like)
+ */
+
+static int tbdml_cmd_async(uint8_t cmd, const void *btx, size_t ntx, void *brx, size_t nrx)
+{
+	tbdml_async_t *a;
+	size_t size;
+	int ret;
+
+	if (tbdml_async_count == TBDML_ASYNC_DEPTH)
+	{
+		ret = tbdml_async_complete();
+		if (ret != 0)
+			return ret;
+	}
+
+	a = &tbdml_async[(tbdml_async_head + tbdml_async_count) % TBDML_ASYNC_DEPTH];
+	a->cmd = cmd;
+	a->brx = brx;
+	a->nrx = nrx;
+
+	size = tbdml_bulk_packet(a->tx, cmd, btx, ntx);
+	ret = sys_usb_bulk_write_submit(&tbdml_device, 2, a->tx, size, &a->atx);
+	if (ret != 0)
+		return ret;
+
+	ret = sys_usb_bulk_read_submit(&tbdml_device, 2, a->rx, nrx + 1, &a->arx);
+	if (ret != 0)
+	{
+		sys_usb_bulk_reap(&a->atx, NULL, TBDML_TIMEOUT);
+		return ret;
+	}
+
+	++ tbdml_async_count;
+	return 0;
+}
+
+
 /*
  *  get TBDML version
  *
@@ -533,7 +699,9 @@ static int tbdml_read_block(uint16_t *addr, uint8_t **buf, uint16_t len)
 
 	uint16_host2le_to_buf(q + 0, *addr);
 	q[2] = (uint8_t)len;
-	if (options.tbdml_bulk)
+	if (options.tbdml_bulk && tbdml_async_enabled)
+		ret = tbdml_cmd_async(TBDML_CMD_READ_BLOCK1, q, sizeof(q), *buf, (int)len);
+	else if (options.tbdml_bulk)
 		ret = tbdml_cmd_bulk(TBDML_CMD_READ_BLOCK1, q, sizeof(q), *buf, (int)len);
 	else
 		ret = tbdml_cmd(TBDML_CMD_READ_BLOCK1, q, sizeof(q), *buf, (int)len);
@@ -566,7 +734,9 @@ static int tbdml_write_block(uint16_t *addr, const uint8_t **buf, uint16_t len)
 	q[2] = (uint8_t)len;
 	memcpy(q + 3, *buf, len);
 
-	if (options.tbdml_bulk)
+	if (options.tbdml_bulk && tbdml_async_enabled)
+		ret = tbdml_cmd_async(TBDML_CMD_WRITE_BLOCK1, q, 3 + len, NULL, 0);
+	else if (options.tbdml_bulk)
 		ret = tbdml_cmd_bulk(TBDML_CMD_WRITE_BLOCK1, q, 3 + len, NULL, 0);
 	else
 		ret = tbdml_cmd(TBDML_CMD_WRITE_BLOCK1, q, 3 + len, NULL, 0);
@@ -594,6 +764,7 @@ static int tbdml_read_mem(uint16_t addr, void *buf, size_t len)
 	uint8_t *ptr;
 	size_t n;
 	int ret;
+	int ret2;
 
 	if (len == 0)
 		return 0;
@@ -607,7 +778,7 @@ static int tbdml_read_mem(uint16_t addr, void *buf, size_t len)
 		n = (TBDML_MAX_DATA_SIZE & 0xfe) - 1;
 		ret = tbdml_read_block(&addr, &ptr, (uint16_t)n);
 		if (ret != 0)
-			return ret;
+			goto done;
 		len -= n;
 	}
 
@@ -616,7 +787,7 @@ static int tbdml_read_mem(uint16_t addr, void *buf, size_t len)
 		n = TBDML_MAX_DATA_SIZE & 0xfe;
 		ret = tbdml_read_block(&addr, &ptr, (uint16_t)n);
 		if (ret != 0)
-			return ret;
+			goto done;
 		len -= n;
 	}
 
@@ -624,10 +795,15 @@ static int tbdml_read_mem(uint16_t addr, void *buf, size_t len)
 	{
 		ret = tbdml_read_block(&addr, &ptr, (uint16_t)len);
 		if (ret != 0)
-			return ret;
+			goto done;
 	}
 
-	return 0;
+	ret = 0;
+done:
+	/* queued block commands complete here */
+
+	ret2 = tbdml_async_flush();
+	return (ret != 0 ? ret : ret2);
 }
 
 
@@ -647,6 +823,7 @@ static int tbdml_write_mem(uint16_t addr, const void *buf, size_t len)
 	const uint8_t *ptr;
 	size_t n;
 	int ret;
+	int ret2;
 
 	if (len == 0)
 		return 0;
@@ -660,7 +837,7 @@ static int tbdml_write_mem(uint16_t addr, const void *buf, size_t len)
 		n = (TBDML_MAX_DATA_SIZE & 0xfe) - 1;
 		ret = tbdml_write_block(&addr, &ptr, (uint16_t)n);
 		if (ret != 0)
-			return ret;
+			goto done;
 		len -= n;
 	}
 
@@ -669,7 +846,7 @@ static int tbdml_write_mem(uint16_t addr, const void *buf, size_t len)
 		n = TBDML_MAX_DATA_SIZE & 0xfe;
 		ret = tbdml_write_block(&addr, &ptr, (uint16_t)n);
 		if (ret != 0)
-			return ret;
+			goto done;
 		len -= n;
 	}
 
@@ -677,10 +854,15 @@ static int tbdml_write_mem(uint16_t addr, const void *buf, size_t len)
 	{
 		ret = tbdml_write_block(&addr, &ptr, (uint16_t)len);
 		if (ret != 0)
-			return ret;
+			goto done;
 	}
 
-	return 0;
+	ret = 0;
+done:
+	/* queued block commands complete here */
+
+	ret2 = tbdml_async_flush();
+	return (ret != 0 ? ret : ret2);
 }
 
 
@@ -862,6 +1044,16 @@ static int tbdml_open(void)
 		       (unsigned int)(v_sw & 0x0f));
 	}
 
+	tbdml_async_enabled = sys_usb_async_available();
+	tbdml_async_head = 0;
+	tbdml_async_count = 0;
+	if (options.verbose && options.tbdml_bulk)
+	{
+		printf("TBDML bulk transfers <%s>\n",
+		       (const char *)(tbdml_async_enabled ?
+		       "asynchronous" : "synchronous"));
+	}
+
 	ret = tbdml_set_target_type(TBDML_TARGET_HC12);
 	if (ret != 0)
 		goto error;
@@ -942,5 +1134,6 @@ hcs12bdm_handler_t tbdml_bdm_handler =
 	tbdml_go,
 	NULL,
 	tbdml_trace1,
-	NULL
+	NULL,
+	tbdml_set_speed
 };
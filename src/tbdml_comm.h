@@ -34,6 +34,7 @@
 
 #define TBDML_TIMEOUT 1000 /* ms */
 #define TBDML_RESET_DELAY 100 /* ms */
+#define TBDML_ASYNC_DEPTH 8 /* block commands queued ahead in bulk mode */
 
 /* command format:
 
@@ -40,6 +40,14 @@
 #define HCS12_AGENT_CMD_FLASH_READ          0x0a
 #define HCS12_AGENT_CMD_FLASH_WRITE         0x0b
 #define HCS12_AGENT_CMD_FLASH_PROTECT       0x0c
+#define HCS12_AGENT_CMD_SCI_BAUD            0x0d
+#define HCS12_AGENT_CMD_EXIT                0x0e
+#define HCS12_AGENT_CMD_FLASH_MASS_ERASE_ALL 0x0f
+#define HCS12_AGENT_CMD_FLASH_WRITE_MULTI   0x10
+#define HCS12_AGENT_CMD_FLASH_READ_PACKED   0x11 /* LRAE agent only */
+#define HCS12_AGENT_CMD_FLASH_WRITE_PACKED  0x12 /* LRAE agent only */
+#define HCS12_AGENT_CMD_RING                0x13
+#define HCS12_AGENT_CMD_IMAGE_CRC           0x14
 
 #define HCS12_AGENT_ERROR_NONE        0x00
 #define HCS12_AGENT_ERROR_XTAL        0x01
@@ -48,4 +56,42 @@
 #define HCS12_AGENT_ERROR_PGM         0x04
 #define HCS12_AGENT_ERROR_SUM         0x55
 
+/* resident agent tag, placed just before agent entry point:
+   version (word), image hash (word, written by hcs12mem after loading);
+   version is raised when agent command behaviour changes (0xa612:
+   EEPROM_WRITE programs only differing words, with sector modify;
+   0xa613: IMAGE_CRC checks agent code between tag and image end,
+   agent variables are placed before tag) */
+
+#define HCS12_AGENT_TAG_SIZE          4
+#define HCS12_AGENT_TAG_VERSION       0xa613
+
+/* packed data (FLASH_READ_PACKED, FLASH_WRITE_PACKED): control byte
+   below HCS12_AGENT_PACK_RUN is followed by (control + 1) literal bytes,
+   other control byte by one byte repeated
+   (control - HCS12_AGENT_PACK_RUN + HCS12_AGENT_PACK_RUN_MIN) times;
+   packed write data is placed at agent buffer end and unpacked in place
+   to buffer start */
+
+#define HCS12_AGENT_PACK_RUN          0x80
+#define HCS12_AGENT_PACK_RUN_MIN      3
+#define HCS12_AGENT_PACK_RUN_MAX      130
+#define HCS12_AGENT_PACK_LITERAL_MAX  128
+
+/* command ring (RING): (param+0) descriptors at address (param+2),
+   each holding command, status and parameters laid out as at agent
+   start, followed by data address used by FLASH_WRITE instead of agent
+   buffer; descriptors are executed in order until one fails, status is
+   written back to each executed descriptor */
+
+#define HCS12_AGENT_RING_DESC         12
+#define HCS12_AGENT_RING_DESC_CMD     0
+#define HCS12_AGENT_RING_DESC_STATUS  1
+#define HCS12_AGENT_RING_DESC_PARAM   2
+#define HCS12_AGENT_RING_DESC_DATA    10
+#define HCS12_AGENT_RING_PENDING      0xff /* status of descriptor not executed */
+
+#define HCS12_AGENT_SCI_SYNC_MSG      0x55
+#define HCS12_AGENT_SCI_SYNC_ACK      0xaa
+
 #endif
@@ -594,7 +594,8 @@
 #  define FSEC_NV2 0x04
 #  define FSEC_SEC1 0x02
 #  define FSEC_SEC0 0x01
-/* #define RESERVED_0x0102 0x0102 */
+#define FTSTMOD 0x0102
+#  define FTSTMOD_WRALL 0x10
 #define FCNFG 0x0103
 #  define FCNFG_CBEIE 0x80
 #  define FCNFG_CCIE 0x40